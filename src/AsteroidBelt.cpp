@@ -0,0 +1,125 @@
+#include "AsteroidBelt.h"
+#include "KeplerSolver.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include <glm/ext.hpp>
+
+// Number of particles processed at once by a thread: the intermediate angles, sines and cosines stay in the L1 cache
+static const size_t kChunkSize = 1024;
+
+AsteroidBelt::AsteroidBelt(float innerRadius, float outerRadius, float referenceRadius, float referencePeriod) {
+    this->innerRadius = innerRadius;
+    this->outerRadius = outerRadius;
+    this->referenceRadius = referenceRadius;
+    this->referencePeriod = referencePeriod;
+}
+
+void AsteroidBelt::setParticleCount(size_t count) {
+    std::mt19937 rng(2024);
+    std::uniform_real_distribution<float> radiusDist(innerRadius, outerRadius);
+    std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * glm::pi<float>());
+    std::normal_distribution<float> inclinationDist(0.0f, 0.05f);
+
+    radii.resize(count);
+    angularSpeeds.resize(count);
+    phases.resize(count);
+    heightSin.resize(count);
+    heightCos.resize(count);
+    posX.assign(count, 0.0f);
+    posY.assign(count, 0.0f);
+    posZ.assign(count, 0.0f);
+    for (size_t i = 0; i < count; ++i) {
+        const float radius = radiusDist(rng);
+        // T = T_ref * (r / r_ref)^(3/2), with the periods divided by 10 as in OrbitalState
+        const float period = 0.1f * referencePeriod * std::pow(radius / referenceRadius, 1.5f);
+        const float inclination = inclinationDist(rng);
+        const float node = angleDist(rng);
+        radii[i] = radius;
+        angularSpeeds[i] = 2.0f * glm::pi<float>() / period;
+        phases[i] = angleDist(rng);
+        // Height of a circle tilted by the inclination around the line of nodes
+        heightSin[i] = radius * std::sin(inclination) * std::cos(node);
+        heightCos[i] = -radius * std::sin(inclination) * std::sin(node);
+    }
+}
+
+void AsteroidBelt::updateRange(double time, size_t begin, size_t end) {
+    float angles[kChunkSize], sines[kChunkSize], cosines[kChunkSize];
+    const double twoPi = 2.0 * glm::pi<double>();
+    const double invTwoPi = 1.0 / twoPi;
+
+    for (size_t first = begin; first < end; first += kChunkSize) {
+        const size_t n = std::min(kChunkSize, end - first);
+        const float *speed = angularSpeeds.data() + first;
+        const float *phase = phases.data() + first;
+        // The whole turns are removed in double precision, so that long runs keep their accuracy
+        for (size_t i = 0; i < n; ++i) {
+            const double angle = phase[i] + speed[i] * time;
+            angles[i] = static_cast<float>(angle - twoPi * std::floor(angle * invTwoPi));
+        }
+
+        computeSinCos(angles, sines, cosines, n);
+
+        const float *radius = radii.data() + first;
+        const float *hs = heightSin.data() + first;
+        const float *hc = heightCos.data() + first;
+        float *x = posX.data() + first;
+        float *y = posY.data() + first;
+        float *z = posZ.data() + first;
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = radius[i] * cosines[i];
+            y[i] = hs[i] * sines[i] + hc[i] * cosines[i];
+            z[i] = radius[i] * sines[i];
+        }
+    }
+}
+
+void AsteroidBelt::update(double time, ThreadPool &pool) {
+    const size_t chunkCount = (getParticleCount() + kChunkSize - 1) / kChunkSize;
+    pool.parallelFor(chunkCount, [&](size_t first, size_t last) {
+        updateRange(time, first * kChunkSize, std::min(last * kChunkSize, getParticleCount()));
+    });
+}
+
+void AsteroidBelt::init() {
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+    glGenBuffers(3, m_posVbo);
+    for (GLuint axis = 0; axis < 3; ++axis) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_posVbo[axis]);
+        glEnableVertexAttribArray(axis);
+        glVertexAttribPointer(axis, 1, GL_FLOAT, GL_FALSE, sizeof(GLfloat), 0);
+    }
+    glBindVertexArray(0);
+}
+
+void AsteroidBelt::render(GLuint program, Camera camera, const glm::vec3 &center) {
+    const size_t count = getParticleCount();
+    if (count == 0)
+        return;
+
+    // Stream the positions of this frame; reallocating the storage (orphaning) lets the driver
+    // hand out fresh memory instead of waiting for the draw call of the previous frame
+    const float *coordinates[3] = { posX.data(), posY.data(), posZ.data() };
+    for (int axis = 0; axis < 3; ++axis) {
+        glBindBuffer(GL_ARRAY_BUFFER, m_posVbo[axis]);
+        glBufferData(GL_ARRAY_BUFFER, count * sizeof(float), nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(float), coordinates[axis]);
+    }
+
+    const glm::mat4 viewMatrix = camera.computeViewMatrixAtOrigin();
+    const glm::mat4 projMatrix = camera.computeProjectionMatrix();
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "viewMat"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
+    glUniformMatrix4fv(glGetUniformLocation(program, "projMat"), 1, GL_FALSE, glm::value_ptr(projMatrix));
+    glUniform3f(glGetUniformLocation(program, "center"), center.x, center.y, center.z);
+
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    glBindVertexArray(m_vao);
+    glDrawArrays(GL_POINTS, 0, static_cast<GLsizei>(count));
+    glBindVertexArray(0);
+    glDisable(GL_PROGRAM_POINT_SIZE);
+}
@@ -0,0 +1,52 @@
+#ifndef _ASTEROIDBELT
+#define _ASTEROIDBELT
+
+#include <cstddef>
+#include <vector>
+#include <glad/gl.h>
+
+#include <glm/glm.hpp>
+
+#include "Camera.h"
+#include "ThreadPool.h"
+
+// Belt of massless particles on circular orbits around the origin, between two radii.
+// Unlike the CelestialObjects, the particles have no geometry, texture or draw call of their own:
+// their orbits are stored as structures of arrays and advanced together by a vectorized pass
+// (see computeSinCos), and the positions are streamed to the GPU and drawn as point sprites
+// with a single draw call.
+class AsteroidBelt {
+    public:
+        // The periods follow Kepler's third law, from the period of an orbit of the given reference radius
+        AsteroidBelt(float innerRadius, float outerRadius, float referenceRadius, float referencePeriod);
+        // Regenerates the given number of particles (the same ones for the same count)
+        void setParticleCount(size_t count);
+        size_t getParticleCount() const { return radii.size(); }
+
+        // Computes the positions of all the particles at the given time, in parallel on the pool
+        void update(double time, ThreadPool &pool);
+        glm::vec3 getPosition(size_t index) const { return glm::vec3(posX[index], posY[index], posZ[index]); }
+
+        void init(); // creates the GPU buffers; requires an OpenGL context
+        // The center of the belt is given relative to the camera (floating origin)
+        void render(GLuint program, Camera camera, const glm::vec3 &center);
+
+    private:
+        void updateRange(double time, size_t begin, size_t end);
+
+    private:
+        float innerRadius, outerRadius;
+        float referenceRadius, referencePeriod;
+        // Orbits: the angle along the orbit is phase + angularSpeed * time, the height above the
+        // ecliptic heightSin * sin(angle) + heightCos * cos(angle) (an inclined circle)
+        std::vector<float> radii;
+        std::vector<float> angularSpeeds;
+        std::vector<float> phases;
+        std::vector<float> heightSin, heightCos;
+        std::vector<float> posX, posY, posZ;
+
+        GLuint m_vao = 0;
+        GLuint m_posVbo[3] = { 0, 0, 0 }; // one buffer per coordinate, uploaded straight from the arrays
+};
+
+#endif
@@ -0,0 +1,906 @@
+#include "Benchmark.h"
+#include "AsteroidBelt.h"
+#include "BlockCompression.h"
+#include "Ephemeris.h"
+#include "ImageDecoder.h"
+#include "OrbitalState.h"
+#include "KeplerSolver.h"
+#include "MeshFile.h"
+#include "MeshOptimizer.h"
+#include "MipChain.h"
+#include "NBodySystem.h"
+#include "SnapshotRing.h"
+#include "SphereMesh.h"
+#include "ThreadPool.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double secondsSince(BenchClock::time_point start) {
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+void benchOrbitalState(size_t bodyCount, int frameCount) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> radiusDist(1.0f, 50.0f);
+    std::uniform_real_distribution<float> periodDist(10.0f, 5000.0f);
+    std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * glm::pi<float>());
+    std::uniform_real_distribution<float> inclinationDist(-0.1f, 0.1f);
+    std::uniform_real_distribution<float> eccentricityDist(0.0f, 0.3f);
+
+    // One star, then planets and moons attached to any previously created body
+    OrbitalState orbits;
+    orbits.reserve(bodyCount);
+    orbits.addBody(OrbitalState::kNoParent, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+    for (size_t i = 1; i < bodyCount; ++i) {
+        int parent = static_cast<int>(rng() % i);
+        orbits.addBody(parent, radiusDist(rng), eccentricityDist(rng), periodDist(rng), angleDist(rng), inclinationDist(rng));
+    }
+
+    orbits.update(0.0); // warm-up
+    BenchClock::time_point start = BenchClock::now();
+    for (int frame = 0; frame < frameCount; ++frame) {
+        orbits.update(frame / 60.0);
+    }
+    double elapsed = secondsSince(start);
+
+    // Prevent the compiler from discarding the updates
+    glm::dvec3 last = orbits.getPosition(bodyCount - 1);
+
+    std::cout << "OrbitalState: " << bodyCount << " bodies, " << frameCount << " frames in " << elapsed << " s" << std::endl;
+    std::cout << "  " << (static_cast<double>(bodyCount) * frameCount / elapsed) << " bodies updated per second"
+              << " (last position " << last.x << ", " << last.y << ", " << last.z << ")" << std::endl;
+}
+
+// Double precision solution of Kepler's equation: bisection to bracket the root, then Newton to polish it
+static void solveKeplerReference(double meanAnomaly, double e, double &cosNu, double &sinNu, double &radiusRatio) {
+    double m = meanAnomaly - 2.0 * M_PI * std::floor(meanAnomaly / (2.0 * M_PI) + 0.5);
+    double low = m - 1.0, high = m + 1.0;
+    for (int i = 0; i < 60; ++i) {
+        double mid = 0.5 * (low + high);
+        if (mid - e * std::sin(mid) > m)
+            high = mid;
+        else
+            low = mid;
+    }
+    double E = 0.5 * (low + high);
+    for (int i = 0; i < 3; ++i)
+        E -= (E - e * std::sin(E) - m) / (1.0 - e * std::cos(E));
+
+    radiusRatio = 1.0 - e * std::cos(E);
+    cosNu = (std::cos(E) - e) / radiusRatio;
+    sinNu = std::sqrt(1.0 - e * e) * std::sin(E) / radiusRatio;
+}
+
+typedef void (*KeplerFunction)(const float *, const float *, float *, float *, float *, size_t);
+
+static double maxKeplerError(KeplerFunction solve, const std::vector<float> &meanAnomalies, const std::vector<float> &eccentricities) {
+    const size_t n = meanAnomalies.size();
+    std::vector<float> cosNu(n), sinNu(n), ratio(n);
+    solve(meanAnomalies.data(), eccentricities.data(), cosNu.data(), sinNu.data(), ratio.data(), n);
+
+    double maxError = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+        double refCos, refSin, refRatio;
+        solveKeplerReference(meanAnomalies[i], eccentricities[i], refCos, refSin, refRatio);
+        maxError = std::max(maxError, std::abs(refCos - cosNu[i]));
+        maxError = std::max(maxError, std::abs(refSin - sinNu[i]));
+        maxError = std::max(maxError, std::abs(refRatio - ratio[i]));
+    }
+    return maxError;
+}
+
+static double keplerSolvesPerSecond(KeplerFunction solve, const std::vector<float> &meanAnomalies, const std::vector<float> &eccentricities, int repeatCount) {
+    const size_t n = meanAnomalies.size();
+    std::vector<float> cosNu(n), sinNu(n), ratio(n);
+    solve(meanAnomalies.data(), eccentricities.data(), cosNu.data(), sinNu.data(), ratio.data(), n); // warm-up
+
+    BenchClock::time_point start = BenchClock::now();
+    for (int i = 0; i < repeatCount; ++i)
+        solve(meanAnomalies.data(), eccentricities.data(), cosNu.data(), sinNu.data(), ratio.data(), n);
+    return static_cast<double>(n) * repeatCount / secondsSince(start);
+}
+
+bool benchKeplerSolver(size_t bodyCount, int repeatCount) {
+    // Accuracy is bounded by the float inputs: near the periapsis of very eccentric orbits,
+    // the true anomaly becomes too sensitive to the mean anomaly, hence the two ranges.
+    const float kEccentricityRanges[2][2] = { { 0.0f, 0.9f }, { 0.9f, 0.99f } };
+    const double kTolerances[2] = { 1e-5, 5e-3 };
+    const size_t checkCount = std::min<size_t>(bodyCount, 1000000);
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> anomalyDist(-100.0f, 100.0f);
+    bool success = true;
+
+    std::cout << "Kepler solver: " << keplerSolverPath() << " path, " << keplerSolverWidth() << " bodies per instruction" << std::endl;
+    for (int range = 0; range < 2; ++range) {
+        std::uniform_real_distribution<float> eccentricityDist(kEccentricityRanges[range][0], kEccentricityRanges[range][1]);
+        std::vector<float> meanAnomalies(checkCount), eccentricities(checkCount);
+        for (size_t i = 0; i < checkCount; ++i) {
+            meanAnomalies[i] = anomalyDist(rng);
+            eccentricities[i] = eccentricityDist(rng);
+        }
+
+        double simdError = maxKeplerError(solveKepler, meanAnomalies, eccentricities);
+        double scalarError = maxKeplerError(solveKeplerScalar, meanAnomalies, eccentricities);
+        bool passed = simdError < kTolerances[range] && scalarError < kTolerances[range];
+        success = success && passed;
+        std::cout << "  accuracy for e in [" << kEccentricityRanges[range][0] << ", " << kEccentricityRanges[range][1] << "]: max error "
+                  << simdError << " (" << keplerSolverPath() << "), " << scalarError << " (scalar), tolerance " << kTolerances[range]
+                  << (passed ? " PASSED" : " FAILED") << std::endl;
+    }
+
+    std::uniform_real_distribution<float> eccentricityDist(0.0f, 0.99f);
+    std::vector<float> meanAnomalies(bodyCount), eccentricities(bodyCount);
+    for (size_t i = 0; i < bodyCount; ++i) {
+        meanAnomalies[i] = anomalyDist(rng);
+        eccentricities[i] = eccentricityDist(rng);
+    }
+    double simdRate = keplerSolvesPerSecond(solveKepler, meanAnomalies, eccentricities, repeatCount);
+    double scalarRate = keplerSolvesPerSecond(solveKeplerScalar, meanAnomalies, eccentricities, repeatCount);
+    std::cout << "  throughput: " << simdRate << " solves per second (" << keplerSolverPath() << "), "
+              << scalarRate << " (scalar), speed-up " << simdRate / scalarRate << std::endl;
+
+    return success;
+}
+
+// A central mass of 1 and a thin disk of light bodies on circular orbits between the two radii
+static void addDisk(NBodySystem &system, size_t bodyCount, double G, double minRadius, double maxRadius) {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> radiusDist(minRadius, maxRadius);
+    std::uniform_real_distribution<double> angleDist(0.0, 2.0 * M_PI);
+    std::uniform_real_distribution<double> heightDist(-0.05, 0.05);
+    system.reserve(bodyCount);
+    system.addBody(glm::dvec3(0.0), glm::dvec3(0.0), 1.0);
+    for (size_t i = 1; i < bodyCount; ++i) {
+        double r = radiusDist(rng), a = angleDist(rng);
+        double speed = std::sqrt(G / r);
+        system.addBody(glm::dvec3(r * std::cos(a), heightDist(rng), r * std::sin(a)),
+                       glm::dvec3(-speed * std::sin(a), 0.0, speed * std::cos(a)), 1e-6);
+    }
+}
+
+// first, first * factor, first * factor^2... below last, then last itself
+static std::vector<size_t> geometricSteps(size_t first, size_t factor, size_t last) {
+    std::vector<size_t> steps;
+    for (size_t value = first; value < last; value *= factor)
+        steps.push_back(value);
+    steps.push_back(last);
+    return steps;
+}
+
+void benchNBody(size_t bodyCount, int stepCount, size_t maxThreads) {
+    const double G = 1.0;
+    const std::vector<size_t> bodyCounts = geometricSteps(1000, 10, bodyCount);
+    const std::vector<size_t> threadCounts = geometricSteps(1, 2, maxThreads);
+
+    std::cout << "N-body (Barnes-Hut): steps per second" << std::endl;
+    std::cout << "  bodies";
+    for (size_t threads : threadCounts)
+        std::cout << "\t" << threads << " thr.";
+    std::cout << std::endl;
+
+    for (size_t n : bodyCounts) {
+        std::cout << "  " << n;
+        for (size_t threads : threadCounts) {
+            ThreadPool pool(threads);
+            NBodySystem system(&pool, G);
+            addDisk(system, n, G, 1.0, 10.0);
+
+            system.step(1e-3); // warm-up, also computes the first accelerations
+            BenchClock::time_point start = BenchClock::now();
+            for (int step = 0; step < stepCount; ++step)
+                system.step(1e-3);
+            std::cout << "\t" << stepCount / secondsSince(start);
+        }
+        std::cout << std::endl;
+    }
+}
+
+void benchTimesteps(size_t bodyCount, int stepCount) {
+    const double G = 1.0;
+    const double dt = 0.02;
+    ThreadPool pool(0);
+
+    // The inner orbits are 1000 times shorter than the outer ones: most bodies need few steps
+    std::cout << "Block timesteps: " << bodyCount << " bodies, " << stepCount << " steps of " << dt << std::endl;
+    std::cout << "  mode\ttime (s)\tforce evals\tenergy drift" << std::endl;
+    for (int block = 1; block >= 0; --block) {
+        NBodySystem system(&pool, G);
+        addDisk(system, bodyCount, G, 0.1, 10.0);
+        system.setBlockTimesteps(block != 0);
+
+        const double initialEnergy = system.computeTotalEnergy();
+        BenchClock::time_point start = BenchClock::now();
+        for (int step = 0; step < stepCount; ++step)
+            system.step(dt);
+        const double seconds = secondsSince(start);
+        const double drift = std::abs((system.computeTotalEnergy() - initialEnergy) / initialEnergy);
+
+        std::cout << "  " << (block ? "block" : "uniform") << "\t" << seconds << "\t"
+                  << system.getForceEvaluationCount() << "\t" << drift << std::endl;
+        if (block) {
+            std::vector<size_t> histogram = system.getLevelHistogram();
+            std::cout << "  levels (bodies stepping dt/2^k):";
+            for (size_t k = 0; k < histogram.size(); ++k) {
+                if (histogram[k] > 0)
+                    std::cout << " " << k << ":" << histogram[k];
+            }
+            std::cout << std::endl;
+        }
+    }
+}
+
+bool benchEphemeris(size_t bodyCount, size_t lookupCount) {
+    const double kSpan = 3650.0; // 100 orbits of the Earth
+    const char *kPath = "ephemeris-bench.bin";
+
+    // Same kind of random hierarchy as in benchOrbitalState, with periods down to that of the Moon
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> radiusDist(1.0f, 50.0f);
+    std::uniform_real_distribution<float> periodDist(28.0f, 5000.0f);
+    std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * glm::pi<float>());
+    std::uniform_real_distribution<float> inclinationDist(-0.1f, 0.1f);
+    std::uniform_real_distribution<float> eccentricityDist(0.0f, 0.3f);
+    OrbitalState orbits;
+    orbits.addBody(OrbitalState::kNoParent, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
+    for (size_t i = 1; i < bodyCount; ++i) {
+        int parent = static_cast<int>(rng() % i);
+        orbits.addBody(parent, radiusDist(rng), eccentricityDist(rng), periodDist(rng), angleDist(rng), inclinationDist(rng));
+    }
+
+    BenchClock::time_point start = BenchClock::now();
+    Ephemeris ephemeris;
+    if (!Ephemeris::write(orbits, 0.0, kSpan, 8, 12, kPath) || !ephemeris.open(kPath)) {
+        std::cout << "Ephemeris: cannot write " << kPath << std::endl;
+        return false;
+    }
+    std::cout << "Ephemeris: " << bodyCount << " bodies over " << kSpan << " s, " << ephemeris.getFileSize() / 1024
+              << " KiB built in " << secondsSince(start) << " s" << std::endl;
+
+    // Random times, as when scrubbing through the timeline
+    std::uniform_real_distribution<double> timeDist(0.0, kSpan);
+    std::vector<double> times(1000);
+    for (double &time : times)
+        time = timeDist(rng);
+
+    // Accuracy against the double precision orbits, relative to the orbit radius
+    double maxError = 0.0;
+    for (size_t t = 0; t < 100; ++t) {
+        for (size_t i = 1; i < bodyCount; ++i) {
+            glm::dvec3 error = ephemeris.getPosition(i, times[t]) - orbits.computePosition(i, times[t]);
+            maxError = std::max(maxError, glm::length(error) / orbits.getOrbitRadius(i));
+        }
+    }
+    const bool accurate = maxError < 1e-8;
+    std::cout << "  max relative error " << maxError << (accurate ? " (ok)" : " (FAILED)") << std::endl;
+
+    // Playback (consecutive frames, whose segments stay in cache), then scrubbing (random times)
+    glm::dvec3 sum(0.0);
+    for (int scrubbing = 0; scrubbing < 2; ++scrubbing) {
+        start = BenchClock::now();
+        for (size_t lookup = 0; lookup < lookupCount; ++lookup) {
+            const double time = scrubbing ? times[lookup % times.size()] : lookup / 60.0;
+            for (size_t i = 0; i < bodyCount; ++i)
+                sum += ephemeris.getPosition(i, time);
+        }
+        const double ephemerisRate = static_cast<double>(lookupCount) * bodyCount / secondsSince(start);
+
+        start = BenchClock::now();
+        for (size_t lookup = 0; lookup < lookupCount; ++lookup) {
+            orbits.update(scrubbing ? times[lookup % times.size()] : lookup / 60.0);
+            sum += orbits.getPosition(bodyCount - 1);
+        }
+        const double orbitsRate = static_cast<double>(lookupCount) * bodyCount / secondsSince(start);
+
+        std::cout << "  " << (scrubbing ? "scrubbing" : "playback") << ", positions per second: " << ephemerisRate
+                  << " (ephemeris), " << orbitsRate << " (Kepler solver)" << std::endl;
+    }
+    std::cout << "  (checksum " << sum.x + sum.y + sum.z << ")" << std::endl;
+
+    ephemeris.close();
+    std::remove(kPath);
+    return accurate;
+}
+
+void benchAsteroidBelt(size_t particleCount, int frameCount) {
+    ThreadPool singleThread(1);
+    ThreadPool allThreads(0);
+
+    std::cout << "Asteroid belt update (" << keplerSolverPath() << "): ms per frame" << std::endl;
+    std::cout << "  particles\t1 thr.\t" << allThreads.getThreadCount() << " thr." << std::endl;
+    for (size_t n = 10000; n <= particleCount; n *= 10) {
+        AsteroidBelt belt(16.0f, 18.0f, 10.0f, 365.0f);
+        belt.setParticleCount(n);
+        std::cout << "  " << n;
+        for (int parallel = 0; parallel < 2; ++parallel) {
+            ThreadPool &pool = parallel ? allThreads : singleThread;
+            belt.update(0.0, pool); // warm-up
+            BenchClock::time_point start = BenchClock::now();
+            for (int frame = 0; frame < frameCount; ++frame)
+                belt.update(frame / 60.0, pool);
+            std::cout << "\t" << 1000.0 * secondsSince(start) / frameCount;
+        }
+        glm::vec3 last = belt.getPosition(n - 1);
+        std::cout << "\t(last position " << last.x << ", " << last.y << ", " << last.z << ")" << std::endl;
+    }
+}
+
+bool benchSnapshots(size_t bodyCount, int snapshotCount) {
+    const double G = 1.0;
+    const double dt = 1e-3;
+    const int kStepsPerSnapshot = 10;
+    const char *kPath = "snapshots-bench.bin";
+    ThreadPool pool(0);
+    NBodySystem system(&pool, G);
+    addDisk(system, bodyCount, G, 1.0, 10.0);
+
+    // A quarter of the snapshots stay in memory, the others are spilled
+    SnapshotRing ring(std::max(snapshotCount / 4, 1), 8);
+    if (!ring.enableSpill(kPath)) {
+        std::cout << "Snapshots: cannot write " << kPath << std::endl;
+        return false;
+    }
+
+    // Reference run, keeping the states at a few odd steps to compare with after seeking
+    const int totalSteps = snapshotCount * kStepsPerSnapshot;
+    std::vector<int> targets;
+    for (int k = 1; k <= 5; ++k)
+        targets.push_back(std::min(totalSteps, totalSteps * k / 6 + 3));
+    std::vector<std::vector<double> > expected(targets.size());
+
+    BenchClock::time_point start = BenchClock::now();
+    ring.record(0.0, system);
+    for (int step = 1; step <= totalSteps; ++step) {
+        system.step(dt);
+        if (step % kStepsPerSnapshot == 0)
+            ring.record(step * dt, system);
+        for (size_t t = 0; t < targets.size(); ++t) {
+            if (targets[t] == step)
+                system.getState(expected[t]);
+        }
+    }
+    const double secondsPerStep = secondsSince(start) / totalSteps;
+    std::cout << "Snapshots: " << bodyCount << " bodies, " << snapshotCount << " snapshots ("
+              << ring.getMemorySnapshotCount() << " in memory, " << ring.getSpilledSnapshotCount() << " spilled), "
+              << "compression " << static_cast<double>(ring.getRawBytes()) / ring.getStoredBytes() << ":1" << std::endl;
+
+    // Seek backward, from the latest target to the earliest, each restore truncating the timeline
+    bool exact = true;
+    std::vector<double> state;
+    for (size_t t = targets.size(); t-- > 0;) {
+        start = BenchClock::now();
+        double snapshotTime;
+        if (!ring.restore(targets[t] * dt, system, snapshotTime)) {
+            std::cout << "  no snapshot before step " << targets[t] << std::endl;
+            return false;
+        }
+        const int snapshotStep = static_cast<int>(std::lround(snapshotTime / dt));
+        for (int step = snapshotStep; step < targets[t]; ++step)
+            system.step(dt);
+        const double seconds = secondsSince(start);
+        system.getState(state);
+        const bool same = state == expected[t];
+        exact = exact && same;
+        std::cout << "  seek to step " << targets[t] << ": " << 1000.0 * seconds << " ms (replay from 0: "
+                  << 1000.0 * secondsPerStep * targets[t] << " ms), " << (same ? "identical" : "DIFFERENT") << std::endl;
+    }
+
+    std::remove(kPath);
+    return exact;
+}
+
+// Original generator: sin/cos for every vertex, and arrays grown one element at a time
+static void genSphereReference(size_t resolution, SphereGeometry &geometry) {
+    geometry.positions.clear();
+    geometry.normals.clear();
+    geometry.texCoords.clear();
+    geometry.indices.clear();
+    for (size_t i = 0; i <= resolution; ++i) {
+        float phi = glm::pi<float>() * static_cast<float>(i) / static_cast<float>(resolution);
+        for (size_t j = 0; j <= resolution; ++j) {
+            float theta = 2 * glm::pi<float>() * static_cast<float>(j) / static_cast<float>(resolution);
+            float x = sin(phi) * cos(theta);
+            float z = sin(phi) * sin(theta);
+            float y = cos(phi);
+            geometry.positions.push_back(x);
+            geometry.positions.push_back(y);
+            geometry.positions.push_back(z);
+            geometry.normals.push_back(x);
+            geometry.normals.push_back(y);
+            geometry.normals.push_back(z);
+            geometry.texCoords.push_back(static_cast<float>(j) / static_cast<float>(resolution));
+            geometry.texCoords.push_back(static_cast<float>(i) / static_cast<float>(resolution));
+        }
+    }
+    for (size_t i = 0; i < resolution; ++i) {
+        for (size_t j = 0; j < resolution; ++j) {
+            size_t p1 = i * (resolution + 1) + j;
+            size_t p2 = p1 + 1;
+            size_t p3 = (i + 1) * (resolution + 1) + j;
+            size_t p4 = p3 + 1;
+            geometry.indices.push_back(p1);
+            geometry.indices.push_back(p2);
+            geometry.indices.push_back(p3);
+            geometry.indices.push_back(p2);
+            geometry.indices.push_back(p4);
+            geometry.indices.push_back(p3);
+        }
+    }
+}
+
+static float maxDifference(const std::vector<float> &a, const std::vector<float> &b) {
+    if (a.size() != b.size())
+        return INFINITY;
+    float difference = 0.0f;
+    for (size_t k = 0; k < a.size(); ++k)
+        difference = std::max(difference, std::abs(a[k] - b[k]));
+    return difference;
+}
+
+bool benchSphereGeneration(size_t maxResolution, int repeatCount) {
+    ThreadPool allThreads(0);
+    bool identical = true;
+
+    std::cout << "Sphere generation: million vertices per second" << std::endl;
+    std::cout << "  resolution\tvertices\toriginal\t1 thr.\t" << allThreads.getThreadCount() << " thr.\tmax. difference" << std::endl;
+    for (size_t resolution = 64; resolution <= maxResolution; resolution *= 2) {
+        const double vertexCount = static_cast<double>((resolution + 1) * (resolution + 1));
+        std::cout << "  " << resolution << "\t" << static_cast<size_t>(vertexCount);
+
+        // A new geometry for each call of the original generator, as a re-initialized object would
+        // start from; the same one for the new generator, which then does not allocate
+        SphereGeometry reference;
+        BenchClock::time_point start = BenchClock::now();
+        for (int r = 0; r < repeatCount; ++r) {
+            SphereGeometry geometry;
+            genSphereReference(resolution, geometry);
+            if (r == repeatCount - 1)
+                std::swap(reference, geometry);
+        }
+        std::cout << "\t" << repeatCount * vertexCount / secondsSince(start) / 1e6;
+
+        SphereGeometry geometry;
+        for (int parallel = 0; parallel < 2; ++parallel) {
+            ThreadPool *pool = parallel ? &allThreads : nullptr;
+            SphereMesh::genSphere(resolution, geometry, pool); // warm-up, allocates the arrays
+            start = BenchClock::now();
+            for (int r = 0; r < repeatCount; ++r)
+                SphereMesh::genSphere(resolution, geometry, pool);
+            std::cout << "\t" << repeatCount * vertexCount / secondsSince(start) / 1e6;
+        }
+
+        // The new generator closes the seam and puts the poles exactly on the axis, hence small differences
+        const float difference = std::max(maxDifference(reference.positions, geometry.positions),
+                                          maxDifference(reference.texCoords, geometry.texCoords));
+        std::cout << "\t" << difference << std::endl;
+        if (difference > 1e-5f || reference.indices != geometry.indices || reference.normals != reference.positions
+            || geometry.normals != geometry.positions)
+            identical = false;
+    }
+
+    if (!identical)
+        std::cout << "Sphere generation: the geometries differ" << std::endl;
+    return identical;
+}
+
+struct SphereErrorStats {
+    double maxError = 0.0; // largest distance from the triangles to the unit sphere
+    size_t degenerateTriangles = 0;
+    double areaRatio = 0.0; // largest area over smallest one, without the degenerate triangles
+};
+
+static SphereErrorStats measureSphereError(const SphereGeometry &geometry) {
+    SphereErrorStats stats;
+    double minArea = INFINITY, maxArea = 0.0;
+    for (size_t t = 0; t < geometry.indices.size(); t += 3) {
+        glm::dvec3 p[3];
+        for (int k = 0; k < 3; ++k) {
+            const float *position = &geometry.positions[3 * geometry.indices[t + k]];
+            p[k] = glm::dvec3(position[0], position[1], position[2]);
+        }
+        const double area = 0.5 * glm::length(glm::cross(p[1] - p[0], p[2] - p[0]));
+        if (area < 1e-9) {
+            ++stats.degenerateTriangles;
+            continue;
+        }
+        minArea = std::min(minArea, area);
+        maxArea = std::max(maxArea, area);
+    }
+    stats.maxError = SphereMesh::computeMaxError(geometry);
+    stats.areaRatio = maxArea / minArea;
+    return stats;
+}
+
+void benchSphereError(size_t maxResolution) {
+    const SphereType types[3] = { SphereType::UV, SphereType::Ico, SphereType::Cube };
+    const char *names[3] = { "UV", "ico", "cube" };
+    SphereGeometry geometry;
+
+    std::cout << "Sphere tessellations: error relative to the radius" << std::endl;
+    std::cout << "  type\tresolution\ttriangles\tvertices\tmax. error\tdegenerate\tarea ratio" << std::endl;
+    for (int t = 0; t < 3; ++t) {
+        for (size_t resolution = 25; resolution <= maxResolution; resolution *= 2) {
+            SphereMesh::genGeometry(types[t], resolution, geometry, nullptr);
+            const SphereErrorStats stats = measureSphereError(geometry);
+            std::cout << "  " << names[t] << "\t" << resolution << "\t" << geometry.indices.size() / 3
+                      << "\t" << geometry.positions.size() / 3 << "\t" << stats.maxError
+                      << "\t" << stats.degenerateTriangles << "\t" << stats.areaRatio << std::endl;
+        }
+    }
+
+    // Same accuracy as the spheres of the solar system
+    const size_t kReferenceResolution = 100;
+    SphereMesh::genSphere(kReferenceResolution, geometry, nullptr);
+    const double targetError = measureSphereError(geometry).maxError;
+    const size_t referenceTriangles = geometry.indices.size() / 3;
+    std::cout << "Triangles for the error of the UV sphere at resolution " << kReferenceResolution
+              << " (" << targetError << "): UV " << referenceTriangles;
+    for (int t = 1; t < 3; ++t) {
+        size_t resolution = 4;
+        for (;; ++resolution) {
+            SphereMesh::genGeometry(types[t], resolution, geometry, nullptr);
+            if (measureSphereError(geometry).maxError <= targetError)
+                break;
+        }
+        std::cout << ", " << names[t] << " " << geometry.indices.size() / 3 << " (resolution " << resolution << ", "
+                  << 100.0 * (geometry.indices.size() / 3) / referenceTriangles << "%)";
+    }
+    std::cout << std::endl;
+}
+
+void benchVertexFormat(size_t maxResolution) {
+    const SphereType types[3] = { SphereType::UV, SphereType::Ico, SphereType::Cube };
+    const char *names[3] = { "UV", "ico", "cube" };
+    SphereGeometry geometry;
+    std::vector<PackedVertex> packed;
+
+    std::cout << "Packed sphere vertices: " << sizeof(PackedVertex) << " bytes per vertex instead of " << 8 * sizeof(float) << std::endl;
+    std::cout << "  type\tresolution\tvertices\tfloat KiB\tpacked KiB\tratio\tposition error\tnormal error (deg)\tuv error" << std::endl;
+    for (int t = 0; t < 3; ++t) {
+        for (size_t resolution = 20; resolution <= maxResolution; resolution *= 2) {
+            SphereMesh::genGeometry(types[t], resolution, geometry, nullptr);
+            SphereMesh::packVertices(geometry, packed);
+            const size_t vertexCount = packed.size();
+            const size_t floatBytes = sizeof(float) * 8 * vertexCount + sizeof(unsigned int) * geometry.indices.size();
+            const size_t indexSize = vertexCount <= 65536 ? sizeof(uint16_t) : sizeof(unsigned int); // as in SphereMesh::genBlobs
+            const size_t packedBytes = sizeof(PackedVertex) * vertexCount + indexSize * geometry.indices.size();
+
+            double positionError = 0.0, normalError = 0.0, texCoordError = 0.0;
+            for (size_t v = 0; v < vertexCount; ++v) {
+                float position[3], normal[3], texCoord[2];
+                SphereMesh::unpackVertex(packed[v], position, normal, texCoord);
+                double dot = 0.0;
+                for (int k = 0; k < 3; ++k) {
+                    positionError = std::max(positionError, std::abs(static_cast<double>(position[k]) - geometry.positions[3 * v + k]));
+                    dot += static_cast<double>(normal[k]) * geometry.normals[3 * v + k];
+                }
+                normalError = std::max(normalError, std::acos(std::min(dot, 1.0)));
+                for (int k = 0; k < 2; ++k)
+                    texCoordError = std::max(texCoordError, std::abs(static_cast<double>(texCoord[k]) - geometry.texCoords[2 * v + k]));
+            }
+            std::cout << "  " << names[t] << "\t" << resolution << "\t" << vertexCount << "\t" << floatBytes / 1024.0
+                      << "\t" << packedBytes / 1024.0 << "\t" << static_cast<double>(floatBytes) / packedBytes
+                      << "\t" << positionError << "\t" << glm::degrees(normalError) << "\t" << texCoordError << std::endl;
+        }
+    }
+}
+
+// Triangles of the mesh by the positions and texture coordinates of their vertices, starting from
+// the smallest vertex so that the rotations of a triangle compare equal
+static std::vector<std::vector<float> > sortedTriangles(const SphereGeometry &geometry) {
+    std::vector<std::vector<float> > triangles(geometry.indices.size() / 3);
+    for (size_t t = 0; t < triangles.size(); ++t) {
+        const unsigned int *triangle = &geometry.indices[3 * t];
+        std::vector<float> &vertices = triangles[t];
+        for (int k = 0; k < 3; ++k) {
+            const unsigned int v = triangle[k];
+            vertices.insert(vertices.end(), &geometry.positions[3 * v], &geometry.positions[3 * v] + 3);
+            vertices.insert(vertices.end(), &geometry.texCoords[2 * v], &geometry.texCoords[2 * v] + 2);
+        }
+        int first = 0;
+        for (int k = 1; k < 3; ++k) {
+            if (std::lexicographical_compare(vertices.begin() + 5 * k, vertices.begin() + 5 * k + 5, vertices.begin() + 5 * first, vertices.begin() + 5 * first + 5))
+                first = k;
+        }
+        std::rotate(vertices.begin(), vertices.begin() + 5 * first, vertices.end());
+    }
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+bool benchMeshOptimizer(size_t maxResolution) {
+    const SphereType types[3] = { SphereType::UV, SphereType::Ico, SphereType::Cube };
+    const char *names[3] = { "UV", "ico", "cube" };
+    SphereGeometry geometry;
+    bool identical = true;
+
+    // The overdraw pass is not used by SphereMesh: it is measured to show that it cannot help convex meshes
+    const float overdrawThreshold = 1.05f;
+    std::cout << "Mesh optimization: FIFO vertex cache of " << kVertexCacheSize << " entries, ACMR / ATVR / overdraw ("
+              << kOverdrawViewSize << "x" << kOverdrawViewSize << " views along the axes)" << std::endl;
+    std::cout << "  type\tresolution\ttriangles\tgenerated\tvertex cache\toverdraw pass\ttime (ms)" << std::endl;
+    for (int t = 0; t < 3; ++t) {
+        for (size_t resolution = 20; resolution <= maxResolution; resolution *= 2) {
+            SphereMesh::genGeometry(types[t], resolution, geometry, nullptr);
+            const size_t vertexCount = geometry.positions.size() / 3;
+            const VertexCacheStats generated = analyzeVertexCache(geometry.indices, vertexCount);
+            const OverdrawStats generatedOverdraw = analyzeOverdraw(geometry.indices, geometry.positions);
+            std::vector<unsigned int> indices = geometry.indices;
+            optimizeVertexCache(indices, vertexCount);
+            const VertexCacheStats cacheOptimized = analyzeVertexCache(indices, vertexCount);
+            const OverdrawStats cacheOverdraw = analyzeOverdraw(indices, geometry.positions);
+            optimizeOverdraw(indices, geometry.positions, overdrawThreshold);
+            const VertexCacheStats overdrawOptimized = analyzeVertexCache(indices, vertexCount);
+            const OverdrawStats overdrawOverdraw = analyzeOverdraw(indices, geometry.positions);
+
+            const std::vector<std::vector<float> > triangles = sortedTriangles(geometry);
+            const BenchClock::time_point start = BenchClock::now();
+            SphereMesh::optimizeGeometry(geometry);
+            const double elapsed = secondsSince(start);
+            identical = identical && sortedTriangles(geometry) == triangles;
+
+            std::cout << "  " << names[t] << "\t" << resolution << "\t" << geometry.indices.size() / 3
+                      << "\t" << generated.acmr << " / " << generated.atvr << " / " << generatedOverdraw.overdraw
+                      << "\t" << cacheOptimized.acmr << " / " << cacheOptimized.atvr << " / " << cacheOverdraw.overdraw
+                      << "\t" << overdrawOptimized.acmr << " / " << overdrawOptimized.atvr << " / " << overdrawOverdraw.overdraw
+                      << "\t" << 1e3 * elapsed << std::endl;
+        }
+    }
+    if (!identical)
+        std::cout << "FAILED: the optimized meshes have different triangles" << std::endl;
+    return identical;
+}
+
+bool benchMeshCache(size_t maxResolution) {
+    const SphereType types[3] = { SphereType::UV, SphereType::Ico, SphereType::Cube };
+    const char *path = "bench-meshes.bin";
+    ThreadPool pool(0);
+
+    // Levels of detail as in CelestialObject: halved from the resolution down to 10
+    std::vector<std::pair<SphereType, size_t> > keys;
+    for (int t = 0; t < 3; ++t) {
+        for (size_t resolution = maxResolution; resolution >= 10; resolution /= 2)
+            keys.push_back(std::make_pair(types[t], resolution));
+    }
+    std::vector<std::vector<PackedVertex> > vertices(keys.size());
+    std::vector<std::vector<unsigned char> > indices(keys.size());
+    std::vector<std::pair<std::string, MeshBlobs> > meshes(keys.size());
+
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t m = 0; m < keys.size(); ++m) {
+        meshes[m].first = SphereMesh::getName(keys[m].first, keys[m].second);
+        meshes[m].second = SphereMesh::genBlobs(keys[m].first, keys[m].second, &pool, vertices[m], indices[m]);
+    }
+    const double generateTime = secondsSince(start);
+
+    start = BenchClock::now();
+    const bool written = MeshFile::write(SphereMesh::getVertexLayout(), meshes, path);
+    const double writeTime = secondsSince(start);
+
+    // Loading maps the file and reads every byte of the blobs, as glBufferData would
+    start = BenchClock::now();
+    MeshFile file;
+    bool identical = written && file.open(path, SphereMesh::getVertexLayout());
+    unsigned int checksum = 0;
+    size_t bytes = 0;
+    std::vector<MeshBlobs> loaded(meshes.size());
+    for (size_t m = 0; identical && m < meshes.size(); ++m) {
+        identical = file.find(meshes[m].first, loaded[m]);
+        const size_t vertexBytes = loaded[m].vertexCount * sizeof(PackedVertex), indexBytes = loaded[m].indexCount * loaded[m].indexSize;
+        for (size_t i = 0; identical && i < vertexBytes; i += 4)
+            checksum += static_cast<const unsigned char *>(loaded[m].vertices)[i];
+        for (size_t i = 0; identical && i < indexBytes; i += 4)
+            checksum += static_cast<const unsigned char *>(loaded[m].indices)[i];
+        bytes += vertexBytes + indexBytes;
+    }
+    const double loadTime = secondsSince(start);
+
+    for (size_t m = 0; identical && m < meshes.size(); ++m) {
+        const MeshBlobs &a = meshes[m].second, &b = loaded[m];
+        identical = a.vertexCount == b.vertexCount && a.indexCount == b.indexCount && a.indexSize == b.indexSize
+                    && a.maxError == b.maxError
+                    && std::equal(static_cast<const char *>(a.vertices), static_cast<const char *>(a.vertices) + a.vertexCount * sizeof(PackedVertex),
+                                  static_cast<const char *>(b.vertices))
+                    && std::equal(static_cast<const char *>(a.indices), static_cast<const char *>(a.indices) + a.indexCount * a.indexSize,
+                                  static_cast<const char *>(b.indices));
+    }
+    const size_t fileSize = file.getFileSize();
+    file.close();
+    std::remove(path);
+
+    std::cout << "Mesh cache: " << meshes.size() << " meshes of the 3 sphere types, resolutions " << maxResolution
+              << " down to 10, " << bytes / 1024 << " KiB of blobs in a file of " << fileSize / 1024 << " KiB" << std::endl;
+    std::cout << "  generated and optimized on " << pool.getThreadCount() << " threads: " << 1e3 * generateTime << " ms" << std::endl;
+    std::cout << "  written: " << 1e3 * writeTime << " ms" << std::endl;
+    std::cout << "  mapped and read (checksum " << checksum << "): " << 1e3 * loadTime << " ms, "
+              << generateTime / loadTime << "x faster than generating" << std::endl;
+    if (!identical)
+        std::cout << "FAILED: the loaded meshes differ from the generated ones" << std::endl;
+    return identical;
+}
+
+bool benchImageDecoding(const std::vector<std::string> &paths, size_t threadCount) {
+    const int channels = 3;
+    std::vector<std::vector<unsigned char> > serialImages(paths.size());
+    double longestTime = 0.0;
+
+    BenchClock::time_point start = BenchClock::now();
+    for (size_t i = 0; i < paths.size(); ++i) {
+        const BenchClock::time_point imageStart = BenchClock::now();
+        int width, height, numComponents;
+        unsigned char *data = stbi_load(paths[i].c_str(), &width, &height, &numComponents, channels);
+        longestTime = std::max(longestTime, secondsSince(imageStart));
+        if (data)
+            serialImages[i].assign(data, data + static_cast<size_t>(width) * height * channels);
+        stbi_image_free(data);
+    }
+    const double serialTime = secondsSince(start);
+
+    ThreadPool pool(threadCount);
+    ImageDecoder decoder(&pool);
+    bool identical = true;
+    start = BenchClock::now();
+    for (const std::string &path : paths)
+        decoder.request(path, channels);
+    for (size_t i = 0; i < paths.size(); ++i) {
+        const DecodedImage image = decoder.take(paths[i], channels);
+        const size_t size = image.data ? static_cast<size_t>(image.width) * image.height * channels : 0;
+        identical = identical && size == serialImages[i].size() && std::equal(image.data, image.data + size, serialImages[i].begin());
+        stbi_image_free(image.data);
+    }
+    const double parallelTime = secondsSince(start);
+
+    std::cout << "Image decoding: " << paths.size() << " images" << std::endl;
+    std::cout << "  one after the other: " << 1e3 * serialTime << " ms, the longest " << 1e3 * longestTime << " ms" << std::endl;
+    std::cout << "  decoder on " << pool.getThreadCount() << " threads: " << 1e3 * parallelTime << " ms ("
+              << serialTime / parallelTime << "x faster, " << parallelTime / longestTime << "x the longest)" << std::endl;
+    if (!identical)
+        std::cout << "FAILED: the decoder gives different images" << std::endl;
+    return identical;
+}
+
+static double srgbToLinear(double c) {
+    return c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4);
+}
+
+static double linearToSrgb(double l) {
+    return l <= 0.0031308 ? 12.92 * l : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+}
+
+// Largest difference between the levels and the exact gamma-correct box filter of the first one,
+// in double precision and from the whole footprint of each texel in the first level
+static int maxMipError(const std::vector<MipLevel> &levels, int channels) {
+    const MipLevel &base = levels[0];
+    std::vector<double> linear(base.pixels.size());
+    for (size_t i = 0; i < linear.size(); ++i)
+        linear[i] = srgbToLinear(base.pixels[i] / 255.0);
+    int maxError = 0;
+    for (size_t l = 1; l < levels.size(); ++l) {
+        const MipLevel &level = levels[l];
+        const uint32_t footprint = 1u << l; // the sizes are powers of 2
+        for (uint32_t y = 0; y < level.height; ++y) {
+            for (uint32_t x = 0; x < level.width; ++x) {
+                for (int c = 0; c < channels; ++c) {
+                    double sum = 0.0;
+                    for (uint32_t v = 0; v < footprint; ++v) {
+                        for (uint32_t u = 0; u < footprint; ++u)
+                            sum += linear[((static_cast<size_t>(y) * footprint + v) * base.width + x * footprint + u) * channels + c];
+                    }
+                    const int exact = static_cast<int>(std::floor(255.0 * linearToSrgb(sum / (footprint * footprint)) + 0.5));
+                    maxError = std::max(maxError, std::abs(exact - level.pixels[(static_cast<size_t>(y) * level.width + x) * channels + c]));
+                }
+            }
+        }
+    }
+    return maxError;
+}
+
+bool benchMipGeneration(size_t size, size_t threadCount) {
+    const int channels = 3;
+    std::vector<unsigned char> image(size * size * channels);
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> noise(0, 255);
+    for (unsigned char &value : image)
+        value = static_cast<unsigned char>(noise(generator));
+
+    // A first small chain builds the color tables outside of the measures, then the best of 3 runs is kept
+    ThreadPool pool(threadCount);
+    std::vector<MipLevel> scalarLevels, simdLevels, parallelLevels;
+    buildMipChain(image.data(), 16, 16, channels, simdLevels);
+    double scalarTime = 0.0, simdTime = 0.0, parallelTime = 0.0;
+    for (int run = 0; run < 3; ++run) {
+        BenchClock::time_point start = BenchClock::now();
+        buildMipChainScalar(image.data(), size, size, channels, scalarLevels);
+        scalarTime = run == 0 ? secondsSince(start) : std::min(scalarTime, secondsSince(start));
+        start = BenchClock::now();
+        buildMipChain(image.data(), size, size, channels, simdLevels);
+        simdTime = run == 0 ? secondsSince(start) : std::min(simdTime, secondsSince(start));
+        start = BenchClock::now();
+        buildMipChain(image.data(), size, size, channels, parallelLevels, &pool);
+        parallelTime = run == 0 ? secondsSince(start) : std::min(parallelTime, secondsSince(start));
+    }
+
+    bool identical = scalarLevels.size() == simdLevels.size() && simdLevels.size() == parallelLevels.size();
+    for (size_t l = 0; identical && l < simdLevels.size(); ++l)
+        identical = scalarLevels[l].pixels == simdLevels[l].pixels && simdLevels[l].pixels == parallelLevels[l].pixels;
+    const bool powerOfTwo = (size & (size - 1)) == 0;
+    const int maxError = powerOfTwo ? maxMipError(simdLevels, channels) : 0;
+
+    const double megapixels = static_cast<double>(size) * size / 1e6;
+    std::cout << "Mip chain of a " << size << "x" << size << " RGB image, " << simdLevels.size() << " levels, gamma-correct box filter" << std::endl;
+    std::cout << "  scalar, 1 thread: " << megapixels / scalarTime << " MP/s" << std::endl;
+    std::cout << "  " << mipChainPath() << ", 1 thread: " << megapixels / simdTime << " MP/s (" << scalarTime / simdTime << "x)" << std::endl;
+    std::cout << "  " << mipChainPath() << ", " << "pool of " << pool.getThreadCount() << ": " << megapixels / parallelTime << " MP/s ("
+              << scalarTime / parallelTime << "x)" << std::endl;
+    if (powerOfTwo)
+        std::cout << "  largest difference with the exact filter: " << maxError << " / 255" << std::endl;
+    if (!identical)
+        std::cout << "FAILED: the code paths give different levels" << std::endl;
+    if (maxError > 1)
+        std::cout << "FAILED: the levels are more than 1/255 away from the exact filter" << std::endl;
+    return identical && maxError <= 1;
+}
+
+bool benchBlockCompression(const std::vector<std::string> &paths, size_t threadCount) {
+    const int channels = 3;
+    const BlockFormat formats[3] = { BlockFormat::BC1, BlockFormat::BC7, BlockFormat::ETC2 };
+    ThreadPool pool(threadCount);
+    double megapixels = 0.0, serialTimes[3] = {}, parallelTimes[3] = {}, psnrSums[3] = {};
+    size_t uncompressedBytes = 0, compressedBytes[3] = {};
+    bool valid = true;
+
+    std::cout << "Block compression: " << paths.size() << " images, PSNR of";
+    for (BlockFormat format : formats)
+        std::cout << " " << getBlockFormatName(format);
+    std::cout << std::endl;
+    for (const std::string &path : paths) {
+        int width, height, numComponents;
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &numComponents, channels);
+        if (!data) {
+            std::cout << "FAILED: cannot decode " << path << std::endl;
+            valid = false;
+            continue;
+        }
+        megapixels += static_cast<double>(width) * height / 1e6;
+        uncompressedBytes += static_cast<size_t>(width) * height * channels;
+        std::cout << "  " << path << " (" << width << "x" << height << "):";
+        for (int f = 0; f < 3; ++f) {
+            std::vector<unsigned char> serialBlocks, parallelBlocks, decoded;
+            BenchClock::time_point start = BenchClock::now();
+            compressImage(formats[f], data, width, height, channels, serialBlocks);
+            serialTimes[f] += secondsSince(start);
+            start = BenchClock::now();
+            compressImage(formats[f], data, width, height, channels, parallelBlocks, &pool);
+            parallelTimes[f] += secondsSince(start);
+            valid = valid && serialBlocks == parallelBlocks;
+
+            decompressImage(formats[f], serialBlocks.data(), width, height, channels, decoded);
+            const double psnr = computePsnr(data, decoded.data(), decoded.size());
+            psnrSums[f] += psnr;
+            compressedBytes[f] += serialBlocks.size();
+            std::cout << " " << psnr << " dB";
+        }
+        std::cout << std::endl;
+        stbi_image_free(data);
+    }
+
+    for (int f = 0; f < 3; ++f) {
+        std::cout << "  " << getBlockFormatName(formats[f]) << ": average PSNR " << psnrSums[f] / paths.size() << " dB, "
+                  << static_cast<double>(uncompressedBytes) / compressedBytes[f] << "x smaller than RGB8, "
+                  << megapixels / serialTimes[f] << " MP/s on 1 thread, " << megapixels / parallelTimes[f] << " MP/s on "
+                  << pool.getThreadCount() << " (" << serialTimes[f] / parallelTimes[f] << "x)" << std::endl;
+    }
+    if (!valid)
+        std::cout << "FAILED: the threads give different blocks, or an image cannot be decoded" << std::endl;
+    return valid;
+}
@@ -0,0 +1,87 @@
+#ifndef _BENCHMARK
+#define _BENCHMARK
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Headless micro-benchmarks, run from the command line instead of opening a window
+// (see main.cpp for the options). Results are printed on the standard output.
+
+// Advances a random hierarchy of bodies and reports the number of bodies updated per second.
+void benchOrbitalState(size_t bodyCount, int frameCount);
+
+// Checks the accuracy of the batched Kepler solver against a double precision reference,
+// then compares the throughput of its SIMD and scalar paths. Returns false if the accuracy check fails.
+bool benchKeplerSolver(size_t bodyCount, int repeatCount);
+
+// Runs the Barnes-Hut gravitational simulation on a disk of bodies for increasing body counts
+// (by factors of 10 from 1000, then bodyCount) and thread counts (powers of 2, then maxThreads),
+// and reports the steps per second.
+void benchNBody(size_t bodyCount, int stepCount, size_t maxThreads);
+
+// Integrates a disk of bodies with block timesteps, then with a single timestep for all the bodies,
+// and reports the time, the number of force evaluations and the relative drift of the total energy.
+void benchTimesteps(size_t bodyCount, int stepCount);
+
+// Builds the ephemeris tables of a random hierarchy of bodies, checks their accuracy against the
+// exact orbits, then compares the cost of random-time lookups with the one of the Kepler solver.
+// Returns false if the accuracy check fails.
+bool benchEphemeris(size_t bodyCount, size_t lookupCount);
+
+// Updates asteroid belts of 10k particles and more (by factors of 10 up to particleCount), on one
+// thread and on all of them, and reports the CPU time per frame. The upload and the draw call need
+// a window and are not included.
+void benchAsteroidBelt(size_t particleCount, int frameCount);
+
+// Integrates a disk of bodies while recording snapshots (partly spilled to disk), then seeks back
+// to various times and checks that restoring and replaying gives exactly the states of the
+// original run. Reports the compression of the snapshots and the cost of seeking compared to
+// replaying from the start. Returns false if a restored state differs.
+bool benchSnapshots(size_t bodyCount, int snapshotCount);
+
+// Generates UV spheres of increasing resolution (by factors of 2 up to maxResolution) with the
+// original vertex-by-vertex generator and with SphereMesh::genSphere, on one thread and on all of
+// them, and reports the vertices generated per second. Returns false if the geometries differ.
+bool benchSphereGeneration(size_t maxResolution, int repeatCount);
+
+// Reports the triangle count, the largest distance between the triangles and the unit sphere,
+// and the spread of the triangle areas of each sphere type, for resolutions up to maxResolution.
+// Then finds the fewest triangles each type needs to be as accurate as the UV sphere at resolution 100.
+void benchSphereError(size_t maxResolution);
+
+// Packs the vertices of each sphere type (see PackedVertex) for resolutions up to maxResolution,
+// and reports the bytes per vertex and per mesh compared to float vertices with 32-bit indices,
+// and the largest errors of the decoded positions, normals and texture coordinates.
+void benchVertexFormat(size_t maxResolution);
+
+// Generates each sphere type for resolutions up to maxResolution and reports the average cache miss
+// ratio (ACMR), transformed vertex ratio (ATVR) and overdraw of the generated order, after the vertex
+// cache optimization and after the overdraw one (which SphereMesh skips), and the time taken by
+// SphereMesh::optimizeGeometry.
+// Returns false if the optimized mesh does not have the same triangles.
+bool benchMeshOptimizer(size_t maxResolution);
+
+// Generates the levels of detail of each sphere type from maxResolution down to 10, writes them to a
+// mesh file, then maps it and reads the blobs back, as the second launch does, and compares the times.
+// Returns false if the loaded blobs differ from the generated ones.
+bool benchMeshCache(size_t maxResolution);
+
+// Decodes the images one after the other, as the startup used to, then all requested at once from an
+// ImageDecoder on threadCount threads (0 for all) and taken in order, as the startup does now, and
+// compares the time to the longest single decode. Returns false if the decoded images differ.
+bool benchImageDecoding(const std::vector<std::string> &paths, size_t threadCount);
+
+// Builds the mip chain of a random RGB image of size x size texels with the scalar code and the SIMD
+// one, on one thread then on threadCount (0 for all), and reports the megapixels of the image
+// processed per second. Returns false if the code paths give different levels, or if a level is more
+// than one 8-bit step away from the exact gamma-correct box filter.
+bool benchMipGeneration(size_t size, size_t threadCount);
+
+// Compresses the first level of each image in every block format, on one thread then on threadCount
+// (0 for all), and reports the PSNR of each image and the megapixels encoded per second by each format,
+// to trade the quality against the encoding time. Returns false if an image cannot be decoded or the
+// threads give different blocks.
+bool benchBlockCompression(const std::vector<std::string> &paths, size_t threadCount);
+
+#endif
@@ -0,0 +1,574 @@
+#include "BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+
+// Not in every OpenGL header: BC1 comes from EXT_texture_compression_s3tc, BC7 is core in OpenGL 4.2
+// and ETC2 in OpenGL 4.3
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#endif
+
+// The 16 texels of a block, in rows, as RGBA (alpha 255 for RGB images)
+typedef unsigned char BlockTexels[16][4];
+
+static int squaredDistance(const unsigned char *texel, const int *color, int channels) {
+    int distance = 0;
+    for (int c = 0; c < channels; ++c)
+        distance += (texel[c] - color[c]) * (texel[c] - color[c]);
+    return distance;
+}
+
+// Fits a line to the texels in the space of the given channels (3 or 4): axis is the principal
+// direction of their covariance, by power iteration, and the endpoints are the extreme texels
+// projected on it
+static void fitLine(const BlockTexels &texels, int channels, float *endpoint0, float *endpoint1) {
+    float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < channels; ++c)
+            mean[c] += texels[i][c] / 16.0f;
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < channels; ++c)
+            for (int d = 0; d < channels; ++d)
+                covariance[c][d] += (texels[i][c] - mean[c]) * (texels[i][d] - mean[d]);
+
+    float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float length = 0.0f;
+        for (int c = 0; c < channels; ++c) {
+            for (int d = 0; d < channels; ++d)
+                next[c] += covariance[c][d] * axis[d];
+            length = std::max(length, std::fabs(next[c]));
+        }
+        if (length == 0.0f)
+            break; // a uniform block, the endpoints are the mean
+        for (int c = 0; c < channels; ++c)
+            axis[c] = next[c] / length;
+    }
+
+    float axisLength = 0.0f;
+    for (int c = 0; c < channels; ++c)
+        axisLength += axis[c] * axis[c];
+    float lowest = 0.0f, highest = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float projection = 0.0f;
+        for (int c = 0; c < channels; ++c)
+            projection += (texels[i][c] - mean[c]) * axis[c];
+        lowest = std::min(lowest, projection / axisLength);
+        highest = std::max(highest, projection / axisLength);
+    }
+    for (int c = 0; c < channels; ++c) {
+        endpoint0[c] = std::min(255.0f, std::max(0.0f, mean[c] + highest * axis[c]));
+        endpoint1[c] = std::min(255.0f, std::max(0.0f, mean[c] + lowest * axis[c]));
+    }
+}
+
+// Least-squares endpoints of the texels for their positions between the endpoints (0 for endpoint0,
+// 1 for endpoint1). Returns false if the positions are all the same.
+static bool refineEndpoints(const BlockTexels &texels, const float *positions, int channels, float *endpoint0, float *endpoint1) {
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    float x0[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, x1[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < 16; ++i) {
+        const float t = positions[i];
+        a += (1.0f - t) * (1.0f - t);
+        b += t * (1.0f - t);
+        c += t * t;
+        for (int k = 0; k < channels; ++k) {
+            x0[k] += (1.0f - t) * texels[i][k];
+            x1[k] += t * texels[i][k];
+        }
+    }
+    const float determinant = a * c - b * b;
+    if (std::fabs(determinant) < 1e-6f)
+        return false;
+    for (int k = 0; k < channels; ++k) {
+        endpoint0[k] = std::min(255.0f, std::max(0.0f, (c * x0[k] - b * x1[k]) / determinant));
+        endpoint1[k] = std::min(255.0f, std::max(0.0f, (a * x1[k] - b * x0[k]) / determinant));
+    }
+    return true;
+}
+
+// BC1
+
+struct Bc1Block {
+    uint16_t color0, color1;
+    uint32_t indices; // 2 bits per texel, from the first one
+    int error;
+};
+
+static uint16_t packRgb565(const float *color) {
+    const int r = std::min(31, static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f));
+    const int g = std::min(63, static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f));
+    const int b = std::min(31, static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f));
+    return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+static void unpackRgb565(uint16_t color, int *rgb) {
+    const int r = color >> 11, g = (color >> 5) & 63, b = color & 31;
+    rgb[0] = r << 3 | r >> 2;
+    rgb[1] = g << 2 | g >> 4;
+    rgb[2] = b << 3 | b >> 2;
+}
+
+static void getBc1Palette(uint16_t color0, uint16_t color1, int palette[4][3]) {
+    unpackRgb565(color0, palette[0]);
+    unpackRgb565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        if (color0 > color1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0; // black, or transparent
+        }
+    }
+}
+
+// Quantizes the endpoints, in the order of the 4-color mode, and picks the closest color of each texel
+static Bc1Block evaluateBc1(const BlockTexels &texels, const float *endpoint0, const float *endpoint1) {
+    Bc1Block block;
+    block.color0 = packRgb565(endpoint0);
+    block.color1 = packRgb565(endpoint1);
+    if (block.color0 < block.color1)
+        std::swap(block.color0, block.color1);
+    int palette[4][3];
+    getBc1Palette(block.color0, block.color1, palette);
+    const int colorCount = block.color0 > block.color1 ? 4 : 1; // equal endpoints: a uniform block
+    block.indices = 0;
+    block.error = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestDistance = squaredDistance(texels[i], palette[0], 3);
+        for (int p = 1; p < colorCount; ++p) {
+            const int distance = squaredDistance(texels[i], palette[p], 3);
+            if (distance < bestDistance) {
+                best = p;
+                bestDistance = distance;
+            }
+        }
+        block.indices |= static_cast<uint32_t>(best) << (2 * i);
+        block.error += bestDistance;
+    }
+    return block;
+}
+
+static void encodeBc1(const BlockTexels &texels, unsigned char *out) {
+    float endpoint0[4], endpoint1[4];
+    fitLine(texels, 3, endpoint0, endpoint1);
+    Bc1Block best = evaluateBc1(texels, endpoint0, endpoint1);
+    const float kPositions[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+    for (int iteration = 0; iteration < 2 && best.error > 0; ++iteration) {
+        float positions[16];
+        for (int i = 0; i < 16; ++i)
+            positions[i] = kPositions[(best.indices >> (2 * i)) & 3];
+        if (!refineEndpoints(texels, positions, 3, endpoint0, endpoint1))
+            break;
+        const Bc1Block candidate = evaluateBc1(texels, endpoint0, endpoint1);
+        if (candidate.error >= best.error)
+            break;
+        best = candidate;
+    }
+
+    out[0] = best.color0 & 0xFF;
+    out[1] = best.color0 >> 8;
+    out[2] = best.color1 & 0xFF;
+    out[3] = best.color1 >> 8;
+    for (int b = 0; b < 4; ++b)
+        out[4 + b] = (best.indices >> (8 * b)) & 0xFF;
+}
+
+static void decodeBc1(const unsigned char *in, BlockTexels &texels) {
+    int palette[4][3];
+    getBc1Palette(static_cast<uint16_t>(in[0] | in[1] << 8), static_cast<uint16_t>(in[2] | in[3] << 8), palette);
+    const uint32_t indices = in[4] | in[5] << 8 | in[6] << 16 | static_cast<uint32_t>(in[7]) << 24;
+    for (int i = 0; i < 16; ++i) {
+        const int *color = palette[(indices >> (2 * i)) & 3];
+        for (int c = 0; c < 3; ++c)
+            texels[i][c] = static_cast<unsigned char>(color[c]);
+        texels[i][3] = 255;
+    }
+}
+
+// BC7, mode 6
+
+static const int kBc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct Bc7Block {
+    int endpoints[2][4]; // 7 bits
+    int pBits[2];
+    int indices[16];
+    int error;
+};
+
+// Low bits written from the first bit of the block, as BC7 reads them
+struct BitWriter {
+    unsigned char *out;
+    int position;
+    void write(uint32_t value, int count) {
+        for (int i = 0; i < count; ++i, ++position)
+            out[position >> 3] |= ((value >> i) & 1) << (position & 7);
+    }
+};
+
+struct BitReader {
+    const unsigned char *in;
+    int position;
+    int read(int count) {
+        int value = 0;
+        for (int i = 0; i < count; ++i, ++position)
+            value |= ((in[position >> 3] >> (position & 7)) & 1) << i;
+        return value;
+    }
+};
+
+// Closest 7-bit values and shared low bit of an RGBA endpoint
+static void quantizeBc7Endpoint(const float *endpoint, int *quantized, int &pBit) {
+    int bestError = std::numeric_limits<int>::max();
+    for (int p = 0; p < 2; ++p) {
+        int candidate[4], error = 0;
+        for (int c = 0; c < 4; ++c) {
+            candidate[c] = std::min(127, std::max(0, static_cast<int>((endpoint[c] - p) / 2.0f + 0.5f)));
+            const int value = candidate[c] << 1 | p;
+            error += static_cast<int>((value - endpoint[c]) * (value - endpoint[c]));
+        }
+        if (error < bestError) {
+            bestError = error;
+            pBit = p;
+            std::copy(candidate, candidate + 4, quantized);
+        }
+    }
+}
+
+static void getBc7Palette(const int endpoints[2][4], const int pBits[2], int palette[16][4]) {
+    for (int c = 0; c < 4; ++c) {
+        const int e0 = endpoints[0][c] << 1 | pBits[0], e1 = endpoints[1][c] << 1 | pBits[1];
+        for (int i = 0; i < 16; ++i)
+            palette[i][c] = ((64 - kBc7Weights[i]) * e0 + kBc7Weights[i] * e1 + 32) >> 6;
+    }
+}
+
+static Bc7Block evaluateBc7(const BlockTexels &texels, const float *endpoint0, const float *endpoint1) {
+    Bc7Block block;
+    quantizeBc7Endpoint(endpoint0, block.endpoints[0], block.pBits[0]);
+    quantizeBc7Endpoint(endpoint1, block.endpoints[1], block.pBits[1]);
+    int palette[16][4];
+    getBc7Palette(block.endpoints, block.pBits, palette);
+    block.error = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestDistance = squaredDistance(texels[i], palette[0], 4);
+        for (int p = 1; p < 16; ++p) {
+            const int distance = squaredDistance(texels[i], palette[p], 4);
+            if (distance < bestDistance) {
+                best = p;
+                bestDistance = distance;
+            }
+        }
+        block.indices[i] = best;
+        block.error += bestDistance;
+    }
+    return block;
+}
+
+static void encodeBc7(const BlockTexels &texels, unsigned char *out) {
+    float endpoint0[4], endpoint1[4];
+    fitLine(texels, 4, endpoint0, endpoint1);
+    Bc7Block best = evaluateBc7(texels, endpoint0, endpoint1);
+    for (int iteration = 0; iteration < 2 && best.error > 0; ++iteration) {
+        float positions[16];
+        for (int i = 0; i < 16; ++i)
+            positions[i] = kBc7Weights[best.indices[i]] / 64.0f;
+        if (!refineEndpoints(texels, positions, 4, endpoint0, endpoint1))
+            break;
+        const Bc7Block candidate = evaluateBc7(texels, endpoint0, endpoint1);
+        if (candidate.error >= best.error)
+            break;
+        best = candidate;
+    }
+
+    // The first index is stored without its high bit, so it must be below 8: the palette is symmetric,
+    // swapping the endpoints and reversing the indices gives the same colors
+    if (best.indices[0] >= 8) {
+        for (int c = 0; c < 4; ++c)
+            std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+        std::swap(best.pBits[0], best.pBits[1]);
+        for (int i = 0; i < 16; ++i)
+            best.indices[i] = 15 - best.indices[i];
+    }
+
+    std::memset(out, 0, 16);
+    BitWriter writer = { out, 0 };
+    writer.write(1 << 6, 7); // mode 6
+    for (int c = 0; c < 4; ++c) {
+        writer.write(best.endpoints[0][c], 7);
+        writer.write(best.endpoints[1][c], 7);
+    }
+    writer.write(best.pBits[0], 1);
+    writer.write(best.pBits[1], 1);
+    writer.write(best.indices[0], 3);
+    for (int i = 1; i < 16; ++i)
+        writer.write(best.indices[i], 4);
+}
+
+static void decodeBc7(const unsigned char *in, BlockTexels &texels) {
+    BitReader reader = { in, 0 };
+    if (reader.read(7) != 1 << 6) {
+        std::memset(texels, 0, sizeof(texels)); // only mode 6 is written, the other ones decode to black as invalid blocks
+        return;
+    }
+    int endpoints[2][4], pBits[2], palette[16][4];
+    for (int c = 0; c < 4; ++c) {
+        endpoints[0][c] = reader.read(7);
+        endpoints[1][c] = reader.read(7);
+    }
+    pBits[0] = reader.read(1);
+    pBits[1] = reader.read(1);
+    getBc7Palette(endpoints, pBits, palette);
+    for (int i = 0; i < 16; ++i) {
+        const int *color = palette[reader.read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; ++c)
+            texels[i][c] = static_cast<unsigned char>(color[c]);
+    }
+}
+
+// ETC2, individual and differential modes
+
+static const int kEtcModifiers[8][4] = {
+    { 2, 8, -2, -8 }, { 5, 17, -5, -17 }, { 9, 29, -9, -29 }, { 13, 42, -13, -42 },
+    { 18, 60, -18, -60 }, { 24, 80, -24, -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 }
+};
+
+static bool inSecondHalf(int texel, bool flip) {
+    return flip ? texel / 4 >= 2 : texel % 4 >= 2; // texels in rows: bottom half if flipped, right half otherwise
+}
+
+// Best table of a half-block for its base color, and the modifier of each of its texels
+static int fitEtcHalf(const BlockTexels &texels, bool flip, bool second, const int *base, int &table, int *modifiers) {
+    int bestError = std::numeric_limits<int>::max();
+    for (int t = 0; t < 8; ++t) {
+        int colors[4][3];
+        for (int m = 0; m < 4; ++m)
+            for (int c = 0; c < 3; ++c)
+                colors[m][c] = std::min(255, std::max(0, base[c] + kEtcModifiers[t][m]));
+        int error = 0, candidate[16];
+        for (int i = 0; i < 16 && error < bestError; ++i) {
+            if (inSecondHalf(i, flip) != second)
+                continue;
+            candidate[i] = 0;
+            int bestDistance = squaredDistance(texels[i], colors[0], 3);
+            for (int m = 1; m < 4; ++m) {
+                const int distance = squaredDistance(texels[i], colors[m], 3);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    candidate[i] = m;
+                }
+            }
+            error += bestDistance;
+        }
+        if (error < bestError) {
+            bestError = error;
+            table = t;
+            for (int i = 0; i < 16; ++i)
+                if (inSecondHalf(i, flip) == second)
+                    modifiers[i] = candidate[i];
+        }
+    }
+    return bestError;
+}
+
+static int expandBits(int value, int bits) {
+    return bits == 5 ? value << 3 | value >> 2 : value << 4 | value;
+}
+
+static void encodeEtc2(const BlockTexels &texels, unsigned char *out) {
+    uint64_t bestBits = 0;
+    int bestError = std::numeric_limits<int>::max();
+    for (int flip = 0; flip < 2; ++flip) {
+        float averages[2][3] = {};
+        for (int i = 0; i < 16; ++i)
+            for (int c = 0; c < 3; ++c)
+                averages[inSecondHalf(i, flip != 0)][c] += texels[i][c] / 8.0f;
+
+        // Differential mode when the half-blocks are close enough, individual mode in any case
+        for (int differential = 1; differential >= 0; --differential) {
+            const int bits = differential ? 5 : 4;
+            const int maximum = (1 << bits) - 1;
+            int quantized[2][3];
+            bool representable = true;
+            for (int h = 0; h < 2; ++h)
+                for (int c = 0; c < 3; ++c)
+                    quantized[h][c] = std::min(maximum, static_cast<int>(averages[h][c] * maximum / 255.0f + 0.5f));
+            for (int c = 0; differential && c < 3; ++c)
+                representable = representable && quantized[1][c] - quantized[0][c] >= -4 && quantized[1][c] - quantized[0][c] <= 3;
+            if (!representable)
+                continue;
+
+            int tables[2], modifiers[16], error = 0;
+            for (int h = 0; h < 2; ++h) {
+                int base[3];
+                for (int c = 0; c < 3; ++c)
+                    base[c] = expandBits(quantized[h][c], bits);
+                error += fitEtcHalf(texels, flip != 0, h == 1, base, tables[h], modifiers);
+            }
+            if (error >= bestError)
+                continue;
+
+            uint64_t blockBits = 0;
+            for (int c = 0; c < 3; ++c) {
+                const int shift = (differential ? 59 : 60) - 8 * c; // of the first color, whose high bit is 63 for R, 55 for G, 47 for B
+                if (differential)
+                    blockBits |= uint64_t(quantized[0][c]) << shift | uint64_t((quantized[1][c] - quantized[0][c]) & 7) << (shift - 3);
+                else
+                    blockBits |= uint64_t(quantized[0][c]) << shift | uint64_t(quantized[1][c]) << (shift - 4);
+            }
+            blockBits |= uint64_t(tables[0]) << 37 | uint64_t(tables[1]) << 34 | uint64_t(differential) << 33 | uint64_t(flip) << 32;
+            for (int i = 0; i < 16; ++i) {
+                const int k = (i % 4) * 4 + i / 4; // the texels of a block are stored by columns
+                blockBits |= uint64_t(modifiers[i] >> 1) << (16 + k) | uint64_t(modifiers[i] & 1) << k;
+            }
+            bestError = error;
+            bestBits = blockBits;
+        }
+    }
+    for (int b = 0; b < 8; ++b)
+        out[b] = (bestBits >> (56 - 8 * b)) & 0xFF; // big-endian
+}
+
+static void decodeEtc2(const unsigned char *in, BlockTexels &texels) {
+    uint64_t blockBits = 0;
+    for (int b = 0; b < 8; ++b)
+        blockBits = blockBits << 8 | in[b];
+    const bool differential = (blockBits >> 33) & 1, flip = (blockBits >> 32) & 1;
+    int bases[2][3];
+    for (int c = 0; c < 3; ++c) {
+        if (differential) {
+            const int shift = 59 - 8 * c;
+            const int first = (blockBits >> shift) & 31;
+            int delta = (blockBits >> (shift - 3)) & 7;
+            delta = delta >= 4 ? delta - 8 : delta;
+            bases[0][c] = expandBits(first, 5);
+            bases[1][c] = expandBits(first + delta, 5);
+        } else {
+            const int shift = 60 - 8 * c;
+            bases[0][c] = expandBits((blockBits >> shift) & 15, 4);
+            bases[1][c] = expandBits((blockBits >> (shift - 4)) & 15, 4);
+        }
+    }
+    const int tables[2] = { static_cast<int>((blockBits >> 37) & 7), static_cast<int>((blockBits >> 34) & 7) };
+    for (int i = 0; i < 16; ++i) {
+        const int k = (i % 4) * 4 + i / 4;
+        const int modifier = static_cast<int>(((blockBits >> (16 + k)) & 1) << 1 | ((blockBits >> k) & 1));
+        const int h = inSecondHalf(i, flip);
+        for (int c = 0; c < 3; ++c)
+            texels[i][c] = static_cast<unsigned char>(std::min(255, std::max(0, bases[h][c] + kEtcModifiers[tables[h]][modifier])));
+        texels[i][3] = 255;
+    }
+}
+
+// Images
+
+static size_t getBlockBytes(BlockFormat format) {
+    return format == BlockFormat::BC7 ? 16 : 8;
+}
+
+const char *getBlockFormatName(BlockFormat format) {
+    const char *names[4] = { "none", "bc1", "bc7", "etc2" };
+    return names[static_cast<int>(format)];
+}
+
+bool parseBlockFormat(const std::string &name, BlockFormat &format) {
+    const BlockFormat formats[4] = { BlockFormat::None, BlockFormat::BC1, BlockFormat::BC7, BlockFormat::ETC2 };
+    for (BlockFormat candidate : formats) {
+        if (name == getBlockFormatName(candidate)) {
+            format = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool canCompress(BlockFormat format, int channels) {
+    return (format == BlockFormat::BC7 && (channels == 3 || channels == 4)) || (format != BlockFormat::None && channels == 3);
+}
+
+uint32_t getBlockFormatGL(BlockFormat format) {
+    const uint32_t formats[4] = { 0, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_COMPRESSED_RGB8_ETC2 };
+    return formats[static_cast<int>(format)];
+}
+
+size_t getCompressedSize(BlockFormat format, uint32_t width, uint32_t height) {
+    return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * getBlockBytes(format);
+}
+
+void compressImage(BlockFormat format, const unsigned char *pixels, uint32_t width, uint32_t height, int channels,
+                   std::vector<unsigned char> &blocks, ThreadPool *pool) {
+    const uint32_t columns = (width + 3) / 4, rows = (height + 3) / 4;
+    const size_t blockBytes = getBlockBytes(format);
+    blocks.assign(getCompressedSize(format, width, height), 0);
+    std::function<void(size_t, size_t)> encodeRows = [&](size_t begin, size_t end) {
+        BlockTexels texels;
+        for (size_t row = begin; row < end; ++row) {
+            for (uint32_t column = 0; column < columns; ++column) {
+                for (int i = 0; i < 16; ++i) {
+                    const uint32_t x = std::min(width - 1, 4 * column + i % 4), y = std::min(height - 1, static_cast<uint32_t>(4 * row) + i / 4);
+                    const unsigned char *texel = pixels + (static_cast<size_t>(y) * width + x) * channels;
+                    for (int c = 0; c < 4; ++c)
+                        texels[i][c] = c < channels ? texel[c] : 255;
+                }
+                unsigned char *out = &blocks[(row * columns + column) * blockBytes];
+                if (format == BlockFormat::BC1)
+                    encodeBc1(texels, out);
+                else if (format == BlockFormat::BC7)
+                    encodeBc7(texels, out);
+                else
+                    encodeEtc2(texels, out);
+            }
+        }
+    };
+    if (pool)
+        pool->parallelFor(rows, encodeRows);
+    else
+        encodeRows(0, rows);
+}
+
+void decompressImage(BlockFormat format, const unsigned char *blocks, uint32_t width, uint32_t height, int channels,
+                     std::vector<unsigned char> &pixels) {
+    const uint32_t columns = (width + 3) / 4, rows = (height + 3) / 4;
+    const size_t blockBytes = getBlockBytes(format);
+    pixels.assign(static_cast<size_t>(width) * height * channels, 0);
+    BlockTexels texels;
+    for (uint32_t row = 0; row < rows; ++row) {
+        for (uint32_t column = 0; column < columns; ++column) {
+            const unsigned char *in = blocks + (static_cast<size_t>(row) * columns + column) * blockBytes;
+            if (format == BlockFormat::BC1)
+                decodeBc1(in, texels);
+            else if (format == BlockFormat::BC7)
+                decodeBc7(in, texels);
+            else
+                decodeEtc2(in, texels);
+            for (int i = 0; i < 16; ++i) {
+                const uint32_t x = 4 * column + i % 4, y = 4 * row + i / 4;
+                if (x < width && y < height)
+                    std::copy(texels[i], texels[i] + channels, &pixels[(static_cast<size_t>(y) * width + x) * channels]);
+            }
+        }
+    }
+}
+
+double computePsnr(const unsigned char *a, const unsigned char *b, size_t size) {
+    double squaredError = 0.0;
+    for (size_t i = 0; i < size; ++i)
+        squaredError += (a[i] - b[i]) * (a[i] - b[i]);
+    if (squaredError == 0.0)
+        return std::numeric_limits<double>::infinity();
+    return 10.0 * std::log10(255.0 * 255.0 * size / squaredError);
+}
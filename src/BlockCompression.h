@@ -0,0 +1,44 @@
+#ifndef _BLOCKCOMPRESSION
+#define _BLOCKCOMPRESSION
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Block-compressed formats of the baked textures, which the GPU samples without decompressing them
+// in memory. Each one stores the texels by blocks of 4x4, the blocks on the edges of a level being
+// padded with its last row and column:
+// - BC1 (S3TC): 8 bytes per block, 2 RGB565 endpoints and 2 bits per texel choosing one of the 4
+//   colors between them. For the opaque textures, 6 times smaller than RGB8.
+// - BC7 (BPTC): 16 bytes per block, here always in its mode 6, 2 RGBA endpoints of 7 bits plus a
+//   shared low bit and 4 bits per texel. Twice the size of BC1, with a much finer palette, and alpha.
+// - ETC2 (RGB8): 8 bytes per block, 2 half-blocks each with a base color and a table of luminance
+//   offsets chosen per texel, here in the modes it shares with ETC1. The format of OpenGL ES 3, core
+//   in OpenGL 4.3, for the platforms without BC1 or BC7.
+enum class BlockFormat { None, BC1, BC7, ETC2 };
+
+// Names as given to --bake-textures: none, bc1, bc7 and etc2
+const char *getBlockFormatName(BlockFormat format);
+bool parseBlockFormat(const std::string &name, BlockFormat &format); // returns false if the name is unknown
+
+// Whether images of the given channels (1, 3 or 4) can be stored in the format: BC1 and ETC2 for RGB only,
+// BC7 for RGB and RGBA
+bool canCompress(BlockFormat format, int channels);
+uint32_t getBlockFormatGL(BlockFormat format); // the internal format of glCompressedTexImage2D
+size_t getCompressedSize(BlockFormat format, uint32_t width, uint32_t height); // in bytes
+
+// Encodes the texels (tightly packed rows) into blocks, in rows of blocks from the top left one. The rows
+// of blocks are split among the threads of the pool, if any.
+void compressImage(BlockFormat format, const unsigned char *pixels, uint32_t width, uint32_t height, int channels,
+                   std::vector<unsigned char> &blocks, ThreadPool *pool = nullptr);
+// Decodes the blocks written by compressImage back to texels of the given channels, to measure the quality
+void decompressImage(BlockFormat format, const unsigned char *blocks, uint32_t width, uint32_t height, int channels,
+                     std::vector<unsigned char> &pixels);
+
+// Peak signal-to-noise ratio of the 8-bit values b against the values a, in dB (infinite if they are equal)
+double computePsnr(const unsigned char *a, const unsigned char *b, size_t size);
+
+#endif
@@ -5,6 +5,8 @@
 #ifndef _CAMERA_H
 #define _CAMERA_H
 
+#include <algorithm>
+
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include "glm/gtx/string_cast.hpp"
@@ -23,6 +25,10 @@ public:
 
     inline void setAspectRatio(const float a) { m_aspectRatio = a; }
 
+    inline float getViewportHeight() const { return m_viewportHeight; }
+
+    inline void setViewportHeight(const float h) { m_viewportHeight = h; }
+
     inline float getNear() const { return m_near; }
 
     inline void setNear(const float n) { m_near = n; }
@@ -39,11 +45,23 @@ public:
         return glm::lookAt(m_pos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
     }
 
+    // View matrix of the camera moved to the origin, for the rendering relative to the camera
+    // (floating origin): the positions are given with the camera position already subtracted
+    inline glm::mat4 computeViewMatrixAtOrigin() const {
+        return glm::lookAt(glm::vec3(0, 0, 0), -m_pos, glm::vec3(0, 1, 0));
+    }
+
     // Returns the projection matrix stemming from the camera intrinsic parameter.
     inline glm::mat4 computeProjectionMatrix() const {
         return glm::perspective(glm::radians(m_fov), m_aspectRatio, m_near, m_far);
     }
 
+    // Moves the camera towards its target (factor < 1) or away from it, staying at least minDistance away
+    void dolly(float factor, float minDistance) {
+        const float distance = glm::length(m_pos);
+        m_pos *= std::max(distance * factor, minDistance) / distance;
+    }
+
     // In order to adjust the zoom (i.e fov)
     void processMouseScroll(float yoffset) {
         m_fov -= (float)yoffset;
@@ -95,6 +113,7 @@ private:
     glm::vec3 m_pos = glm::vec3(0, 0, 0);
     float m_fov = 45.f; // Field of view, in degrees
     float m_aspectRatio = 1.f; // Ratio between the width and the height of the image
+    float m_viewportHeight = 1.f; // Height of the image, in pixels
     float m_near = 0.1f; // Distance before which geometry is excluded from the rasterization process
     float m_far = 10.f; // Distance after which the geometry is excluded from the rasterization process
     float m_zoom = 45.0f;
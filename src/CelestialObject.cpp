@@ -4,211 +4,77 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
-CelestialObject::CelestialObject(float radius, float rotationPeriod, size_t m_resolution, std::string texPath, CelestialType type) {
+CelestialObject::CelestialObject(OrbitalState *orbits, float radius, float rotationPeriod, size_t m_resolution, std::string texPath, CelestialType type) {
     this->type = type;
     this->radius = radius;
     this->rotationPeriod = rotationPeriod;
+    this->inclinationAngle = 0.0f;
     this->m_resolution = m_resolution;
     this->parent = nullptr;
     this->texPath = texPath;
-    this->center = glm::vec3(0.0);
+    this->orbits = orbits;
+    this->orbitIndex = orbits->addBody(OrbitalState::kNoParent, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 }
 
-CelestialObject::CelestialObject(float radius, CelestialObject *parent, float orbitRadius, float orbitPeriod, float rotationPeriod, float inclinationAngle, size_t m_resolution, std::string texPath, CelestialType type) {
+CelestialObject::CelestialObject(OrbitalState *orbits, float radius, CelestialObject *parent, float orbitRadius, float eccentricity, float orbitPeriod, float rotationPeriod, float inclinationAngle, size_t m_resolution, std::string texPath, CelestialType type) {
     this->type = type;
     this->radius = radius;
     this->parent = parent;
-    this->orbitPeriod = orbitPeriod;
-    this->orbitRadius = orbitRadius;
     this->rotationPeriod = rotationPeriod;
     this->inclinationAngle = inclinationAngle;
     this->m_resolution = m_resolution;
     this->texPath = texPath;
-    this->center = glm::vec3(parent->center.x  + orbitRadius, parent->center.y , parent->center.z);
+    this->orbits = orbits;
+    // The inclination angle is the tilt of the rotation axis, the orbit itself stays in the ecliptic plane
+    this->orbitIndex = orbits->addBody(static_cast<int>(parent->orbitIndex), orbitRadius, eccentricity, orbitPeriod, 0.0f, 0.0f);
 }
 
-void CelestialObject::init() {
-  m_vao = 0;
-  m_posVbo = 0;
-  m_normalVbo = 0;
-  m_ibo = 0;
-  this->genSphere();
-  this->initGPUgeometry();
-  m_texVbo = loadTextureFromFileToGPU(this->texPath);
+void CelestialObject::prefetchImages(TextureCache *textures, ImageDecoder *decoder) const {
+  textures->prefetch(this->texPath, TextureFormat::RGB);
+  if (this->terrainPool)
+    decoder->request(this->texPath, 1); // the heightmap
 }
 
-void CelestialObject::genSphere() {
-    // Clearing existing vectors if they contain data
-    this->m_vertexPositions.clear();
-    this->m_vertexNormals.clear();
-    this->m_triangleIndices.clear();
-
-    // Calculation of the vertices of the sphere
-    for (size_t i = 0; i <= this->m_resolution; ++i) {
-        float phi = glm::pi<float>() * static_cast<float>(i) / static_cast<float>(this->m_resolution); // Angle vertical (0 à pi)
-        for (size_t j = 0; j <= this->m_resolution; ++j) {
-            float theta = 2 * glm::pi<float>() * static_cast<float>(j) / static_cast<float>(this->m_resolution); // Angle horizontal (0 à 2*pi)
-
-            // Spherical coordinates
-            float x = this->radius * sin(phi) * cos(theta);
-            float z = this->radius * sin(phi) * sin(theta);
-            float y = this->radius * cos(phi);
-
-            // Add the positions
-            m_vertexPositions.push_back(x);
-            m_vertexPositions.push_back(y);
-            m_vertexPositions.push_back(z);
-
-            // Add the normals (same as the positions for a sphere)
-            m_vertexNormals.push_back(x);
-            m_vertexNormals.push_back(y);
-            m_vertexNormals.push_back(z);
-
-            float t1 = static_cast<float>(j)/static_cast<float>(m_resolution);
-            float t2 = static_cast<float>(i)/static_cast<float>(m_resolution);
-            m_vertexTexCoords.push_back(t1);
-            m_vertexTexCoords.push_back(t2);
-        }
-    }
-
-    // Computation of the indices of the triangles forming the sphere
-    for (size_t i = 0; i < m_resolution; ++i) {
-        for (size_t j = 0; j < m_resolution; ++j) {
-            size_t p1 = i * (m_resolution + 1) + j;
-            size_t p2 = p1 + 1;
-            size_t p3 = (i + 1) * (m_resolution + 1) + j;
-            size_t p4 = p3 + 1;
-
-            // Triangle 1
-            m_triangleIndices.push_back(p1);
-            m_triangleIndices.push_back(p2);
-            m_triangleIndices.push_back(p3);
-
-            // Triangle 2
-            m_triangleIndices.push_back(p2);
-            m_triangleIndices.push_back(p4);
-            m_triangleIndices.push_back(p3);
-        }
-    }
-}
-
-void CelestialObject::initGPUgeometry() {
- // Create a single handle, vertex array object that contains attributes,
- // vertex buffer objects (e.g., vertex's position, normal, and color)
-#ifdef _MY_OPENGL_IS_33_
-  glGenVertexArrays(1, &m_vao); // If your system doesn't support OpenGL 4.5, you should use this instead of glCreateVertexArrays.
-#else
-  glCreateVertexArrays(1, &m_vao);
-#endif
-  glBindVertexArray(m_vao);
-
-  // Generate a GPU buffer to store the positions of the vertices and the normals
-  size_t vertexBufferSize = sizeof(float)*m_vertexPositions.size(); // Gather the size of the buffer from the CPU-side vector
-  size_t vertexNormalsBufferSize = sizeof(float)*m_vertexNormals.size();
-  size_t vertexTexCoordsBufferSize = sizeof(float)*m_vertexTexCoords.size();
-#ifdef _MY_OPENGL_IS_33_
-  glGenBuffers(1, &m_posVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, m_posVbo);
-  glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, m_vertexPositions.data(), GL_DYNAMIC_READ);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), 0);
-
-  glGenBuffers(1, &m_normalVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, m_normalVbo);
-  glBufferData(GL_ARRAY_BUFFER, vertexNormalsBufferSize, m_vertexNormals.data(), GL_DYNAMIC_READ);
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), 0);
-
-  glGenBuffers(1, &m_texCoordVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, m_texCoordVbo);
-  glBufferData(GL_ARRAY_BUFFER, vertexTexCoordsBufferSize, m_vertexTexCoords.data(), GL_STATIC_DRAW);
-  glEnableVertexAttribArray(2);
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2*sizeof(GLfloat), 0);
-#else
-  glCreateBuffers(1, &m_posVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, m_posVbo);
-  glNamedBufferStorage(m_posVbo, vertexBufferSize, m_vertexPositions.data(), GL_DYNAMIC_STORAGE_BIT); // Create a data storage on the GPU and fill it from a CPU array
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), 0);
-  glEnableVertexAttribArray(0);
-
-  glCreateBuffers(1, &m_normalVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, m_normalVbo);
-  glNamedBufferStorage(GL_ARRAY_BUFFER, vertexNormalsBufferSize, m_vertexNormals.data(), GL_DYNAMIC_STORAGE_BIT);
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 3*sizeof(GLfloat), 0);
-
-  glCreateBuffers(1, &m_texCoordVbo);
-  glBindBuffer(GL_ARRAY_BUFFER, m_texCoordVbo);
-  glNamedBufferStorage(GL_ARRAY_BUFFER, vertexTexCoordsBufferSize, m_vertexTexCoords.data(), GL_DYNAMIC_STORAGE_BIT);
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 2*sizeof(GLfloat), 0);
-#endif
-
-  // Same for an index buffer object that stores the list of indices of the
-  // triangles forming the mesh
-  size_t indexBufferSize = sizeof(unsigned int)*m_triangleIndices.size();
-#ifdef _MY_OPENGL_IS_33_
-  glGenBuffers(1, &m_ibo);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, m_triangleIndices.data(), GL_DYNAMIC_READ);
-#else
-  glCreateBuffers(1, &m_ibo);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-  glNamedBufferStorage(g_ibo, indexBufferSize, m_triangleIndices.data(), GL_DYNAMIC_STORAGE_BIT);
-#endif
-
-  glBindVertexArray(0); // deactivate the VAO for now, will be activated again when rendering
-}
-
-GLuint CelestialObject::loadTextureFromFileToGPU(const std::string &filename) {
-    int width, height, numComponents;
-    // Loading the image in CPU memory using stb_image
-    unsigned char *data = stbi_load(
-            filename.c_str(),
-            &width, &height,
-            &numComponents, // 1 for a 8 bit grey-scale image, 3 for 24bits RGB image, 4 for 32bits RGBA image
-            0);
-
-    GLuint texID;
-    glGenTextures(1, &texID); // generate an OpenGL texture container
-    glBindTexture(GL_TEXTURE_2D, texID); // activate the texture
-    // Setup the texture filtering option and repeat mode; check www.opengl.org for details.
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    // Fill the GPU texture with the data stored in the CPU image
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-
-    // Free useless CPU memory
-    stbi_image_free(data);
-    glBindTexture(GL_TEXTURE_2D, 0); // unbind the texture
-
-    return texID;
+void CelestialObject::init(SphereMeshCache *meshes, TextureCache *textures, ImageDecoder *decoder) {
+  this->lods.clear();
+  for (size_t resolution = this->m_resolution; resolution >= kMinLodResolution || this->lods.empty(); resolution /= 2)
+    this->lods.insert(this->lods.begin(), &meshes->get(this->sphereType, resolution));
+  this->currentLod = this->lods.size() - 1;
+  this->proceduralSphere = &meshes->getProcedural();
+  this->impostor = &meshes->getImpostor();
+  this->texture = textures->get(this->texPath, TextureFormat::RGB);
+  if (!this->texture)
+    std::cerr << "WARNING: cannot load " << this->texPath << ", the object is untextured" << std::endl;
+
+  if (this->terrainPool) {
+    this->terrain.reset(new PlanetTerrain(this->terrainPool, kTerrainSlotCount));
+    if (!this->terrain->loadHeightmap(decoder, this->texPath, this->terrainHeightScale))
+      std::cerr << "WARNING: cannot load " << this->texPath << " as a heightmap, the terrain is flat" << std::endl;
+    this->terrain->init();
+  }
 }
 
-void CelestialObject::updateOrbit(float deltaTime, float r) {
-    // Update the orbit angle in function of the time and the orbital speed
-    float orbitAngle = 2 * M_PI * (1 / (this->orbitPeriod * 0.1)) * deltaTime; // * 0.1 for a smaller period
-
-    // Compute the new position of the planet
-    float newX = parent->center.x + r * glm::cos(orbitAngle);
-    float newZ = parent->center.z + r * glm::sin(orbitAngle);
-
-    // Update the center of the planet
-    center = glm::vec3(newX, parent->center.y, newZ);
+void CelestialObject::enableTerrain(ThreadPool *pool, float heightScale) {
+  this->terrainPool = pool;
+  this->terrainHeightScale = heightScale;
 }
 
-float CelestialObject::getRotationAngle(float deltaTime) {
-    float rotationAngle = 2.0 * M_PI * deltaTime / rotationPeriod * (1 / 0.1);
-    return rotationAngle;
+float CelestialObject::getRotationAngle(double time) {
+    // Whole turns are removed in double precision, so that the spin stays smooth after long runs
+    double turns = time / (rotationPeriod * 0.1);
+    return static_cast<float>(2.0 * M_PI * (turns - std::floor(turns)));
 }
 
 
-void CelestialObject::render(GLuint program, Camera camera) {
+void CelestialObject::render(GLuint program, GLuint impostorProgram, Camera camera, const glm::mat4 &orbitFrame, double time) {
 
-    glm::mat4 model = glm::mat4(1.0f);
-    const glm::mat4 viewMatrix = camera.computeViewMatrix();
+    // The orbit frame, i.e. the position of the object, comes from the scene hierarchy.
+    // The tilt and the spin of the object are not inherited by its satellites, so they are applied here.
+    // The camera sits at the origin of the rendering space, the orbit frame being relative to it.
+    glm::mat4 model = orbitFrame;
+    const glm::mat4 viewMatrix = camera.computeViewMatrixAtOrigin();
     const glm::mat4 projMatrix = camera.computeProjectionMatrix();
-    const glm::vec3 camPosition = camera.getPosition();
+    const glm::vec3 camPosition(0.0f);
 
     glUseProgram(program);
 
@@ -217,22 +83,88 @@ void CelestialObject::render(GLuint program, Camera camera) {
     glUniform3f(glGetUniformLocation(program, "camPos"), camPosition[0], camPosition[1], camPosition[2]);
 
     glActiveTexture(GL_TEXTURE0); // activate texture unit 0
-    glBindTexture(GL_TEXTURE_2D, this->m_texVbo);
+    glBindTexture(GL_TEXTURE_2D, this->texture ? this->texture->getId() : 0);
     glUniform1i(glGetUniformLocation(program, "material.albedoTex"), 0);
 
-    float deltaTime = (float) glfwGetTime();
-
-    if (this->type != CelestialType::Star) {
-        float distance = this->orbitRadius;
-        this->updateOrbit(deltaTime, distance);
+    model = glm::rotate(model, inclinationAngle, glm::vec3(1.0, 0.0, 0.0));
+    model = glm::rotate(model, this->getRotationAngle(time), glm::vec3(0.0, 1.0, 0.0));
+    model = glm::scale(model, glm::vec3(this->radius)); // the mesh is a unit sphere
+
+    // Close up, the terrain replaces the sphere once its coarsest patches are built
+    const float distance = glm::length(glm::vec3(orbitFrame[3]));
+    if (this->terrain && distance < kTerrainDistance * this->radius) {
+        this->terrain->update(glm::vec3(glm::inverse(model) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+        if (this->terrain->isReady()) {
+            // The patches keep float vertices
+            glUniform1i(glGetUniformLocation(program, "octahedralNormals"), GL_FALSE);
+            glUniform2f(glGetUniformLocation(program, "texCoordScale"), 1.0f, 1.0f);
+            this->terrain->render(program, model);
+            this->drawnTriangles = this->terrain->getDrawnTriangleCount();
+            return;
+        }
+    }
 
-        model = glm::translate(model, this->center);
+    // Far away, a quad ray-casting the sphere replaces the triangles
+    if (distance > this->radius && this->getProjectedRadius(camera, distance) < kImpostorMaxRadius) {
+        this->renderImpostor(impostorProgram, viewMatrix, projMatrix, model);
+        this->drawnTriangles = 2;
+        return;
     }
 
-    model = glm::rotate(model, inclinationAngle, glm::vec3(1.0, 0.0, 0.0));
-    model = glm::rotate(model, this->getRotationAngle(deltaTime), glm::vec3(0.0, 1.0, 0.0));
+    glUniformMatrix4fv(glGetUniformLocation(program, "modelMat"), 1, GL_FALSE, glm::value_ptr(model));
+    if (this->procedural) {
+        this->updateProceduralResolution(camera, distance);
+        this->proceduralSphere->draw(program, this->proceduralResolution);
+        this->drawnTriangles = ProceduralSphere::getTriangleCount(this->proceduralResolution);
+        return;
+    }
+    glUniform1i(glGetUniformLocation(program, "octahedralNormals"), GL_TRUE);
+    glUniform2f(glGetUniformLocation(program, "texCoordScale"), SphereMesh::kTexCoordScaleU, 1.0f);
+    this->updateLod(camera, distance);
+    this->lods[this->currentLod]->draw();
+    this->drawnTriangles = this->lods[this->currentLod]->getTriangleCount();
+}
 
+void CelestialObject::renderImpostor(GLuint program, const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix, const glm::mat4 &model) {
+    glUseProgram(program);
+    glUniformMatrix4fv(glGetUniformLocation(program, "viewMat"), 1, GL_FALSE, glm::value_ptr(viewMatrix));
+    glUniformMatrix4fv(glGetUniformLocation(program, "projMat"), 1, GL_FALSE, glm::value_ptr(projMatrix));
     glUniformMatrix4fv(glGetUniformLocation(program, "modelMat"), 1, GL_FALSE, glm::value_ptr(model));
-    glBindVertexArray(m_vao);
-    glDrawElements(GL_TRIANGLES, m_triangleIndices.size(), GL_UNSIGNED_INT, 0); // Call for rendering: stream the current GPU geometry through the current GPU program
-}
\ No newline at end of file
+    glUniform3f(glGetUniformLocation(program, "camPos"), 0.0f, 0.0f, 0.0f);
+    glUniform1i(glGetUniformLocation(program, "material.albedoTex"), 0); // the texture is bound by render
+    glUniform1i(glGetUniformLocation(program, "lit"), this->type == CelestialType::Planet); // the stars shine
+    this->impostor->draw();
+}
+
+float CelestialObject::getProjectedRadius(const Camera &camera, float distance) const {
+    // Radius of the silhouette on the screen; the errors of the meshes are relative to their radius
+    const float angularRadius = this->radius / std::sqrt(distance * distance - this->radius * this->radius); // tangent
+    return angularRadius / std::tan(0.5f * glm::radians(camera.getFov())) * 0.5f * camera.getViewportHeight();
+}
+
+void CelestialObject::updateLod(const Camera &camera, float distance) {
+    if (distance <= this->radius) {
+        this->currentLod = this->lods.size() - 1;
+        return;
+    }
+    const float projectedRadius = this->getProjectedRadius(camera, distance);
+
+    while (this->currentLod + 1 < this->lods.size() && this->lods[this->currentLod]->getMaxError() * projectedRadius > kMaxPixelError)
+        ++this->currentLod;
+    while (this->currentLod > 0 && this->lods[this->currentLod - 1]->getMaxError() * projectedRadius < kLodHysteresis * kMaxPixelError)
+        --this->currentLod;
+}
+
+void CelestialObject::updateProceduralResolution(const Camera &camera, float distance) {
+    if (distance <= this->radius) {
+        this->proceduralResolution = kMaxProceduralResolution;
+        return;
+    }
+    const float projectedRadius = this->getProjectedRadius(camera, distance);
+    const size_t needed = std::min(std::max(ProceduralSphere::getResolutionForError(kMaxPixelError / projectedRadius),
+                                            static_cast<size_t>(kMinLodResolution)),
+                                   static_cast<size_t>(kMaxProceduralResolution));
+    if (this->proceduralResolution < needed
+        || ProceduralSphere::getMaxError(this->proceduralResolution) * projectedRadius < kLodHysteresis * kMaxPixelError)
+        this->proceduralResolution = needed;
+}
@@ -2,6 +2,7 @@
 #define _CELESTIALOBJECT
 
 #include <iostream>
+#include <memory>
 #include <vector>
 #include <glad/gl.h>
 #include <GLFW/glfw3.h>
@@ -9,46 +10,82 @@
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include "Camera.h"
+#include "OrbitalState.h"
+#include "PlanetTerrain.h"
+#include "SphereMesh.h"
+#include "TextureCache.h"
 
 enum class CelestialType { Planet, Star };
 
 class CelestialObject {
     public:
-        CelestialObject(float radius, CelestialObject *parent, float orbitRadius, float orbitPeriod, float rotationPeriod, float inclinationAngle, size_t m_resolution, std::string texPath, CelestialType type);
-        CelestialObject(float radius, float rotationPeriod, size_t m_resolution, std::string texPath, CelestialType type);
-        void init(); // should properly set up the geometry buffer
-        void render(GLuint program, Camera camera); // should be called in the main rendering loop
+        CelestialObject(OrbitalState *orbits, float radius, CelestialObject *parent, float orbitRadius, float eccentricity, float orbitPeriod, float rotationPeriod, float inclinationAngle, size_t m_resolution, std::string texPath, CelestialType type);
+        CelestialObject(OrbitalState *orbits, float radius, float rotationPeriod, size_t m_resolution, std::string texPath, CelestialType type);
+        void setSphereType(SphereType type) { this->sphereType = type; } // before init, UV sphere by default
+        // Before init: closer than kTerrainDistance radii, the object is drawn as a terrain displaced by
+        // the grey levels of its texture (heightScale relative to the radius), built on the pool
+        void enableTerrain(ThreadPool *pool, float heightScale);
+        // Draws the procedural UV sphere instead of the meshes, at the resolution just within
+        // kMaxPixelError (with the same hysteresis as the levels of detail); can change at any time
+        void setProcedural(bool enabled) { this->procedural = enabled; }
+        bool isProcedural() const { return this->procedural; }
+        // Starts decoding the images used by init, before the OpenGL context exists
+        void prefetchImages(TextureCache *textures, ImageDecoder *decoder) const;
+        // Gets the shared sphere meshes of its type, from its resolution down by factors of 2 (levels of detail), its shared
+        // texture and its heightmap
+        void init(SphereMeshCache *meshes, TextureCache *textures, ImageDecoder *decoder);
+        // Should be called in the main rendering loop, with the transform of the orbit of the object
+        // relative to the camera (floating origin, see SceneHierarchy) and the simulation time to display.
+        // Below kImpostorMaxRadius pixels, the object is drawn as an impostor with the second program.
+        void render(GLuint program, GLuint impostorProgram, Camera camera, const glm::mat4 &orbitFrame, double time);
         CelestialType getType() { return this->type; }
-        float getOrbitRadius() { return this->orbitRadius; }
+        size_t getOrbitIndex() { return this->orbitIndex; }
+        float getOrbitRadius() { return this->orbits->getOrbitRadius(this->orbitIndex); }
+        float getRadius() const { return this->radius; }
+        const std::string &getTexturePath() const { return this->texPath; }
+        size_t getDrawnTriangleCount() const { return this->drawnTriangles; } // in the last render
+        const PlanetTerrain *getTerrain() const { return this->terrain.get(); } // null if not enabled
+
+        const static size_t kMinLodResolution = 10;
+        // Largest distance, in pixels, between the drawn mesh and the true sphere. The level of detail
+        // gets finer as soon as it is exceeded, but coarser only once the coarser level is within
+        // kLodHysteresis of it, so that an object at a constant distance does not switch back and forth.
+        constexpr static float kMaxPixelError = 0.5f;
+        constexpr static float kLodHysteresis = 0.5f;
+        constexpr static float kTerrainDistance = 4.0f;
+        const static size_t kTerrainSlotCount = 256;
+        const static size_t kMaxProceduralResolution = 1024;
+        constexpr static float kImpostorMaxRadius = 64.0f; // in pixels
     
     private:
-        void initGPUgeometry();
-        void genSphere();
-        GLuint loadTextureFromFileToGPU(const std::string &filename);
-        void updateOrbit(float deltaTime, float radius);
-        float getRotationAngle(float deltaTime);
+        float getRotationAngle(double time);
+        float getProjectedRadius(const Camera &camera, float distance) const; // in pixels
+        void updateLod(const Camera &camera, float distance);
+        void updateProceduralResolution(const Camera &camera, float distance);
+        void renderImpostor(GLuint program, const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix, const glm::mat4 &model);
 
     private:
         CelestialType type;
         CelestialObject* parent;
+        OrbitalState* orbits; // shared store holding the orbit of this object
+        size_t orbitIndex;
         size_t m_resolution;
         std::string texPath;
         float radius;
-        float orbitRadius;
-        float orbitPeriod;
         float rotationPeriod;
         float inclinationAngle;
-        glm::vec3 center;
-        std::vector<float> m_vertexPositions;
-        std::vector<float> m_vertexNormals;
-        std::vector<unsigned int> m_triangleIndices;
-        std::vector<float> m_vertexTexCoords;
-        GLuint m_vao;
-        GLuint m_texVbo;
-        GLuint m_posVbo;
-        GLuint m_normalVbo;
-        GLuint m_ibo;
-        GLuint m_texCoordVbo;
+        SphereType sphereType = SphereType::UV;
+        std::vector<const SphereMesh*> lods; // from the coarsest, shared with the other objects of the same type
+        size_t currentLod = 0;
+        const ProceduralSphere *proceduralSphere = nullptr;
+        const SphereImpostor *impostor = nullptr;
+        bool procedural = false;
+        size_t proceduralResolution = kMinLodResolution;
+        size_t drawnTriangles = 0;
+        std::unique_ptr<PlanetTerrain> terrain;
+        ThreadPool *terrainPool = nullptr;
+        float terrainHeightScale = 0.0f;
+        std::shared_ptr<const Texture> texture; // shared with the other objects of the same texture
         glm::mat4 m_modelMatrix;
 };
 
@@ -0,0 +1,163 @@
+#include "Ephemeris.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+static const char kMagic[4] = { 'E', 'P', 'H', 'M' };
+static const uint32_t kVersion = 2; // 1 stored the coefficients in float
+
+// FNV-1a over the parents and a few reference positions: any change of the orbital elements changes the hash
+uint64_t Ephemeris::hashOrbits(const OrbitalState &orbits) {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void *bytes, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            hash ^= static_cast<const unsigned char *>(bytes)[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    for (size_t i = 0; i < orbits.size(); ++i) {
+        int32_t parent = orbits.getParent(i);
+        float period = orbits.getOrbitPeriod(i);
+        mix(&parent, sizeof(parent));
+        mix(&period, sizeof(period));
+        for (int t = 0; t < 3; ++t) {
+            glm::vec3 p = glm::vec3(orbits.computePosition(i, t * 0.37 * period));
+            mix(&p.x, sizeof(float));
+            mix(&p.y, sizeof(float));
+            mix(&p.z, sizeof(float));
+        }
+    }
+    return hash;
+}
+
+bool Ephemeris::write(const OrbitalState &orbits, double startTime, double endTime,
+                      int segmentsPerOrbit, int coefficientCount, const std::string &path) {
+    const size_t n = orbits.size();
+    const double span = endTime - startTime;
+    if (span <= 0.0 || segmentsPerOrbit < 1 || coefficientCount < 1)
+        return false;
+
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.bodyCount = static_cast<uint32_t>(n);
+    header.coefficientCount = static_cast<uint32_t>(coefficientCount);
+    header.startTime = startTime;
+    header.endTime = endTime;
+    header.orbitsHash = hashOrbits(orbits);
+
+    // Bodies without orbit are constant: a single segment is enough
+    std::vector<BodyRecord> records(n);
+    uint64_t offset = sizeof(Header) + n * sizeof(BodyRecord);
+    for (size_t i = 0; i < n; ++i) {
+        const double period = 0.1 * orbits.getOrbitPeriod(i); // the periods are divided by 10 (see OrbitalState)
+        const double segmentCount = period > 0.0 ? std::ceil(span * segmentsPerOrbit / period) : 1.0;
+        records[i].parent = orbits.getParent(i);
+        records[i].segmentCount = static_cast<uint32_t>(segmentCount);
+        records[i].segmentDuration = span / segmentCount;
+        records[i].offset = offset;
+        offset += uint64_t(records[i].segmentCount) * 3 * coefficientCount * sizeof(double);
+    }
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(records.data()), n * sizeof(BodyRecord));
+
+    // Chebyshev interpolation at the Chebyshev nodes x_k = cos(pi (k + 1/2) / N) of each segment:
+    // c_j = 2/N sum_k f(x_k) T_j(x_k), the first coefficient being halved
+    const int N = coefficientCount;
+    std::vector<double> nodeCosines(N * N);
+    for (int j = 0; j < N; ++j)
+        for (int k = 0; k < N; ++k)
+            nodeCosines[j * N + k] = std::cos(glm::pi<double>() * j * (k + 0.5) / N);
+
+    std::vector<glm::dvec3> samples(N);
+    std::vector<double> coefficients(3 * N);
+    for (size_t i = 0; i < n; ++i) {
+        for (uint32_t segment = 0; segment < records[i].segmentCount; ++segment) {
+            const double segmentStart = startTime + segment * records[i].segmentDuration;
+            for (int k = 0; k < N; ++k) {
+                const double x = std::cos(glm::pi<double>() * (k + 0.5) / N);
+                samples[k] = orbits.computePosition(i, segmentStart + 0.5 * (x + 1.0) * records[i].segmentDuration);
+            }
+            for (int j = 0; j < N; ++j) {
+                glm::dvec3 sum(0.0);
+                for (int k = 0; k < N; ++k)
+                    sum += samples[k] * nodeCosines[j * N + k];
+                sum *= (j == 0 ? 1.0 : 2.0) / N;
+                coefficients[j] = sum.x;
+                coefficients[N + j] = sum.y;
+                coefficients[2 * N + j] = sum.z;
+            }
+            out.write(reinterpret_cast<const char *>(coefficients.data()), coefficients.size() * sizeof(double));
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+bool Ephemeris::open(const std::string &path) {
+    close();
+    if (!file.open(path))
+        return false;
+
+    // Check everything a lookup relies on, so that a truncated or foreign file is rejected here
+    const size_t fileSize = file.getSize();
+    const Header *candidate = reinterpret_cast<const Header *>(file.getData());
+    bool valid = fileSize >= sizeof(Header)
+                 && std::memcmp(candidate->magic, kMagic, sizeof(kMagic)) == 0
+                 && candidate->version == kVersion
+                 && candidate->coefficientCount > 0
+                 && candidate->endTime > candidate->startTime
+                 && fileSize >= sizeof(Header) + uint64_t(candidate->bodyCount) * sizeof(BodyRecord);
+    const BodyRecord *records = reinterpret_cast<const BodyRecord *>(file.getData() + sizeof(Header));
+    for (uint32_t i = 0; valid && i < candidate->bodyCount; ++i) {
+        const uint64_t bytes = uint64_t(records[i].segmentCount) * 3 * candidate->coefficientCount * sizeof(double);
+        valid = records[i].segmentCount > 0 && records[i].segmentDuration > 0.0
+                && records[i].offset % sizeof(double) == 0 && records[i].offset + bytes <= fileSize;
+    }
+    if (!valid) {
+        file.close();
+        return false;
+    }
+
+    this->header = candidate;
+    this->bodies = records;
+    return true;
+}
+
+void Ephemeris::close() {
+    file.close();
+    this->header = nullptr;
+    this->bodies = nullptr;
+}
+
+bool Ephemeris::matches(const OrbitalState &orbits) const {
+    return isOpen() && header->bodyCount == orbits.size() && header->orbitsHash == hashOrbits(orbits);
+}
+
+glm::dvec3 Ephemeris::getPosition(size_t index, double time) const {
+    const BodyRecord &body = bodies[index];
+    const int N = static_cast<int>(header->coefficientCount);
+
+    const double t = std::min(std::max(time - header->startTime, 0.0), header->endTime - header->startTime);
+    const uint32_t segment = std::min(static_cast<uint32_t>(t / body.segmentDuration), body.segmentCount - 1);
+    const double x = 2.0 * (t - segment * body.segmentDuration) / body.segmentDuration - 1.0;
+    const double *c = reinterpret_cast<const double *>(file.getData() + body.offset) + size_t(segment) * 3 * N;
+
+    // Clenshaw recurrence, the three coordinates side by side
+    const double twoX = 2.0 * x;
+    double bx1 = 0.0, by1 = 0.0, bz1 = 0.0, bx2 = 0.0, by2 = 0.0, bz2 = 0.0;
+    for (int j = N - 1; j >= 1; --j) {
+        const double bx0 = twoX * bx1 - bx2 + c[j];
+        const double by0 = twoX * by1 - by2 + c[N + j];
+        const double bz0 = twoX * bz1 - bz2 + c[2 * N + j];
+        bx2 = bx1; by2 = by1; bz2 = bz1;
+        bx1 = bx0; by1 = by0; bz1 = bz0;
+    }
+    return glm::dvec3(x * bx1 - bx2 + c[0], x * by1 - by2 + c[N], x * bz1 - bz2 + c[2 * N]);
+}
@@ -0,0 +1,63 @@
+#ifndef _EPHEMERIS
+#define _EPHEMERIS
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "MappedFile.h"
+#include "OrbitalState.h"
+
+// Precomputed positions of the bodies of an OrbitalState, in the manner of the JPL DE files.
+// The time span is cut, for each body, into segments covering a fraction of its orbit, and
+// each coordinate of the position relative to the parent is stored over every segment as the
+// coefficients of a Chebyshev series. The tables live in a binary file mapped in memory: looking
+// up a position at any time costs an index computation and a short polynomial evaluation,
+// however far the time is from the previous lookup.
+class Ephemeris {
+    public:
+        // Fits the orbits over [startTime, endTime] and writes the tables to the given path.
+        // Each orbit is covered by segmentsPerOrbit segments of coefficientCount coefficients per coordinate.
+        static bool write(const OrbitalState &orbits, double startTime, double endTime,
+                          int segmentsPerOrbit, int coefficientCount, const std::string &path);
+
+        bool open(const std::string &path); // returns false if the file is missing or invalid
+        void close();
+        bool isOpen() const { return header != nullptr; }
+        // True if the tables were built from orbits identical to the given ones
+        bool matches(const OrbitalState &orbits) const;
+        bool covers(double time) const { return isOpen() && time >= header->startTime && time <= header->endTime; }
+        size_t size() const { return isOpen() ? header->bodyCount : 0; }
+        size_t getFileSize() const { return file.getSize(); }
+
+        // Position relative to the parent, the time being clamped to the span of the tables.
+        // The coefficients are stored and evaluated in double precision, like OrbitalState::computePosition.
+        glm::dvec3 getPosition(size_t index, double time) const;
+
+    private:
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint32_t bodyCount;
+            uint32_t coefficientCount;
+            double startTime, endTime;
+            uint64_t orbitsHash;
+        };
+        struct BodyRecord {
+            int32_t parent;
+            uint32_t segmentCount;
+            double segmentDuration;
+            uint64_t offset; // in bytes from the start of the file, segmentCount * 3 * coefficientCount doubles
+        };
+
+        static uint64_t hashOrbits(const OrbitalState &orbits);
+
+    private:
+        MappedFile file;
+        const Header *header = nullptr;
+        const BodyRecord *bodies = nullptr;
+};
+
+#endif
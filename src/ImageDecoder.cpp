@@ -0,0 +1,93 @@
+#include "ImageDecoder.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "stb_image.h"
+
+typedef std::chrono::steady_clock DecodeClock;
+
+static double secondsSince(DecodeClock::time_point start) {
+    return std::chrono::duration<double>(DecodeClock::now() - start).count();
+}
+
+ImageDecoder::ImageDecoder(ThreadPool *pool) : pool(pool), requests(std::make_shared<Requests>()) {}
+
+ImageDecoder::Request::~Request() {
+    if (state != State::Taken)
+        stbi_image_free(image.data);
+}
+
+void ImageDecoder::request(const std::string &path, int channels) {
+    std::shared_ptr<Request> request;
+    {
+        std::lock_guard<std::mutex> lock(requests->mutex);
+        std::shared_ptr<Request> &entry = requests->entries[std::make_pair(path, channels)];
+        if (entry)
+            return; // already requested
+        entry = request = std::make_shared<Request>();
+    }
+    std::shared_ptr<Requests> shared = requests;
+    pool->submit([shared, request, path, channels]() {
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (request->state != State::Queued)
+                return; // taken by the caller in the meantime
+            request->state = State::Decoding;
+        }
+        decode(*shared, *request, path, channels);
+    });
+}
+
+DecodedImage ImageDecoder::take(const std::string &path, int channels) {
+    const DecodeClock::time_point start = DecodeClock::now();
+    std::shared_ptr<Request> request;
+    std::unique_lock<std::mutex> lock(requests->mutex);
+    std::shared_ptr<Request> &entry = requests->entries[std::make_pair(path, channels)];
+    if (!entry || entry->state == State::Taken)
+        entry = std::make_shared<Request>();
+    request = entry;
+    if (request->state == State::Queued) {
+        // Better decoded here than waiting for a worker busy with other images
+        request->state = State::Decoding;
+        lock.unlock();
+        decode(*requests, *request, path, channels);
+        lock.lock();
+    }
+    requests->imageReady.wait(lock, [&] { return request->state == State::Ready; });
+    request->state = State::Taken;
+    waitTime += secondsSince(start);
+    return request->image;
+}
+
+void ImageDecoder::decode(Requests &requests, Request &request, const std::string &path, int channels) {
+    const DecodeClock::time_point start = DecodeClock::now();
+    DecodedImage image;
+    image.data = stbi_load(path.c_str(), &image.width, &image.height, &image.channels, channels);
+    if (channels != 0)
+        image.channels = channels; // stbi_load gives those of the file
+    const double elapsed = secondsSince(start);
+
+    std::lock_guard<std::mutex> lock(requests.mutex);
+    request.image = image;
+    request.state = State::Ready;
+    ++requests.decodedCount;
+    requests.longestDecodeTime = std::max(requests.longestDecodeTime, elapsed);
+    requests.totalDecodeTime += elapsed;
+    requests.imageReady.notify_all();
+}
+
+size_t ImageDecoder::getDecodedCount() const {
+    std::lock_guard<std::mutex> lock(requests->mutex);
+    return requests->decodedCount;
+}
+
+double ImageDecoder::getLongestDecodeTime() const {
+    std::lock_guard<std::mutex> lock(requests->mutex);
+    return requests->longestDecodeTime;
+}
+
+double ImageDecoder::getTotalDecodeTime() const {
+    std::lock_guard<std::mutex> lock(requests->mutex);
+    return requests->totalDecodeTime;
+}
@@ -0,0 +1,65 @@
+#ifndef _IMAGEDECODER
+#define _IMAGEDECODER
+
+#include <condition_variable>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "ThreadPool.h"
+
+// Image decoded by stb_image, to free with stbi_image_free
+struct DecodedImage {
+    unsigned char *data = nullptr; // null if the file cannot be decoded
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+};
+
+// Decodes the images on the workers of a pool, so that the files are decoded in parallel, and
+// while the window and the OpenGL context are created, instead of one by one before each upload.
+// An image is requested as early as possible, then taken by the thread uploading it.
+class ImageDecoder {
+    public:
+        explicit ImageDecoder(ThreadPool *pool);
+        // Starts decoding the file with the given channels (as stbi_load, 0 for those of the file)
+        void request(const std::string &path, int channels);
+        // Waits for a requested image, or decodes it on the calling thread if no worker has started it
+        // or if it was not requested. Each request is taken once, the image then belongs to the caller.
+        DecodedImage take(const std::string &path, int channels);
+
+        size_t getDecodedCount() const;
+        double getLongestDecodeTime() const; // in seconds
+        double getTotalDecodeTime() const; // same, summed over the images
+        double getWaitTime() const { return waitTime; } // spent in take, decoding or waiting
+
+    private:
+        enum class State { Queued, Decoding, Ready, Taken };
+        struct Request {
+            ~Request(); // frees the image if not taken
+            State state = State::Queued;
+            DecodedImage image;
+        };
+        // Shared with the tasks, which can still be queued when the decoder is gone
+        struct Requests {
+            std::mutex mutex;
+            std::condition_variable imageReady;
+            std::map<std::pair<std::string, int>, std::shared_ptr<Request> > entries;
+            size_t decodedCount = 0;
+            double longestDecodeTime = 0.0;
+            double totalDecodeTime = 0.0;
+        };
+
+        // Decodes a request that the caller switched from queued to decoding, then marks it ready
+        static void decode(Requests &requests, Request &request, const std::string &path, int channels);
+
+    private:
+        ThreadPool *pool;
+        std::shared_ptr<Requests> requests;
+        double waitTime = 0.0;
+};
+
+#endif
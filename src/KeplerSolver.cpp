@@ -0,0 +1,334 @@
+#include "KeplerSolver.h"
+
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// With GCC and Clang on x86, the AVX2 and AVX-512 paths are compiled whatever the instruction set of
+// the build, for their own target, and the widest one the CPU supports is picked at the first call.
+// Elsewhere, only the paths of the instruction set the program is compiled for are available.
+// The generic code below is always inlined into the entry point of each path, so that it is only
+// ever compiled for the target of that path.
+#if defined(__SSE2__) && defined(__GNUC__)
+#define RUNTIME_DISPATCH
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+#define AVX512_TARGET __attribute__((target("avx512f")))
+#define LANES_INLINE inline __attribute__((always_inline))
+#else
+#define AVX2_TARGET
+#define AVX512_TARGET
+#define LANES_INLINE inline
+#endif
+
+// Starting from Danby's guess E0 = M + 0.85*e*sign(M), this is enough to converge for every
+// eccentricity up to 0.99. A fixed count keeps all the lanes in lockstep.
+static const int kNewtonIterations = 6;
+
+// Each "lanes" structure below wraps the handful of operations needed by the solver for one
+// instruction set, so that the solver itself is written only once (see solveLanes).
+
+struct ScalarLanes {
+    typedef float reg;
+    typedef bool mask;
+    static const int width = 1;
+    static reg load(const float *p) { return *p; }
+    static void store(float *p, reg a) { *p = a; }
+    static reg set1(float a) { return a; }
+    static reg add(reg a, reg b) { return a + b; }
+    static reg sub(reg a, reg b) { return a - b; }
+    static reg mul(reg a, reg b) { return a * b; }
+    static reg madd(reg a, reg b, reg c) { return a * b + c; }
+    static reg div(reg a, reg b) { return a / b; }
+    static reg sqrt(reg a) { return std::sqrt(a); }
+    static reg round(reg a) { return std::nearbyint(a); }
+    static reg floor(reg a) { return std::floor(a); }
+    static mask greater(reg a, reg b) { return a > b; }
+    static mask less(reg a, reg b) { return a < b; }
+    static mask both(mask a, mask b) { return a && b; }
+    static reg select(mask m, reg a, reg b) { return m ? a : b; }
+};
+
+#if defined(__SSE2__)
+struct SseLanes {
+    typedef __m128 reg;
+    typedef __m128 mask;
+    static const int width = 4;
+    static reg load(const float *p) { return _mm_loadu_ps(p); }
+    static void store(float *p, reg a) { _mm_storeu_ps(p, a); }
+    static reg set1(float a) { return _mm_set1_ps(a); }
+    static reg add(reg a, reg b) { return _mm_add_ps(a, b); }
+    static reg sub(reg a, reg b) { return _mm_sub_ps(a, b); }
+    static reg mul(reg a, reg b) { return _mm_mul_ps(a, b); }
+    static reg madd(reg a, reg b, reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static reg div(reg a, reg b) { return _mm_div_ps(a, b); }
+    static reg sqrt(reg a) { return _mm_sqrt_ps(a); }
+    // SSE2 has no rounding instruction: go through integers (the values are small enough)
+    static reg round(reg a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+    static reg floor(reg a) {
+        reg r = round(a);
+        return _mm_sub_ps(r, _mm_and_ps(_mm_cmpgt_ps(r, a), _mm_set1_ps(1.0f)));
+    }
+    static mask greater(reg a, reg b) { return _mm_cmpgt_ps(a, b); }
+    static mask less(reg a, reg b) { return _mm_cmplt_ps(a, b); }
+    static mask both(mask a, mask b) { return _mm_and_ps(a, b); }
+    static reg select(mask m, reg a, reg b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+};
+#endif
+
+#if defined(__AVX2__) || defined(RUNTIME_DISPATCH)
+struct Avx2Lanes {
+    typedef __m256 reg;
+    typedef __m256 mask;
+    static const int width = 8;
+    AVX2_TARGET static reg load(const float *p) { return _mm256_loadu_ps(p); }
+    AVX2_TARGET static void store(float *p, reg a) { _mm256_storeu_ps(p, a); }
+    AVX2_TARGET static reg set1(float a) { return _mm256_set1_ps(a); }
+    AVX2_TARGET static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+    AVX2_TARGET static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+    AVX2_TARGET static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+#if defined(__FMA__) || defined(RUNTIME_DISPATCH)
+    AVX2_TARGET static reg madd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+    AVX2_TARGET static reg madd(reg a, reg b, reg c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+#endif
+    AVX2_TARGET static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+    AVX2_TARGET static reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+    AVX2_TARGET static reg round(reg a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    AVX2_TARGET static reg floor(reg a) { return _mm256_floor_ps(a); }
+    AVX2_TARGET static mask greater(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    AVX2_TARGET static mask less(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    AVX2_TARGET static mask both(mask a, mask b) { return _mm256_and_ps(a, b); }
+    AVX2_TARGET static reg select(mask m, reg a, reg b) { return _mm256_blendv_ps(b, a, m); }
+};
+#endif
+
+#if defined(__AVX512F__) || defined(RUNTIME_DISPATCH)
+struct Avx512Lanes {
+    typedef __m512 reg;
+    typedef __mmask16 mask;
+    static const int width = 16;
+    AVX512_TARGET static reg load(const float *p) { return _mm512_loadu_ps(p); }
+    AVX512_TARGET static void store(float *p, reg a) { _mm512_storeu_ps(p, a); }
+    AVX512_TARGET static reg set1(float a) { return _mm512_set1_ps(a); }
+    AVX512_TARGET static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+    AVX512_TARGET static reg sub(reg a, reg b) { return _mm512_sub_ps(a, b); }
+    AVX512_TARGET static reg mul(reg a, reg b) { return _mm512_mul_ps(a, b); }
+    AVX512_TARGET static reg madd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+    AVX512_TARGET static reg div(reg a, reg b) { return _mm512_div_ps(a, b); }
+    AVX512_TARGET static reg sqrt(reg a) { return _mm512_sqrt_ps(a); }
+    AVX512_TARGET static reg round(reg a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+    AVX512_TARGET static reg floor(reg a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+    AVX512_TARGET static mask greater(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    AVX512_TARGET static mask less(reg a, reg b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    AVX512_TARGET static mask both(mask a, mask b) { return a & b; }
+    AVX512_TARGET static reg select(mask m, reg a, reg b) { return _mm512_mask_blend_ps(m, b, a); }
+};
+#endif
+
+// GCC warns about the wide registers passed between the generic functions, which have the default
+// target, but they are only compiled inlined into the entry points of their paths
+#if defined(RUNTIME_DISPATCH) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+// Sine and cosine of x, for |x| up to a few thousands. The argument is reduced to
+// [-pi/4, pi/4] by subtracting a multiple of pi/2 (in three parts to keep the precision),
+// then minimax polynomials are evaluated and swapped/negated depending on the quadrant.
+template <typename V>
+static LANES_INLINE void sinCos(typename V::reg x, typename V::reg &s, typename V::reg &c) {
+    typedef typename V::reg reg;
+    const reg q = V::round(V::mul(x, V::set1(0.636619772367581f))); // x * 2/pi
+    reg r = V::madd(q, V::set1(-1.5703125f), x);
+    r = V::madd(q, V::set1(-4.837512969970703125e-4f), r);
+    r = V::madd(q, V::set1(-7.54978995489188216e-8f), r);
+
+    const reg r2 = V::mul(r, r);
+    reg ps = V::madd(r2, V::set1(-1.9515295891e-4f), V::set1(8.3321608736e-3f));
+    ps = V::madd(ps, r2, V::set1(-1.6666654611e-1f));
+    ps = V::madd(V::mul(ps, r2), r, r);
+    reg pc = V::madd(r2, V::set1(2.443315711809948e-5f), V::set1(-1.388731625493765e-3f));
+    pc = V::madd(pc, r2, V::set1(4.166664568298827e-2f));
+    pc = V::madd(V::mul(pc, r2), r2, V::madd(r2, V::set1(-0.5f), V::set1(1.0f)));
+
+    // Quadrant q mod 4, kept in floating point to avoid integer operations
+    const reg quadrant = V::sub(q, V::mul(V::set1(4.0f), V::floor(V::mul(q, V::set1(0.25f)))));
+    const reg half = V::mul(quadrant, V::set1(0.5f));
+    const typename V::mask odd = V::greater(V::sub(half, V::floor(half)), V::set1(0.25f));
+    const typename V::mask negateSin = V::greater(quadrant, V::set1(1.5f));
+    const typename V::mask negateCos = V::both(V::greater(quadrant, V::set1(0.5f)), V::less(quadrant, V::set1(2.5f)));
+
+    const reg zero = V::set1(0.0f);
+    s = V::select(odd, pc, ps);
+    c = V::select(odd, ps, pc);
+    s = V::select(negateSin, V::sub(zero, s), s);
+    c = V::select(negateCos, V::sub(zero, c), c);
+}
+
+// Solves V::width bodies starting at index i.
+template <typename V>
+static LANES_INLINE void solveLanes(const float *meanAnomalies, const float *eccentricities,
+                                    float *cosTrueAnomalies, float *sinTrueAnomalies, float *radiusRatios, size_t i) {
+    typedef typename V::reg reg;
+    const reg one = V::set1(1.0f);
+    const reg e = V::load(eccentricities + i);
+
+    // Reduce the mean anomaly to [-pi, pi], with 2*pi split in two parts to keep the precision
+    reg m = V::load(meanAnomalies + i);
+    const reg turns = V::round(V::mul(m, V::set1(0.159154943091895f)));
+    m = V::madd(turns, V::set1(-6.28125f), m);
+    m = V::madd(turns, V::set1(-1.9353071795864769e-3f), m);
+
+    // Danby's starting guess, then Newton iterations on f(E) = E - e*sin(E) - M
+    const reg offset = V::mul(V::set1(0.85f), e);
+    reg E = V::add(m, V::select(V::less(m, V::set1(0.0f)), V::sub(V::set1(0.0f), offset), offset));
+    reg s, c;
+    for (int iteration = 0; iteration < kNewtonIterations; ++iteration) {
+        sinCos<V>(E, s, c);
+        const reg f = V::sub(V::sub(E, V::mul(e, s)), m);
+        const reg df = V::sub(one, V::mul(e, c));
+        E = V::sub(E, V::div(f, df));
+    }
+    sinCos<V>(E, s, c);
+
+    // cos(nu) = (cos(E) - e) / (1 - e*cos(E)), sin(nu) = sqrt(1 - e^2)*sin(E) / (1 - e*cos(E))
+    const reg ratio = V::sub(one, V::mul(e, c));
+    const reg invRatio = V::div(one, ratio);
+    const reg minorAxis = V::sqrt(V::sub(one, V::mul(e, e)));
+    V::store(cosTrueAnomalies + i, V::mul(V::sub(c, e), invRatio));
+    V::store(sinTrueAnomalies + i, V::mul(V::mul(minorAxis, s), invRatio));
+    V::store(radiusRatios + i, ratio);
+}
+
+template <typename V>
+static LANES_INLINE void solveAll(const float *meanAnomalies, const float *eccentricities,
+                                  float *cosTrueAnomalies, float *sinTrueAnomalies, float *radiusRatios, size_t count) {
+    size_t i = 0;
+    for (; i + V::width <= count; i += V::width)
+        solveLanes<V>(meanAnomalies, eccentricities, cosTrueAnomalies, sinTrueAnomalies, radiusRatios, i);
+    for (; i < count; ++i)
+        solveLanes<ScalarLanes>(meanAnomalies, eccentricities, cosTrueAnomalies, sinTrueAnomalies, radiusRatios, i);
+}
+
+template <typename V>
+static LANES_INLINE void sinCosLanes(const float *angles, float *sines, float *cosines, size_t i) {
+    typename V::reg s, c;
+    sinCos<V>(V::load(angles + i), s, c);
+    V::store(sines + i, s);
+    V::store(cosines + i, c);
+}
+
+template <typename V>
+static LANES_INLINE void sinCosAll(const float *angles, float *sines, float *cosines, size_t count) {
+    size_t i = 0;
+    for (; i + V::width <= count; i += V::width)
+        sinCosLanes<V>(angles, sines, cosines, i);
+    for (; i < count; ++i)
+        sinCosLanes<ScalarLanes>(angles, sines, cosines, i);
+}
+
+#if defined(RUNTIME_DISPATCH) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+// Entry points of the code paths
+static void solveScalarPath(const float *meanAnomalies, const float *eccentricities,
+                            float *cosTrueAnomalies, float *sinTrueAnomalies, float *radiusRatios, size_t count) {
+    solveAll<ScalarLanes>(meanAnomalies, eccentricities, cosTrueAnomalies, sinTrueAnomalies, radiusRatios, count);
+}
+
+#if !defined(__SSE2__)
+static void sinCosScalarPath(const float *angles, float *sines, float *cosines, size_t count) {
+    sinCosAll<ScalarLanes>(angles, sines, cosines, count);
+}
+#endif
+
+#if defined(__SSE2__)
+static void solveSse(const float *meanAnomalies, const float *eccentricities,
+                     float *cosTrueAnomalies, float *sinTrueAnomalies, float *radiusRatios, size_t count) {
+    solveAll<SseLanes>(meanAnomalies, eccentricities, cosTrueAnomalies, sinTrueAnomalies, radiusRatios, count);
+}
+
+static void sinCosSse(const float *angles, float *sines, float *cosines, size_t count) {
+    sinCosAll<SseLanes>(angles, sines, cosines, count);
+}
+#endif
+
+#if defined(__AVX2__) || defined(RUNTIME_DISPATCH)
+AVX2_TARGET static void solveAvx2(const float *meanAnomalies, const float *eccentricities,
+                                  float *cosTrueAnomalies, float *sinTrueAnomalies, float *radiusRatios, size_t count) {
+    solveAll<Avx2Lanes>(meanAnomalies, eccentricities, cosTrueAnomalies, sinTrueAnomalies, radiusRatios, count);
+}
+
+AVX2_TARGET static void sinCosAvx2(const float *angles, float *sines, float *cosines, size_t count) {
+    sinCosAll<Avx2Lanes>(angles, sines, cosines, count);
+}
+#endif
+
+#if defined(__AVX512F__) || defined(RUNTIME_DISPATCH)
+AVX512_TARGET static void solveAvx512(const float *meanAnomalies, const float *eccentricities,
+                                      float *cosTrueAnomalies, float *sinTrueAnomalies, float *radiusRatios, size_t count) {
+    solveAll<Avx512Lanes>(meanAnomalies, eccentricities, cosTrueAnomalies, sinTrueAnomalies, radiusRatios, count);
+}
+
+AVX512_TARGET static void sinCosAvx512(const float *angles, float *sines, float *cosines, size_t count) {
+    sinCosAll<Avx512Lanes>(angles, sines, cosines, count);
+}
+#endif
+
+// The code path of solveKepler and computeSinCos
+struct KeplerPath {
+    const char *name;
+    int width;
+    void (*solve)(const float *, const float *, float *, float *, float *, size_t);
+    void (*sinCos)(const float *, float *, float *, size_t);
+};
+
+static KeplerPath selectPath() {
+#if defined(RUNTIME_DISPATCH)
+    // The checks include the support of the wide registers by the operating system
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return { "AVX-512", Avx512Lanes::width, solveAvx512, sinCosAvx512 };
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return { "AVX2", Avx2Lanes::width, solveAvx2, sinCosAvx2 };
+    return { "SSE2", SseLanes::width, solveSse, sinCosSse };
+#elif defined(__AVX512F__)
+    return { "AVX-512", Avx512Lanes::width, solveAvx512, sinCosAvx512 };
+#elif defined(__AVX2__)
+    return { "AVX2", Avx2Lanes::width, solveAvx2, sinCosAvx2 };
+#elif defined(__SSE2__)
+    return { "SSE2", SseLanes::width, solveSse, sinCosSse };
+#else
+    return { "scalar", ScalarLanes::width, solveScalarPath, sinCosScalarPath };
+#endif
+}
+
+static const KeplerPath &getPath() {
+    static const KeplerPath path = selectPath(); // selected once, on first use
+    return path;
+}
+
+void solveKepler(const float *meanAnomalies, const float *eccentricities,
+                 float *cosTrueAnomalies, float *sinTrueAnomalies, float *radiusRatios, size_t count) {
+    getPath().solve(meanAnomalies, eccentricities, cosTrueAnomalies, sinTrueAnomalies, radiusRatios, count);
+}
+
+void solveKeplerScalar(const float *meanAnomalies, const float *eccentricities,
+                       float *cosTrueAnomalies, float *sinTrueAnomalies, float *radiusRatios, size_t count) {
+    solveScalarPath(meanAnomalies, eccentricities, cosTrueAnomalies, sinTrueAnomalies, radiusRatios, count);
+}
+
+void computeSinCos(const float *angles, float *sines, float *cosines, size_t count) {
+    getPath().sinCos(angles, sines, cosines, count);
+}
+
+const char *keplerSolverPath() {
+    return getPath().name;
+}
+
+int keplerSolverWidth() {
+    return getPath().width;
+}
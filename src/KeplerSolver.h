@@ -0,0 +1,30 @@
+#ifndef _KEPLERSOLVER
+#define _KEPLERSOLVER
+
+#include <cstddef>
+
+// Batched solver of Kepler's equation M = E - e*sin(E) for elliptical orbits (0 <= e < 1).
+// For each body, the mean anomaly M is turned into the eccentric anomaly E with a fixed
+// number of Newton iterations, then into the true anomaly nu. The true anomaly is returned
+// as its cosine and sine, along with the distance to the focus in units of the semi-major
+// axis (r/a = 1 - e*cos(E)), which is all that is needed to place a body on its orbit.
+//
+// solveKepler processes 16, 8 or 4 bodies per instruction depending on the instruction set of
+// the CPU (AVX-512, AVX2 or SSE2), the remaining ones with the scalar code. With GCC and Clang the
+// path is chosen at run time; with other compilers, from the instruction set the program is compiled for.
+void solveKepler(const float *meanAnomalies, const float *eccentricities,
+                 float *cosTrueAnomalies, float *sinTrueAnomalies, float *radiusRatios, size_t count);
+
+// Same computation, one body at a time. Always available, mostly for comparison purposes.
+void solveKeplerScalar(const float *meanAnomalies, const float *eccentricities,
+                       float *cosTrueAnomalies, float *sinTrueAnomalies, float *radiusRatios, size_t count);
+
+// Sines and cosines of angles of magnitude up to a few thousands, with the same SIMD code path as
+// solveKepler (absolute error below 1e-6 after range reduction). Used by other batched orbit updates.
+void computeSinCos(const float *angles, float *sines, float *cosines, size_t count);
+
+// Name and number of lanes of the code path used by solveKepler.
+const char *keplerSolverPath();
+int keplerSolverWidth();
+
+#endif
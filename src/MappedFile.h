@@ -0,0 +1,31 @@
+#ifndef _MAPPEDFILE
+#define _MAPPEDFILE
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The pages are loaded by the OS on first access
+// and shared with its file cache, so opening even a large file costs almost nothing.
+class MappedFile {
+    public:
+        MappedFile() {}
+        ~MappedFile() { close(); }
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        bool open(const std::string &path); // returns false if the file cannot be mapped
+        void close();
+        bool isOpen() const { return data != nullptr; }
+        const unsigned char *getData() const { return data; }
+        size_t getSize() const { return size; }
+
+    private:
+        const unsigned char *data = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        void *fileHandle = nullptr;
+        void *mappingHandle = nullptr;
+#endif
+};
+
+#endif
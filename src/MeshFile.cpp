@@ -0,0 +1,112 @@
+#include "MeshFile.h"
+
+#include <cstring>
+#include <fstream>
+
+static const char kMagic[4] = { 'M', 'E', 'S', 'H' };
+static const uint32_t kVersion = 1; // to increase whenever the generated meshes change
+static const uint64_t kAlignment = 16;
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+bool MeshFile::write(const VertexLayout &layout, const std::vector<std::pair<std::string, MeshBlobs> > &meshes,
+                     const std::string &path) {
+    Header header = Header(); // zero-initialized, padding included
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.meshCount = static_cast<uint32_t>(meshes.size());
+    header.layout = layout;
+
+    std::vector<MeshRecord> records(meshes.size());
+    uint64_t offset = sizeof(Header) + meshes.size() * sizeof(MeshRecord);
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        const std::string &name = meshes[m].first;
+        const MeshBlobs &blobs = meshes[m].second;
+        if (name.size() > kMaxNameLength)
+            return false;
+        MeshRecord &record = records[m];
+        std::memset(&record, 0, sizeof(record));
+        std::memcpy(record.name, name.c_str(), name.size());
+        record.vertexCount = static_cast<uint32_t>(blobs.vertexCount);
+        record.indexCount = static_cast<uint32_t>(blobs.indexCount);
+        record.indexSize = static_cast<uint32_t>(blobs.indexSize);
+        record.maxError = blobs.maxError;
+        record.vertexOffset = alignOffset(offset);
+        record.indexOffset = alignOffset(record.vertexOffset + uint64_t(blobs.vertexCount) * layout.stride);
+        offset = record.indexOffset + uint64_t(blobs.indexCount) * blobs.indexSize;
+    }
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(MeshRecord));
+    uint64_t written = sizeof(Header) + records.size() * sizeof(MeshRecord);
+    const char zeros[kAlignment] = {};
+    for (size_t m = 0; m < meshes.size(); ++m) {
+        const MeshBlobs &blobs = meshes[m].second;
+        out.write(zeros, records[m].vertexOffset - written);
+        out.write(static_cast<const char *>(blobs.vertices), uint64_t(blobs.vertexCount) * layout.stride);
+        written = records[m].vertexOffset + uint64_t(blobs.vertexCount) * layout.stride;
+        out.write(zeros, records[m].indexOffset - written);
+        out.write(static_cast<const char *>(blobs.indices), uint64_t(blobs.indexCount) * blobs.indexSize);
+        written = records[m].indexOffset + uint64_t(blobs.indexCount) * blobs.indexSize;
+    }
+    return static_cast<bool>(out);
+}
+
+bool MeshFile::open(const std::string &path, const VertexLayout &layout) {
+    close();
+    if (!file.open(path))
+        return false;
+
+    // Check everything a lookup relies on, so that a truncated or foreign file is rejected here
+    const size_t fileSize = file.getSize();
+    const Header *candidate = reinterpret_cast<const Header *>(file.getData());
+    bool valid = fileSize >= sizeof(Header)
+                 && std::memcmp(candidate->magic, kMagic, sizeof(kMagic)) == 0
+                 && candidate->version == kVersion
+                 && std::memcmp(&candidate->layout, &layout, sizeof(VertexLayout)) == 0
+                 && fileSize >= sizeof(Header) + uint64_t(candidate->meshCount) * sizeof(MeshRecord);
+    const MeshRecord *records = reinterpret_cast<const MeshRecord *>(file.getData() + sizeof(Header));
+    for (uint32_t m = 0; valid && m < candidate->meshCount; ++m) {
+        const MeshRecord &record = records[m];
+        valid = record.name[kMaxNameLength] == '\0'
+                && (record.indexSize == 2 || record.indexSize == 4)
+                && record.vertexOffset % kAlignment == 0 && record.indexOffset % kAlignment == 0
+                && record.vertexOffset + uint64_t(record.vertexCount) * layout.stride <= fileSize
+                && record.indexOffset + uint64_t(record.indexCount) * record.indexSize <= fileSize;
+    }
+    if (!valid) {
+        file.close();
+        return false;
+    }
+
+    this->header = candidate;
+    this->meshes = records;
+    return true;
+}
+
+void MeshFile::close() {
+    file.close();
+    this->header = nullptr;
+    this->meshes = nullptr;
+}
+
+bool MeshFile::find(const std::string &name, MeshBlobs &blobs) const {
+    for (size_t m = 0; m < getMeshCount(); ++m) {
+        const MeshRecord &record = meshes[m];
+        if (name != record.name)
+            continue;
+        blobs.vertices = file.getData() + record.vertexOffset;
+        blobs.vertexCount = record.vertexCount;
+        blobs.indices = file.getData() + record.indexOffset;
+        blobs.indexCount = record.indexCount;
+        blobs.indexSize = record.indexSize;
+        blobs.maxError = record.maxError;
+        return true;
+    }
+    return false;
+}
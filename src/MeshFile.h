@@ -0,0 +1,82 @@
+#ifndef _MESHFILE
+#define _MESHFILE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Layout of the interleaved vertices of a mesh, as given to glVertexAttribPointer
+struct VertexAttributeLayout {
+    uint32_t location;
+    uint32_t componentCount;
+    uint32_t type; // GL_SHORT, GL_FLOAT...
+    uint32_t normalized;
+    uint32_t offset; // in bytes from the start of the vertex
+};
+
+struct VertexLayout {
+    const static size_t kMaxAttributes = 4;
+    uint32_t stride = 0;
+    uint32_t attributeCount = 0;
+    VertexAttributeLayout attributes[kMaxAttributes] = {};
+};
+
+// Vertex and index buffers of a mesh, ready for glBufferData
+struct MeshBlobs {
+    const void *vertices = nullptr;
+    size_t vertexCount = 0;
+    const void *indices = nullptr;
+    size_t indexCount = 0;
+    size_t indexSize = 0; // 2 or 4 bytes
+    double maxError = 0.0; // see SphereMesh::computeMaxError
+};
+
+// Binary file of meshes stored exactly as they are uploaded, found by name. The header holds a
+// version and the vertex layout, and the file is mapped in memory like the ephemeris tables: the
+// blobs of a mesh point into the mapping and go to the GPU without any processing. A file of
+// another version or layout is rejected, so the meshes are generated again.
+class MeshFile {
+    public:
+        static bool write(const VertexLayout &layout, const std::vector<std::pair<std::string, MeshBlobs> > &meshes,
+                          const std::string &path);
+
+        // Returns false if the file is missing, invalid, or of another version or vertex layout
+        bool open(const std::string &path, const VertexLayout &layout);
+        void close();
+        bool isOpen() const { return header != nullptr; }
+        bool find(const std::string &name, MeshBlobs &blobs) const; // valid until close
+        size_t getMeshCount() const { return isOpen() ? header->meshCount : 0; }
+        size_t getFileSize() const { return file.getSize(); }
+
+        const static size_t kMaxNameLength = 31;
+
+    private:
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint32_t meshCount;
+            uint32_t padding;
+            VertexLayout layout;
+        };
+        struct MeshRecord {
+            char name[kMaxNameLength + 1];
+            uint32_t vertexCount;
+            uint32_t indexCount;
+            uint32_t indexSize;
+            uint32_t padding;
+            double maxError;
+            uint64_t vertexOffset; // in bytes from the start of the file, aligned to 16 bytes
+            uint64_t indexOffset; // same
+        };
+
+    private:
+        MappedFile file;
+        const Header *header = nullptr;
+        const MeshRecord *meshes = nullptr;
+};
+
+#endif
@@ -0,0 +1,313 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+// Parameters of the vertex scores of Forsyth's algorithm, which simulates a larger LRU cache than
+// the FIFO of the statistics: the order is good for any cache size up to it
+static const size_t kLruCacheSize = 32;
+static const float kCacheDecayPower = 1.5f;
+static const float kLastTriangleScore = 0.75f; // the vertices of the last triangle are slightly penalized, against strips of thin triangles
+static const float kValenceBoostScale = 2.0f;
+static const float kValenceBoostPower = 0.5f; // vertices with few triangles left are used up first, against isolated leftovers
+
+static const unsigned int kUnusedVertex = ~0u;
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount, size_t cacheSize) {
+    // A vertex is in the FIFO if it was inserted less than cacheSize insertions ago
+    std::vector<size_t> insertions(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    size_t insertionCount = cacheSize + 1, misses = 0, usedCount = 0;
+    for (unsigned int v : indices) {
+        if (insertionCount - insertions[v] > cacheSize) {
+            insertions[v] = insertionCount++;
+            ++misses;
+        }
+        if (!used[v]) {
+            used[v] = true;
+            ++usedCount;
+        }
+    }
+    VertexCacheStats stats;
+    if (indices.size() > 0) {
+        stats.acmr = static_cast<double>(misses) / (indices.size() / 3);
+        stats.atvr = static_cast<double>(misses) / usedCount;
+    }
+    return stats;
+}
+
+OverdrawStats analyzeOverdraw(const std::vector<unsigned int> &indices, const std::vector<float> &positions, int viewSize) {
+    OverdrawStats stats;
+    const size_t vertexCount = positions.size() / 3;
+    if (indices.empty() || vertexCount == 0 || viewSize <= 0)
+        return stats;
+
+    // The bounding box, scaled uniformly to fit the grid
+    glm::vec3 lower(positions[0], positions[1], positions[2]), upper = lower;
+    for (size_t v = 1; v < vertexCount; ++v) {
+        const glm::vec3 p(positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]);
+        lower = glm::min(lower, p);
+        upper = glm::max(upper, p);
+    }
+    const glm::vec3 extent = upper - lower;
+    const float largest = std::max(extent.x, std::max(extent.y, extent.z));
+    const float scale = largest > 0.0f ? viewSize / largest : 0.0f;
+
+    std::vector<float> depths(size_t(viewSize) * viewSize);
+    for (int axis = 0; axis < 3; ++axis) {
+        // Screen coordinates along the two other axes, in the order that makes the signed area of a
+        // triangle its normal along the axis
+        const int xAxis = (axis + 1) % 3, yAxis = (axis + 2) % 3;
+        for (float side = -1.0f; side <= 1.0f; side += 2.0f) {
+            // Looking from the side of the axis: the closest points have the largest side * coordinate
+            std::fill(depths.begin(), depths.end(), HUGE_VALF);
+            for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+                float x[3], y[3], z[3];
+                for (int k = 0; k < 3; ++k) {
+                    const float *p = &positions[3 * indices[t + k]];
+                    x[k] = (p[xAxis] - lower[xAxis]) * scale;
+                    y[k] = (p[yAxis] - lower[yAxis]) * scale;
+                    z[k] = -side * p[axis];
+                }
+                const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+                if (side * area <= 0.0f)
+                    continue; // back-facing or seen edge-on
+
+                // Pixel centers inside the triangle, with barycentric coordinates from the edge functions
+                const int minX = std::max(0, static_cast<int>(std::floor(std::min(x[0], std::min(x[1], x[2])))));
+                const int maxX = std::min(viewSize - 1, static_cast<int>(std::ceil(std::max(x[0], std::max(x[1], x[2])))));
+                const int minY = std::max(0, static_cast<int>(std::floor(std::min(y[0], std::min(y[1], y[2])))));
+                const int maxY = std::min(viewSize - 1, static_cast<int>(std::ceil(std::max(y[0], std::max(y[1], y[2])))));
+                for (int py = minY; py <= maxY; ++py) {
+                    for (int px = minX; px <= maxX; ++px) {
+                        const float cx = px + 0.5f, cy = py + 0.5f;
+                        const float w0 = ((x[1] - cx) * (y[2] - cy) - (x[2] - cx) * (y[1] - cy)) / area;
+                        const float w1 = ((x[2] - cx) * (y[0] - cy) - (x[0] - cx) * (y[2] - cy)) / area;
+                        const float w2 = 1.0f - w0 - w1;
+                        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                            continue;
+                        const float depth = w0 * z[0] + w1 * z[1] + w2 * z[2];
+                        float &stored = depths[size_t(py) * viewSize + px];
+                        if (depth < stored) {
+                            if (stored == HUGE_VALF)
+                                ++stats.covered;
+                            stored = depth;
+                            ++stats.shaded;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if (stats.covered > 0)
+        stats.overdraw = static_cast<double>(stats.shaded) / stats.covered;
+    return stats;
+}
+
+static float vertexScore(int cachePosition, unsigned int remainingTriangles) {
+    if (remainingTriangles == 0)
+        return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3)
+            score = kLastTriangleScore;
+        else
+            score = std::pow(1.0f - (cachePosition - 3) / static_cast<float>(kLruCacheSize - 3), kCacheDecayPower);
+    }
+    return score + kValenceBoostScale * std::pow(static_cast<float>(remainingTriangles), -kValenceBoostPower);
+}
+
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount) {
+    const size_t triangleCount = indices.size() / 3;
+
+    // Triangles of each vertex, of which the first remaining[v] are not emitted yet
+    std::vector<unsigned int> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+    for (unsigned int v : indices)
+        ++remaining[v];
+    for (size_t v = 0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<unsigned int> adjacency(indices.size()), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (int k = 0; k < 3; ++k)
+            adjacency[fill[indices[3 * t + k]]++] = static_cast<unsigned int>(t);
+    }
+
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v)
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<unsigned int> result, cache, newCache;
+    result.reserve(indices.size());
+    cache.reserve(kLruCacheSize + 3);
+    newCache.reserve(kLruCacheSize + 3);
+    size_t nextInput = 0; // no triangle before it is left
+    long best = -1;
+    for (size_t count = 0; count < triangleCount; ++count) {
+        if (best < 0) {
+            // No triangle left around the cache: continue with the next one in the input order
+            while (emitted[nextInput])
+                ++nextInput;
+            best = static_cast<long>(nextInput);
+        }
+        const unsigned int *triangle = &indices[3 * best];
+        emitted[best] = true;
+        result.insert(result.end(), triangle, triangle + 3);
+
+        newCache.assign(triangle, triangle + 3);
+        for (int k = 0; k < 3; ++k) {
+            const unsigned int v = triangle[k];
+            unsigned int *first = &adjacency[offsets[v]], *last = first + remaining[v];
+            std::iter_swap(std::find(first, last, static_cast<unsigned int>(best)), last - 1);
+            --remaining[v];
+        }
+        for (unsigned int v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                newCache.push_back(v);
+        }
+
+        // Scores of the vertices that entered, moved in or left the cache, then of their triangles
+        for (size_t i = 0; i < newCache.size(); ++i) {
+            const unsigned int v = newCache[i];
+            cachePositions[v] = i < kLruCacheSize ? static_cast<int>(i) : -1;
+            vertexScores[v] = vertexScore(cachePositions[v], remaining[v]);
+        }
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : newCache) {
+            for (unsigned int a = offsets[v]; a < offsets[v] + remaining[v]; ++a) {
+                const unsigned int t = adjacency[a];
+                const float score = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+        if (newCache.size() > kLruCacheSize)
+            newCache.resize(kLruCacheSize);
+        cache.swap(newCache);
+    }
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<float> &positions, float threshold) {
+    const size_t triangleCount = indices.size() / 3;
+    const size_t vertexCount = positions.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Cache misses of each triangle in the current order, with the same FIFO as analyzeVertexCache.
+    // Restarting the cache only takes moving the insertion count forward.
+    std::vector<size_t> insertions(vertexCount, 0);
+    size_t insertionCount = kVertexCacheSize + 1;
+    auto countMisses = [&](size_t t) {
+        unsigned int misses = 0;
+        for (int k = 0; k < 3; ++k) {
+            const unsigned int v = indices[3 * t + k];
+            if (insertionCount - insertions[v] > kVertexCacheSize) {
+                insertions[v] = insertionCount++;
+                ++misses;
+            }
+        }
+        return misses;
+    };
+
+    // Hard boundaries, where the three vertices miss the cache: the order does not matter there
+    std::vector<size_t> hardClusters;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        if (countMisses(t) == 3)
+            hardClusters.push_back(t);
+    }
+    hardClusters.push_back(triangleCount);
+
+    // Soft boundaries: each cluster ends as soon as its miss ratio, from a cold cache, is within the
+    // threshold of the one of the whole hard cluster, so that drawing the clusters in any order
+    // misses at most that much more
+    std::vector<size_t> clusters;
+    for (size_t c = 0; c + 1 < hardClusters.size(); ++c) {
+        const size_t first = hardClusters[c], last = hardClusters[c + 1];
+        insertionCount += kVertexCacheSize + 1;
+        size_t clusterMisses = 0;
+        for (size_t t = first; t < last; ++t)
+            clusterMisses += countMisses(t);
+        const double clusterThreshold = threshold * static_cast<double>(clusterMisses) / (last - first);
+
+        size_t start = first;
+        while (start < last) {
+            clusters.push_back(start);
+            insertionCount += kVertexCacheSize + 1;
+            size_t runMisses = 0, t = start;
+            while (t < last) {
+                runMisses += countMisses(t++);
+                if (static_cast<double>(runMisses) / (t - start) <= clusterThreshold)
+                    break;
+            }
+            start = t;
+        }
+    }
+    clusters.push_back(triangleCount);
+
+    // Centroid of the mesh, then centroid and mean normal of each cluster, weighted by the areas
+    auto position = [&](unsigned int v) { return glm::vec3(positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]); };
+    std::vector<glm::vec3> centroids(triangleCount), normals(triangleCount); // normals scaled by twice the area
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t t = 0; t < triangleCount; ++t) {
+        const glm::vec3 p0 = position(indices[3 * t]), p1 = position(indices[3 * t + 1]), p2 = position(indices[3 * t + 2]);
+        centroids[t] = (p0 + p1 + p2) / 3.0f;
+        normals[t] = glm::cross(p1 - p0, p2 - p0);
+        const float area = glm::length(normals[t]);
+        meshCentroid += centroids[t] * area;
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    std::vector<float> facings(clusters.size() - 1);
+    std::vector<size_t> order(clusters.size() - 1);
+    for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; ++t) {
+            const float triangleArea = glm::length(normals[t]);
+            centroid += centroids[t] * triangleArea;
+            normal += normals[t];
+            area += triangleArea;
+        }
+        const float normalLength = glm::length(normal);
+        facings[c] = area > 0.0f && normalLength > 0.0f ? glm::dot(centroid / area - meshCentroid, normal / normalLength) : 0.0f;
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return facings[a] > facings[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (size_t c : order)
+        result.insert(result.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1]);
+    indices.swap(result);
+}
+
+void optimizeVertexFetch(std::vector<unsigned int> &indices, size_t vertexCount, std::vector<unsigned int> &remap) {
+    remap.assign(vertexCount, kUnusedVertex);
+    unsigned int next = 0;
+    for (unsigned int &v : indices) {
+        if (remap[v] == kUnusedVertex)
+            remap[v] = next++;
+        v = remap[v];
+    }
+    for (unsigned int &r : remap) {
+        if (r == kUnusedVertex)
+            r = next++;
+    }
+}
+
+void remapVertices(std::vector<float> &attributes, size_t components, const std::vector<unsigned int> &remap) {
+    std::vector<float> result(attributes.size());
+    for (size_t v = 0; v < remap.size(); ++v)
+        std::copy(&attributes[components * v], &attributes[components * v] + components, &result[components * remap[v]]);
+    attributes.swap(result);
+}
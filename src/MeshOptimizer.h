@@ -0,0 +1,55 @@
+#ifndef _MESHOPTIMIZER
+#define _MESHOPTIMIZER
+
+#include <cstddef>
+#include <vector>
+
+// Reordering of indexed triangle meshes for the GPU, without changing the triangles themselves.
+// A mesh is first reordered for the post-transform vertex cache, so that the vertices shaded for
+// a triangle are reused by the next ones, then, if it is concave, its triangles can be grouped in
+// clusters sorted from the most outward-facing, which lowers the overdraw at the cost of some cache
+// hits, and finally its vertices are renumbered in the order the triangles use them, for the
+// vertex fetch.
+
+// Efficiency of the post-transform vertex cache, simulated as a FIFO of cacheSize vertices
+struct VertexCacheStats {
+    double acmr = 0.0; // average cache miss ratio: vertices shaded per triangle, 0.5 at best on a regular grid, 3 at worst
+    double atvr = 0.0; // average transformed vertex ratio: vertices shaded per vertex of the mesh, 1 at best
+};
+
+const size_t kVertexCacheSize = 16; // the size assumed for the optimization and the statistics
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, size_t vertexCount, size_t cacheSize = kVertexCacheSize);
+
+// Overdraw of the mesh rasterized in its triangle order, with back-face culling and a depth test,
+// in orthographic views along the 6 directions of the axes on a grid of viewSize^2 pixels
+struct OverdrawStats {
+    size_t covered = 0; // pixels covered by the mesh, over all the views
+    size_t shaded = 0; // pixels that passed the depth test when they were drawn
+    double overdraw = 0.0; // shaded / covered, 1 at best (a convex mesh always draws each pixel once)
+};
+
+const int kOverdrawViewSize = 256;
+
+OverdrawStats analyzeOverdraw(const std::vector<unsigned int> &indices, const std::vector<float> &positions, int viewSize = kOverdrawViewSize);
+
+// Reorders the triangles for the vertex cache, with the linear-speed algorithm of Tom Forsyth:
+// the next triangle is the one whose vertices score best, from their position in a simulated LRU
+// cache and the number of their triangles still to be drawn.
+void optimizeVertexCache(std::vector<unsigned int> &indices, size_t vertexCount);
+
+// Splits the triangles, in their current order, into clusters where the simulated cache restarts
+// or, within those, where the cache miss ratio of a cluster from a cold cache is within the
+// threshold of the one of its hard cluster (1.05 for 5%). The clusters are then sorted by how
+// much they face away from the centroid of the mesh, so that the front of the mesh tends to be
+// drawn first. Reordering the clusters loses the hits between them, so the miss ratio of the whole
+// mesh can grow by more than the threshold: check the result with analyzeOverdraw.
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<float> &positions, float threshold);
+
+// Renumbers the vertices in the order of their first use (the unused ones last), rewrites the
+// indices and fills remap with the new index of each old vertex, to reorder the attribute arrays
+// with remapVertices.
+void optimizeVertexFetch(std::vector<unsigned int> &indices, size_t vertexCount, std::vector<unsigned int> &remap);
+void remapVertices(std::vector<float> &attributes, size_t components, const std::vector<unsigned int> &remap);
+
+#endif
@@ -0,0 +1,262 @@
+#include "MipChain.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// With GCC and Clang on x86, the AVX path is compiled whatever the instruction set of the build, for
+// its own target, and used if the CPU supports it. The generic code is always inlined into the entry
+// point of each path (see reduceRowAvx), so that it is only compiled for the target of that path.
+#if defined(__SSE2__) && defined(__GNUC__)
+#define RUNTIME_DISPATCH
+#define AVX_TARGET __attribute__((target("avx")))
+#define LANES_INLINE inline __attribute__((always_inline))
+#else
+#define AVX_TARGET
+#define LANES_INLINE inline
+#endif
+
+// The linear values are quantized to 16 bits to be turned back into sRGB by a table, within 0.06
+// of an 8-bit level of the exact conversion
+static const size_t kSrgbTableSize = 65536;
+
+// Conversions of the color channels between the 8-bit sRGB values and the linear floats
+struct ColorTables {
+    float toLinear[256];
+    unsigned char toSrgb[kSrgbTableSize];
+
+    ColorTables() {
+        for (int i = 0; i < 256; ++i) {
+            const double c = i / 255.0;
+            toLinear[i] = static_cast<float>(c <= 0.04045 ? c / 12.92 : std::pow((c + 0.055) / 1.055, 2.4));
+        }
+        for (size_t i = 0; i < kSrgbTableSize; ++i) {
+            const double l = static_cast<double>(i) / (kSrgbTableSize - 1);
+            const double c = l <= 0.0031308 ? 12.92 * l : 1.055 * std::pow(l, 1.0 / 2.4) - 0.055;
+            toSrgb[i] = static_cast<unsigned char>(std::min(255.0, std::floor(255.0 * c + 0.5)));
+        }
+    }
+};
+
+static const ColorTables &getColorTables() {
+    static const ColorTables tables; // built once, on first use
+    return tables;
+}
+
+// Each "lanes" structure below handles width texels of 4 linear floats at a time for one instruction
+// set: average turns the 2x2 texels of two source rows into the texels of the next level, adding
+// them in the same order for every code path, and quantize rounds the clamped values, multiplied
+// by the given scales, to integers. So every code path gives exactly the same levels.
+
+struct ScalarMipLanes {
+    static const int width = 1;
+    static void average(const float *row0, const float *row1, float *out) {
+        for (int c = 0; c < 4; ++c)
+            out[c] = ((row0[c] + row1[c]) + (row0[4 + c] + row1[4 + c])) * 0.25f;
+    }
+    static void quantize(const float *values, const float *scales, int32_t *out) {
+        for (int c = 0; c < 4; ++c)
+            out[c] = static_cast<int32_t>(std::nearbyint(std::min(1.0f, std::max(0.0f, values[c])) * scales[c]));
+    }
+};
+
+#if defined(__SSE2__)
+struct SseMipLanes {
+    static const int width = 1; // one RGBA texel per register
+    static void average(const float *row0, const float *row1, float *out) {
+        const __m128 left = _mm_add_ps(_mm_loadu_ps(row0), _mm_loadu_ps(row1));
+        const __m128 right = _mm_add_ps(_mm_loadu_ps(row0 + 4), _mm_loadu_ps(row1 + 4));
+        _mm_storeu_ps(out, _mm_mul_ps(_mm_add_ps(left, right), _mm_set1_ps(0.25f)));
+    }
+    static void quantize(const float *values, const float *scales, int32_t *out) {
+        const __m128 clamped = _mm_min_ps(_mm_set1_ps(1.0f), _mm_max_ps(_mm_setzero_ps(), _mm_loadu_ps(values)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_cvtps_epi32(_mm_mul_ps(clamped, _mm_loadu_ps(scales))));
+    }
+};
+#endif
+
+#if defined(__AVX__) || defined(RUNTIME_DISPATCH)
+struct AvxMipLanes {
+    static const int width = 2;
+    AVX_TARGET static void average(const float *row0, const float *row1, float *out) {
+        // Vertical sums of the source texels 0-1 and 2-3, then the pairs are regrouped by lane halves
+        const __m256 first = _mm256_add_ps(_mm256_loadu_ps(row0), _mm256_loadu_ps(row1));
+        const __m256 second = _mm256_add_ps(_mm256_loadu_ps(row0 + 8), _mm256_loadu_ps(row1 + 8));
+        const __m256 left = _mm256_permute2f128_ps(first, second, 0x20); // texels 0 and 2
+        const __m256 right = _mm256_permute2f128_ps(first, second, 0x31); // texels 1 and 3
+        _mm256_storeu_ps(out, _mm256_mul_ps(_mm256_add_ps(left, right), _mm256_set1_ps(0.25f)));
+    }
+    AVX_TARGET static void quantize(const float *values, const float *scales, int32_t *out) {
+        const __m256 clamped = _mm256_min_ps(_mm256_set1_ps(1.0f), _mm256_max_ps(_mm256_setzero_ps(), _mm256_loadu_ps(values)));
+        const __m256 scale = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(scales));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), _mm256_cvtps_epi32(_mm256_mul_ps(clamped, scale)));
+    }
+};
+#endif
+
+// Converts a row of 8-bit texels to linear floats, 4 per texel
+static void decodeRow(const unsigned char *pixels, uint32_t width, int channels, float *out) {
+    const ColorTables &tables = getColorTables();
+    const int colorChannels = std::min(channels, 3);
+    for (uint32_t x = 0; x < width; ++x) {
+        for (int c = 0; c < channels; ++c) {
+            const unsigned char value = pixels[x * channels + c];
+            out[4 * x + c] = c < colorChannels ? tables.toLinear[value] : value / 255.0f;
+        }
+    }
+}
+
+// Averages the 2x2 texels of two rows of linear floats, then rounds the row back to 8-bit texels
+template <typename V>
+static LANES_INLINE void reduceRow(const float *row0, const float *row1, uint32_t sourceWidth, uint32_t width, int channels,
+                                   float *out, int32_t *quantized, unsigned char *pixels) {
+    if (sourceWidth > 1) {
+        uint32_t x = 0;
+        for (; x + V::width <= width; x += V::width)
+            V::average(row0 + 8 * x, row1 + 8 * x, out + 4 * x);
+        for (; x < width; ++x)
+            ScalarMipLanes::average(row0 + 8 * x, row1 + 8 * x, out + 4 * x);
+    } else {
+        for (int c = 0; c < 4; ++c)
+            out[c] = ((row0[c] + row1[c]) + (row0[c] + row1[c])) * 0.25f; // the single column twice
+    }
+
+    // The color channels go through the table of kSrgbTableSize entries, the alpha channel straight to 8 bits
+    const ColorTables &tables = getColorTables();
+    const int colorChannels = std::min(channels, 3);
+    const float colorScale = static_cast<float>(kSrgbTableSize - 1);
+    const float scales[4] = { colorScale, colorScale, colorScale, channels == 4 ? 255.0f : colorScale };
+    uint32_t x = 0;
+    for (; x + V::width <= width; x += V::width)
+        V::quantize(out + 4 * x, scales, quantized + 4 * x);
+    for (; x < width; ++x)
+        ScalarMipLanes::quantize(out + 4 * x, scales, quantized + 4 * x);
+    for (x = 0; x < width; ++x) {
+        for (int c = 0; c < channels; ++c) {
+            const int32_t value = quantized[4 * x + c];
+            pixels[x * channels + c] = c < colorChannels ? tables.toSrgb[value] : static_cast<unsigned char>(value);
+        }
+    }
+}
+
+// Entry points of the code paths
+typedef void (*ReduceRowFunction)(const float *, const float *, uint32_t, uint32_t, int, float *, int32_t *, unsigned char *);
+
+static void reduceRowScalar(const float *row0, const float *row1, uint32_t sourceWidth, uint32_t width, int channels,
+                            float *out, int32_t *quantized, unsigned char *pixels) {
+    reduceRow<ScalarMipLanes>(row0, row1, sourceWidth, width, channels, out, quantized, pixels);
+}
+
+#if defined(__SSE2__)
+static void reduceRowSse(const float *row0, const float *row1, uint32_t sourceWidth, uint32_t width, int channels,
+                         float *out, int32_t *quantized, unsigned char *pixels) {
+    reduceRow<SseMipLanes>(row0, row1, sourceWidth, width, channels, out, quantized, pixels);
+}
+#endif
+
+#if defined(__AVX__) || defined(RUNTIME_DISPATCH)
+AVX_TARGET static void reduceRowAvx(const float *row0, const float *row1, uint32_t sourceWidth, uint32_t width, int channels,
+                                    float *out, int32_t *quantized, unsigned char *pixels) {
+    reduceRow<AvxMipLanes>(row0, row1, sourceWidth, width, channels, out, quantized, pixels);
+}
+#endif
+
+// Calls body(begin, end) over the rows, on the threads of the pool if any
+static void forRows(ThreadPool *pool, size_t count, const std::function<void(size_t, size_t)> &body) {
+    if (pool)
+        pool->parallelFor(count, body);
+    else
+        body(0, count);
+}
+
+static void buildLevels(const unsigned char *pixels, uint32_t width, uint32_t height, int channels, std::vector<MipLevel> &levels,
+                        ReduceRowFunction reduceRow, ThreadPool *pool) {
+    levels.assign(1, MipLevel());
+    levels[0].width = width;
+    levels[0].height = height;
+    levels[0].pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * channels);
+
+    // Linear floats of the previous level, from the second one: the first level is decoded two rows
+    // at a time while computing the second one, which saves a pass over the largest level
+    std::vector<float> linear, next;
+    uint32_t sourceWidth = width, sourceHeight = height;
+    while (sourceWidth > 1 || sourceHeight > 1) {
+        MipLevel level;
+        level.width = std::max(1u, sourceWidth / 2);
+        level.height = std::max(1u, sourceHeight / 2);
+        level.pixels.resize(static_cast<size_t>(level.width) * level.height * channels);
+        next.resize(static_cast<size_t>(level.width) * level.height * 4);
+        const bool first = linear.empty();
+
+        forRows(pool, level.height, [&](size_t begin, size_t end) {
+            std::vector<float> decoded(first ? 8 * static_cast<size_t>(sourceWidth) : 0, 0.0f);
+            std::vector<int32_t> quantized(4 * static_cast<size_t>(level.width));
+            for (size_t y = begin; y < end; ++y) {
+                const size_t y0 = std::min<size_t>(2 * y, sourceHeight - 1), y1 = std::min<size_t>(2 * y + 1, sourceHeight - 1);
+                const float *row0, *row1;
+                if (first) {
+                    decodeRow(pixels + y0 * sourceWidth * channels, sourceWidth, channels, &decoded[0]);
+                    decodeRow(pixels + y1 * sourceWidth * channels, sourceWidth, channels, &decoded[4 * sourceWidth]);
+                    row0 = &decoded[0];
+                    row1 = &decoded[4 * sourceWidth];
+                } else {
+                    row0 = &linear[4 * y0 * sourceWidth];
+                    row1 = &linear[4 * y1 * sourceWidth];
+                }
+                reduceRow(row0, row1, sourceWidth, level.width, channels, &next[4 * y * level.width], &quantized[0],
+                          &level.pixels[y * level.width * channels]);
+            }
+        });
+
+        levels.push_back(std::move(level));
+        linear.swap(next);
+        sourceWidth = levels.back().width;
+        sourceHeight = levels.back().height;
+    }
+}
+
+// The code path of buildMipChain
+struct MipPath {
+    const char *name;
+    ReduceRowFunction reduceRow;
+};
+
+static MipPath selectPath() {
+#if defined(RUNTIME_DISPATCH)
+    // The check includes the support of the wide registers by the operating system
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx"))
+        return { "AVX", reduceRowAvx };
+    return { "SSE2", reduceRowSse };
+#elif defined(__AVX__)
+    return { "AVX", reduceRowAvx };
+#elif defined(__SSE2__)
+    return { "SSE2", reduceRowSse };
+#else
+    return { "scalar", reduceRowScalar };
+#endif
+}
+
+static const MipPath &getPath() {
+    static const MipPath path = selectPath(); // selected once, on first use
+    return path;
+}
+
+void buildMipChain(const unsigned char *pixels, uint32_t width, uint32_t height, int channels, std::vector<MipLevel> &levels,
+                   ThreadPool *pool) {
+    buildLevels(pixels, width, height, channels, levels, getPath().reduceRow, pool);
+}
+
+void buildMipChainScalar(const unsigned char *pixels, uint32_t width, uint32_t height, int channels, std::vector<MipLevel> &levels,
+                         ThreadPool *pool) {
+    buildLevels(pixels, width, height, channels, levels, reduceRowScalar, pool);
+}
+
+const char *mipChainPath() {
+    return getPath().name;
+}
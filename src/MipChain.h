@@ -0,0 +1,38 @@
+#ifndef _MIPCHAIN
+#define _MIPCHAIN
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// One level of a mip chain, with tightly packed rows of 8-bit channels
+struct MipLevel {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<unsigned char> pixels;
+};
+
+// Fills levels with the image then its halved versions down to 1x1, with the sizes of OpenGL
+// (max(1, size / 2) at each level). Each texel is the box filter of the 2x2 texels above it, the
+// last row or column of an odd size being left out.
+//
+// The filter is gamma-correct: the color channels are sRGB, so the texels are averaged in linear
+// space (a 4th channel, alpha, is already linear), otherwise the dark texels would win and the
+// distant textures would darken. Every level is computed from the linear floats of the previous
+// one, rounded to 8 bits only for its own pixels. The rows of a level are split among the threads
+// of the pool (if any), and buildMipChain averages 2 texels per instruction with AVX, or 1 with
+// SSE2, depending on the instruction set of the CPU (with GCC and Clang; with other compilers, the
+// instruction set the program is compiled for).
+void buildMipChain(const unsigned char *pixels, uint32_t width, uint32_t height, int channels, std::vector<MipLevel> &levels,
+                   ThreadPool *pool = nullptr);
+
+// Same result one texel channel at a time. Always available, mostly for comparison purposes.
+void buildMipChainScalar(const unsigned char *pixels, uint32_t width, uint32_t height, int channels, std::vector<MipLevel> &levels,
+                         ThreadPool *pool = nullptr);
+
+// Name of the code path used by buildMipChain
+const char *mipChainPath();
+
+#endif
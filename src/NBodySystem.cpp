@@ -0,0 +1,310 @@
+#include "NBodySystem.h"
+
+#include <algorithm>
+#include <cmath>
+
+NBodySystem::NBodySystem(ThreadPool *pool, double gravitationalConstant) {
+    this->pool = pool;
+    this->gravitationalConstant = gravitationalConstant;
+}
+
+size_t NBodySystem::addBody(const glm::dvec3 &position, const glm::dvec3 &velocity, double mass) {
+    masses.push_back(mass);
+    posX.push_back(position.x);
+    posY.push_back(position.y);
+    posZ.push_back(position.z);
+    velX.push_back(velocity.x);
+    velY.push_back(velocity.y);
+    velZ.push_back(velocity.z);
+    accX.push_back(0.0);
+    accY.push_back(0.0);
+    accZ.push_back(0.0);
+    prevPosX.push_back(position.x);
+    prevPosY.push_back(position.y);
+    prevPosZ.push_back(position.z);
+    levels.push_back(0);
+    accelerationsValid = false;
+    return masses.size() - 1;
+}
+
+void NBodySystem::reserve(size_t count) {
+    masses.reserve(count);
+    posX.reserve(count);
+    posY.reserve(count);
+    posZ.reserve(count);
+    velX.reserve(count);
+    velY.reserve(count);
+    velZ.reserve(count);
+    accX.reserve(count);
+    accY.reserve(count);
+    accZ.reserve(count);
+    prevPosX.reserve(count);
+    prevPosY.reserve(count);
+    prevPosZ.reserve(count);
+    levels.reserve(count);
+}
+
+void NBodySystem::clear() {
+    masses.clear();
+    posX.clear();
+    posY.clear();
+    posZ.clear();
+    velX.clear();
+    velY.clear();
+    velZ.clear();
+    accX.clear();
+    accY.clear();
+    accZ.clear();
+    prevPosX.clear();
+    prevPosY.clear();
+    prevPosZ.clear();
+    levels.clear();
+    bindings.clear();
+    accelerationsValid = false;
+}
+
+void NBodySystem::addBinding(size_t child, size_t parent, double gm) {
+    bindings.push_back({ child, parent, gm });
+    accelerationsValid = false;
+}
+
+void NBodySystem::loadFromOrbits(const OrbitalState &orbits) {
+    clear();
+    reserve(orbits.size());
+
+    // Positions and velocities relative to the parents, on the kinematic orbits
+    std::vector<glm::dvec3> positions(orbits.size());
+    std::vector<glm::dvec3> velocities(orbits.size());
+    for (size_t i = 0; i < orbits.size(); ++i) {
+        positions[i] = orbits.getPosition(i);
+        if (orbits.getParent(i) != OrbitalState::kNoParent)
+            velocities[i] = orbits.getKeplerVelocity(i, orbits.getOrbitGM(i));
+    }
+
+    // It is the center of mass of a parent and its children that follows the orbit of the parent:
+    // the parent moves against its children (the Earth around the barycenter of the Earth-Moon pair)
+    std::vector<glm::dvec3> childMoments(orbits.size(), glm::dvec3(0.0));
+    std::vector<glm::dvec3> childMomenta(orbits.size(), glm::dvec3(0.0));
+    std::vector<double> systemMasses(orbits.size());
+    for (size_t i = 0; i < orbits.size(); ++i)
+        systemMasses[i] = orbits.getMass(i);
+    for (size_t i = 0; i < orbits.size(); ++i) {
+        const int parent = orbits.getParent(i);
+        if (parent != OrbitalState::kNoParent) {
+            childMoments[parent] += positions[i] * orbits.getMass(i);
+            childMomenta[parent] += velocities[i] * orbits.getMass(i);
+            systemMasses[parent] += orbits.getMass(i);
+        }
+    }
+    for (size_t i = 0; i < orbits.size(); ++i) {
+        if (systemMasses[i] > 0.0) {
+            positions[i] -= childMoments[i] / systemMasses[i];
+            velocities[i] -= childMomenta[i] / systemMasses[i];
+        }
+    }
+
+    // Parents are registered before their children in the orbital state
+    glm::dvec3 momentum(0.0);
+    double totalMass = 0.0;
+    for (size_t i = 0; i < orbits.size(); ++i) {
+        const int parent = orbits.getParent(i);
+        if (parent != OrbitalState::kNoParent) {
+            positions[i] += positions[parent];
+            velocities[i] += velocities[parent];
+        }
+        momentum += velocities[i] * orbits.getMass(i);
+        totalMass += orbits.getMass(i);
+    }
+
+    // Remove the drift of the center of mass, so that the system stays in view
+    const glm::dvec3 drift = totalMass > 0.0 ? momentum / totalMass : glm::dvec3(0.0);
+    for (size_t i = 0; i < orbits.size(); ++i)
+        addBody(positions[i], velocities[i] - drift, orbits.getMass(i));
+
+    // The relative acceleration of the pair is gm (1 + m_body / m_parent) / r^2 for a binding of gm
+    for (size_t i = 0; i < orbits.size(); ++i) {
+        const int parent = orbits.getParent(i);
+        if (parent == OrbitalState::kNoParent || orbits.getMass(parent) <= 0.0)
+            continue;
+        const double pairGM = gravitationalConstant * (orbits.getMass(parent) + orbits.getMass(i));
+        const double gm = (orbits.getOrbitGM(i) - pairGM) / (1.0 + orbits.getMass(i) / orbits.getMass(parent));
+        if (gm != 0.0)
+            addBinding(i, parent, gm);
+    }
+}
+
+void NBodySystem::getState(std::vector<double> &state) const {
+    const std::vector<double> *arrays[6] = { &posX, &posY, &posZ, &velX, &velY, &velZ };
+    state.resize(6 * size());
+    for (int a = 0; a < 6; ++a)
+        std::copy(arrays[a]->begin(), arrays[a]->end(), state.begin() + a * size());
+}
+
+void NBodySystem::setState(const std::vector<double> &state) {
+    std::vector<double> *arrays[6] = { &posX, &posY, &posZ, &velX, &velY, &velZ };
+    for (int a = 0; a < 6; ++a)
+        std::copy(state.begin() + a * size(), state.begin() + (a + 1) * size(), arrays[a]->begin());
+    prevPosX = posX;
+    prevPosY = posY;
+    prevPosZ = posZ;
+    // The bodies are synchronized between steps: recomputing the accelerations and the levels from
+    // the positions gives the same ones as at the end of the step that produced the state
+    accelerationsValid = false;
+}
+
+void NBodySystem::computeAccelerations(const std::vector<uint32_t> &bodies) {
+    octree.build(posX.data(), posY.data(), posZ.data(), masses.data(), size(), *pool);
+    octree.computeAccelerations(gravitationalConstant, openingAngle, softening, bodies, accX.data(), accY.data(), accZ.data(), *pool);
+    addBindingAccelerations(bodies);
+    forceEvaluations += bodies.size();
+}
+
+void NBodySystem::addBindingAccelerations(const std::vector<uint32_t> &bodies) {
+    if (bindings.empty())
+        return;
+    // Only the accelerations of the given bodies were recomputed, the others must be left as they are
+    std::vector<bool> active(size(), false);
+    for (uint32_t i : bodies)
+        active[i] = true;
+    for (const Binding &binding : bindings) {
+        const double dx = posX[binding.parent] - posX[binding.child];
+        const double dy = posY[binding.parent] - posY[binding.child];
+        const double dz = posZ[binding.parent] - posZ[binding.child];
+        const double r2 = dx * dx + dy * dy + dz * dz + softening * softening;
+        const double factor = binding.gm / (r2 * std::sqrt(r2));
+        if (active[binding.child]) {
+            accX[binding.child] += factor * dx;
+            accY[binding.child] += factor * dy;
+            accZ[binding.child] += factor * dz;
+        }
+        if (active[binding.parent]) {
+            // Equal and opposite force, so that the momentum is conserved
+            const double ratio = masses[binding.child] / masses[binding.parent];
+            accX[binding.parent] -= factor * ratio * dx;
+            accY[binding.parent] -= factor * ratio * dy;
+            accZ[binding.parent] -= factor * ratio * dz;
+        }
+    }
+}
+
+int NBodySystem::desiredLevel(size_t index, double dt) const {
+    // dt_i = sqrt(2 eta softening / |a|): the step shrinks where the acceleration is strong
+    const double acceleration = std::sqrt(accX[index] * accX[index] + accY[index] * accY[index] + accZ[index] * accZ[index]);
+    if (acceleration <= 0.0)
+        return 0;
+    const double desiredStep = std::sqrt(2.0 * timestepAccuracy * softening / acceleration);
+    if (desiredStep >= dt)
+        return 0;
+    return std::min(kMaxLevel, static_cast<int>(std::ceil(std::log2(dt / desiredStep))));
+}
+
+void NBodySystem::updateLevels(const std::vector<uint32_t> &bodies, uint32_t tick, double dt) {
+    // A body may always move to a finer level, but only to a coarser one whose steps start at this tick
+    int uniformLevel = 0;
+    for (uint32_t i : bodies) {
+        int level = desiredLevel(i, dt);
+        while (level < levels[i] && tick % (kTicksPerStep >> level) != 0)
+            ++level;
+        levels[i] = level;
+        uniformLevel = std::max(uniformLevel, level);
+    }
+    // Without block timesteps, all the bodies (then all active) share the finest level
+    if (!blockTimesteps) {
+        for (uint32_t i : bodies)
+            levels[i] = uniformLevel;
+    }
+}
+
+void NBodySystem::kick(const std::vector<uint32_t> &bodies, double tickDuration) {
+    pool->parallelFor(bodies.size(), [&](size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b) {
+            const uint32_t i = bodies[b];
+            const double dt = 0.5 * tickDuration * (kTicksPerStep >> levels[i]); // half a step of the body
+            velX[i] += accX[i] * dt;
+            velY[i] += accY[i] * dt;
+            velZ[i] += accZ[i] * dt;
+        }
+    });
+}
+
+void NBodySystem::drift(double dt) {
+    pool->parallelFor(size(), [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; ++i) {
+            posX[i] += velX[i] * dt;
+            posY[i] += velY[i] * dt;
+            posZ[i] += velZ[i] * dt;
+        }
+    });
+}
+
+void NBodySystem::step(double dt) {
+    std::vector<uint32_t> active;
+    if (!accelerationsValid) {
+        for (size_t i = 0; i < size(); ++i)
+            active.push_back(static_cast<uint32_t>(i));
+        computeAccelerations(active);
+        for (uint32_t i : active)
+            levels[i] = 0;
+        updateLevels(active, 0, dt);
+        accelerationsValid = true;
+    }
+
+    prevPosX = posX;
+    prevPosY = posY;
+    prevPosZ = posZ;
+
+    // Kick-drift-kick leapfrog on block timesteps: the step of a body at level k is dt / 2^k, and
+    // the bodies are all synchronized at the end of dt. Each body is kicked only when its own
+    // step starts or ends, and the forces are only computed for the bodies ending a step.
+    const double tickDuration = dt / kTicksPerStep;
+    active.resize(size());
+    for (size_t i = 0; i < size(); ++i)
+        active[i] = static_cast<uint32_t>(i);
+    kick(active, tickDuration);
+
+    uint32_t tick = 0;
+    while (tick < kTicksPerStep) {
+        const int finestLevel = size() > 0 ? *std::max_element(levels.begin(), levels.end()) : 0;
+        const uint32_t stride = kTicksPerStep >> finestLevel;
+        drift(stride * tickDuration);
+        tick += stride;
+
+        active.clear();
+        for (size_t i = 0; i < size(); ++i) {
+            if (tick % (kTicksPerStep >> levels[i]) == 0)
+                active.push_back(static_cast<uint32_t>(i));
+        }
+        computeAccelerations(active);
+        kick(active, tickDuration); // closing half-kick, on the step that ends
+        updateLevels(active, tick, dt);
+        if (tick < kTicksPerStep)
+            kick(active, tickDuration); // opening half-kick, on the next step
+    }
+}
+
+double NBodySystem::computeTotalEnergy() {
+    std::vector<double> ax(size()), ay(size()), az(size()), potentials(size());
+    octree.build(posX.data(), posY.data(), posZ.data(), masses.data(), size(), *pool);
+    octree.computeAccelerations(gravitationalConstant, openingAngle, softening, ax.data(), ay.data(), az.data(), potentials.data(), *pool);
+
+    // Each pair appears in the potentials of both of its bodies
+    double energy = 0.0;
+    for (size_t i = 0; i < size(); ++i) {
+        const double v2 = velX[i] * velX[i] + velY[i] * velY[i] + velZ[i] * velZ[i];
+        energy += 0.5 * masses[i] * (v2 + potentials[i]);
+    }
+    for (const Binding &binding : bindings) {
+        const double dx = posX[binding.parent] - posX[binding.child];
+        const double dy = posY[binding.parent] - posY[binding.child];
+        const double dz = posZ[binding.parent] - posZ[binding.child];
+        energy -= binding.gm * masses[binding.child] / std::sqrt(dx * dx + dy * dy + dz * dz + softening * softening);
+    }
+    return energy;
+}
+
+std::vector<size_t> NBodySystem::getLevelHistogram() const {
+    std::vector<size_t> histogram(kMaxLevel + 1, 0);
+    for (int level : levels)
+        ++histogram[level];
+    return histogram;
+}
@@ -0,0 +1,96 @@
+#ifndef _NBODYSYSTEM
+#define _NBODYSYSTEM
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Octree.h"
+#include "OrbitalState.h"
+#include "ThreadPool.h"
+
+// Gravitational N-body simulation, alternative to the kinematic orbits of OrbitalState.
+// The forces are approximated with a Barnes-Hut octree rebuilt at every step, and the bodies
+// are advanced with a kick-drift-kick leapfrog integrator on block timesteps: each body takes
+// power-of-two fractions of the step, smaller where its acceleration is stronger. Building the
+// tree, computing the forces and integrating are all spread over the threads of the pool.
+class NBodySystem {
+    public:
+        NBodySystem(ThreadPool *pool, double gravitationalConstant);
+        size_t addBody(const glm::dvec3 &position, const glm::dvec3 &velocity, double mass);
+        void reserve(size_t count);
+        void clear();
+
+        // Replaces the bodies with the ones of the kinematic model, at their current positions.
+        // Each body gets the velocity of its kinematic orbit around its parent, whose period sets the
+        // gravitational parameter of the pair (see OrbitalState::getOrbitGM), and it is the center of
+        // mass of a body and its children that is put on that orbit. As the periods of the scene do not
+        // match its masses, the difference with G (m_parent + m_body) is made up by a binding, an extra
+        // inverse-square attraction between the two bodies: the orbits then stay the kinematic ones,
+        // perturbed by the gravity of all the other bodies.
+        void loadFromOrbits(const OrbitalState &orbits);
+        // Adds an attraction of gm / r^2 on the child, and the opposite force on the parent
+        void addBinding(size_t child, size_t parent, double gm);
+
+        void step(double dt); // advances all the bodies by dt, after which they are all synchronized
+        size_t size() const { return masses.size(); }
+        glm::dvec3 getPosition(size_t index) const { return glm::dvec3(posX[index], posY[index], posZ[index]); }
+        glm::dvec3 getPreviousPosition(size_t index) const { return glm::dvec3(prevPosX[index], prevPosY[index], prevPosZ[index]); }
+        // Position between the previous step (alpha = 0) and the latest one (alpha = 1)
+        glm::dvec3 getInterpolatedPosition(size_t index, double alpha) const { return glm::mix(getPreviousPosition(index), getPosition(index), alpha); }
+
+        // Full dynamical state, for snapshots: the positions then the velocities, coordinate by coordinate.
+        // Restoring a state and stepping gives exactly the same results as the original run.
+        void getState(std::vector<double> &state) const;
+        void setState(const std::vector<double> &state); // for the same bodies as getState
+
+        void setOpeningAngle(double theta) { openingAngle = theta; }
+        void setSoftening(double length) { softening = length; }
+        // Smaller values give smaller individual steps, hence fewer errors and more force evaluations
+        void setTimestepAccuracy(double eta) { timestepAccuracy = eta; }
+        // When disabled, all the bodies take the smallest individual step (for comparison)
+        void setBlockTimesteps(bool enabled) { blockTimesteps = enabled; }
+
+        // Diagnostics: the total energy is conserved by the exact dynamics, so its drift measures the integration error
+        double computeTotalEnergy();
+        size_t getForceEvaluationCount() const { return forceEvaluations; }
+        std::vector<size_t> getLevelHistogram() const; // number of bodies stepping dt / 2^k, for each level k
+
+        const static int kMaxLevel = 12;
+
+    private:
+        void computeAccelerations(const std::vector<uint32_t> &bodies);
+        void addBindingAccelerations(const std::vector<uint32_t> &bodies);
+        int desiredLevel(size_t index, double dt) const;
+        void updateLevels(const std::vector<uint32_t> &bodies, uint32_t tick, double dt);
+        void kick(const std::vector<uint32_t> &bodies, double tickDuration);
+        void drift(double dt);
+
+    private:
+        ThreadPool *pool;
+        Octree octree;
+        double gravitationalConstant;
+        double openingAngle = 0.5; // cells seen under a smaller angle are approximated by their center of mass
+        double softening = 1e-3;
+        double timestepAccuracy = 0.025;
+        bool blockTimesteps = true;
+        bool accelerationsValid = false;
+        size_t forceEvaluations = 0;
+        std::vector<double> masses;
+        std::vector<double> posX, posY, posZ;
+        std::vector<double> velX, velY, velZ;
+        std::vector<double> accX, accY, accZ;
+        std::vector<double> prevPosX, prevPosY, prevPosZ;
+        std::vector<int> levels; // each body steps dt / 2^level
+        struct Binding {
+            size_t child, parent;
+            double gm;
+        };
+        std::vector<Binding> bindings;
+
+        const static uint32_t kTicksPerStep = 1u << kMaxLevel;
+};
+
+#endif
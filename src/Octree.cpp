@@ -0,0 +1,334 @@
+#include "Octree.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+static const uint32_t kLeafSize = 8; // a cell with at most this many bodies is not split
+static const int kMaxLevel = 21; // 21 bits per axis in a 64-bit Morton key
+
+// Spreads the 21 lowest bits of v so that two zeros separate consecutive bits
+static uint64_t spreadBits(uint64_t v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+}
+
+struct KeyedBody {
+    uint64_t key;
+    uint32_t index;
+    bool operator<(const KeyedBody &other) const { return key < other.key; }
+};
+
+// Splits [0, n) in chunks of the given size and processes them in parallel
+template <typename F>
+static void forEachChunk(ThreadPool &pool, size_t n, size_t chunkSize, const F &body) {
+    const size_t chunkCount = (n + chunkSize - 1) / chunkSize;
+    pool.parallelFor(chunkCount, [&](size_t first, size_t last) {
+        for (size_t c = first; c < last; ++c)
+            body(c, c * chunkSize, std::min(n, (c + 1) * chunkSize));
+    });
+}
+
+// Sorts runs of the array in parallel, then merges pairs of adjacent runs in parallel until one is left
+static void parallelSort(std::vector<KeyedBody> &bodies, ThreadPool &pool) {
+    const size_t n = bodies.size();
+    size_t runSize = std::max<size_t>(4096, (n + pool.getThreadCount() - 1) / pool.getThreadCount());
+    forEachChunk(pool, n, runSize, [&](size_t, size_t begin, size_t end) {
+        std::sort(bodies.begin() + begin, bodies.begin() + end);
+    });
+
+    std::vector<KeyedBody> buffer(n);
+    for (; runSize < n; runSize *= 2) {
+        forEachChunk(pool, n, 2 * runSize, [&](size_t, size_t begin, size_t end) {
+            size_t middle = std::min(end, begin + runSize);
+            std::merge(bodies.begin() + begin, bodies.begin() + middle, bodies.begin() + middle, bodies.begin() + end, buffer.begin() + begin);
+        });
+        bodies.swap(buffer);
+    }
+}
+
+void Octree::build(const double *x, const double *y, const double *z, const double *mass, size_t n, ThreadPool &pool) {
+    assert(n < std::numeric_limits<uint32_t>::max());
+    nodes.clear();
+    if (n == 0)
+        return;
+
+    // Bounding cube of the bodies
+    const size_t chunkSize = 16384;
+    const size_t chunkCount = (n + chunkSize - 1) / chunkSize;
+    std::vector<double> chunkBounds(chunkCount * 6);
+    forEachChunk(pool, n, chunkSize, [&](size_t c, size_t begin, size_t end) {
+        double *b = &chunkBounds[c * 6];
+        b[0] = b[3] = x[begin];
+        b[1] = b[4] = y[begin];
+        b[2] = b[5] = z[begin];
+        for (size_t i = begin + 1; i < end; ++i) {
+            b[0] = std::min(b[0], x[i]); b[3] = std::max(b[3], x[i]);
+            b[1] = std::min(b[1], y[i]); b[4] = std::max(b[4], y[i]);
+            b[2] = std::min(b[2], z[i]); b[5] = std::max(b[5], z[i]);
+        }
+    });
+    double bounds[6] = { chunkBounds[0], chunkBounds[1], chunkBounds[2], chunkBounds[3], chunkBounds[4], chunkBounds[5] };
+    for (size_t c = 1; c < chunkCount; ++c) {
+        for (int k = 0; k < 3; ++k) {
+            bounds[k] = std::min(bounds[k], chunkBounds[c * 6 + k]);
+            bounds[k + 3] = std::max(bounds[k + 3], chunkBounds[c * 6 + k + 3]);
+        }
+    }
+    rootWidth = std::max(std::max(bounds[3] - bounds[0], bounds[4] - bounds[1]), bounds[5] - bounds[2]);
+    rootWidth = rootWidth > 0.0 ? rootWidth * (1.0 + 1e-9) : 1.0;
+
+    // Morton keys, then sort
+    const double scale = static_cast<double>(1 << kMaxLevel) / rootWidth;
+    const double maxCoordinate = static_cast<double>((1 << kMaxLevel) - 1);
+    std::vector<KeyedBody> keyed(n);
+    forEachChunk(pool, n, chunkSize, [&](size_t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            uint64_t qx = static_cast<uint64_t>(std::min(maxCoordinate, (x[i] - bounds[0]) * scale));
+            uint64_t qy = static_cast<uint64_t>(std::min(maxCoordinate, (y[i] - bounds[1]) * scale));
+            uint64_t qz = static_cast<uint64_t>(std::min(maxCoordinate, (z[i] - bounds[2]) * scale));
+            keyed[i].key = spreadBits(qx) << 2 | spreadBits(qy) << 1 | spreadBits(qz);
+            keyed[i].index = static_cast<uint32_t>(i);
+        }
+    });
+    parallelSort(keyed, pool);
+
+    // Copy the bodies in sorted order, for a coherent memory access during the traversals
+    keys.resize(n);
+    order.resize(n);
+    sortedX.resize(n);
+    sortedY.resize(n);
+    sortedZ.resize(n);
+    sortedMass.resize(n);
+    sortedSlots.resize(n);
+    forEachChunk(pool, n, chunkSize, [&](size_t, size_t begin, size_t end) {
+        for (size_t s = begin; s < end; ++s) {
+            const uint32_t i = keyed[s].index;
+            keys[s] = keyed[s].key;
+            order[s] = i;
+            sortedSlots[i] = static_cast<uint32_t>(s);
+            sortedX[s] = x[i];
+            sortedY[s] = y[i];
+            sortedZ[s] = z[i];
+            sortedMass[s] = mass[i];
+        }
+    });
+
+    // The subtrees below a given level are built in parallel, then the levels above are assembled
+    int splitLevel = 0;
+    while (splitLevel < 3 && (size_t(1) << (3 * splitLevel)) < 8 * pool.getThreadCount())
+        ++splitLevel;
+    if (pool.getThreadCount() == 1)
+        splitLevel = 0;
+
+    std::vector<Range> ranges;
+    collectSubtrees(0, static_cast<uint32_t>(n), 0, splitLevel, ranges);
+    std::vector<std::vector<Node> > subtrees(ranges.size());
+    pool.parallelFor(ranges.size(), [&](size_t first, size_t last) {
+        for (size_t r = first; r < last; ++r)
+            buildSubtree(ranges[r].begin, ranges[r].end, ranges[r].level, subtrees[r]);
+    });
+
+    size_t nextSubtree = 0;
+    assemble(0, static_cast<uint32_t>(n), 0, splitLevel, subtrees, nextSubtree);
+}
+
+uint32_t Octree::childEnd(uint32_t begin, uint32_t end, int level, unsigned octant) const {
+    // The bodies of a cell share the bits above this level: sorted by key means sorted by octant
+    const int shift = 3 * (kMaxLevel - 1 - level);
+    return static_cast<uint32_t>(std::partition_point(keys.begin() + begin, keys.begin() + end,
+        [&](uint64_t key) { return ((key >> shift) & 7) <= octant; }) - keys.begin());
+}
+
+void Octree::collectSubtrees(uint32_t begin, uint32_t end, int level, int splitLevel, std::vector<Range> &subtrees) const {
+    if (level == splitLevel || end - begin <= kLeafSize) {
+        Range range = { begin, end, level };
+        subtrees.push_back(range);
+        return;
+    }
+    for (unsigned octant = 0; octant < 8; ++octant) {
+        uint32_t childLast = childEnd(begin, end, level, octant);
+        if (childLast > begin)
+            collectSubtrees(begin, childLast, level + 1, splitLevel, subtrees);
+        begin = childLast;
+    }
+}
+
+void Octree::buildSubtree(uint32_t begin, uint32_t end, int level, std::vector<Node> &out) const {
+    const size_t index = out.size();
+    out.push_back(Node());
+
+    Node node;
+    node.width = std::ldexp(rootWidth, -level);
+    node.bodyBegin = begin;
+    node.bodyEnd = end;
+    node.leaf = end - begin <= kLeafSize || level == kMaxLevel;
+    node.mass = 0.0;
+    double sumX = 0.0, sumY = 0.0, sumZ = 0.0;
+
+    if (node.leaf) {
+        for (uint32_t s = begin; s < end; ++s) {
+            node.mass += sortedMass[s];
+            sumX += sortedMass[s] * sortedX[s];
+            sumY += sortedMass[s] * sortedY[s];
+            sumZ += sortedMass[s] * sortedZ[s];
+        }
+    } else {
+        for (unsigned octant = 0; octant < 8; ++octant) {
+            uint32_t childLast = childEnd(begin, end, level, octant);
+            if (childLast > begin) {
+                const size_t child = out.size();
+                buildSubtree(begin, childLast, level + 1, out);
+                node.mass += out[child].mass;
+                sumX += out[child].mass * out[child].comX;
+                sumY += out[child].mass * out[child].comY;
+                sumZ += out[child].mass * out[child].comZ;
+            }
+            begin = childLast;
+        }
+    }
+
+    if (node.mass > 0.0) {
+        node.comX = sumX / node.mass;
+        node.comY = sumY / node.mass;
+        node.comZ = sumZ / node.mass;
+    } else {
+        // Massless bodies only: any point of the cell will do
+        node.comX = sortedX[node.bodyBegin];
+        node.comY = sortedY[node.bodyBegin];
+        node.comZ = sortedZ[node.bodyBegin];
+    }
+    node.next = static_cast<uint32_t>(out.size());
+    out[index] = node;
+}
+
+size_t Octree::assemble(uint32_t begin, uint32_t end, int level, int splitLevel,
+                        std::vector<std::vector<Node> > &subtrees, size_t &nextSubtree) {
+    const size_t index = nodes.size();
+
+    // Same descent as collectSubtrees, so the subtrees are consumed in the order they were collected
+    if (level == splitLevel || end - begin <= kLeafSize) {
+        const std::vector<Node> &subtree = subtrees[nextSubtree++];
+        const uint32_t offset = static_cast<uint32_t>(index);
+        for (const Node &node : subtree) {
+            nodes.push_back(node);
+            nodes.back().next += offset;
+        }
+        return index;
+    }
+
+    nodes.push_back(Node());
+    Node node;
+    node.width = std::ldexp(rootWidth, -level);
+    node.bodyBegin = begin;
+    node.bodyEnd = end;
+    node.leaf = false;
+    node.mass = 0.0;
+    double sumX = 0.0, sumY = 0.0, sumZ = 0.0;
+    for (unsigned octant = 0; octant < 8; ++octant) {
+        uint32_t childLast = childEnd(begin, end, level, octant);
+        if (childLast > begin) {
+            const size_t child = assemble(begin, childLast, level + 1, splitLevel, subtrees, nextSubtree);
+            node.mass += nodes[child].mass;
+            sumX += nodes[child].mass * nodes[child].comX;
+            sumY += nodes[child].mass * nodes[child].comY;
+            sumZ += nodes[child].mass * nodes[child].comZ;
+        }
+        begin = childLast;
+    }
+    if (node.mass > 0.0) {
+        node.comX = sumX / node.mass;
+        node.comY = sumY / node.mass;
+        node.comZ = sumZ / node.mass;
+    } else {
+        node.comX = nodes[index + 1].comX;
+        node.comY = nodes[index + 1].comY;
+        node.comZ = nodes[index + 1].comZ;
+    }
+    node.next = static_cast<uint32_t>(nodes.size());
+    nodes[index] = node;
+    return index;
+}
+
+void Octree::accelerationOf(uint32_t sortedIndex, double gm, double theta2, double softening2,
+                            double &ax, double &ay, double &az, double &potential) const {
+    const double px = sortedX[sortedIndex], py = sortedY[sortedIndex], pz = sortedZ[sortedIndex];
+    const uint32_t nodeCount = static_cast<uint32_t>(nodes.size());
+    double sumX = 0.0, sumY = 0.0, sumZ = 0.0, sumPotential = 0.0;
+
+    uint32_t current = 0;
+    while (current < nodeCount) {
+        const Node &node = nodes[current];
+        if (node.leaf) {
+            for (uint32_t s = node.bodyBegin; s < node.bodyEnd; ++s) {
+                if (s == sortedIndex)
+                    continue;
+                const double dx = sortedX[s] - px, dy = sortedY[s] - py, dz = sortedZ[s] - pz;
+                const double d2 = dx * dx + dy * dy + dz * dz + softening2;
+                const double invD = 1.0 / std::sqrt(d2);
+                const double f = sortedMass[s] * invD * invD * invD;
+                sumX += f * dx;
+                sumY += f * dy;
+                sumZ += f * dz;
+                sumPotential += sortedMass[s] * invD;
+            }
+            current = node.next;
+            continue;
+        }
+
+        const double dx = node.comX - px, dy = node.comY - py, dz = node.comZ - pz;
+        const double d2 = dx * dx + dy * dy + dz * dz + softening2;
+        if (node.width * node.width < theta2 * d2) {
+            // Far enough: the whole cell acts as a point mass
+            const double invD = 1.0 / std::sqrt(d2);
+            const double f = node.mass * invD * invD * invD;
+            sumX += f * dx;
+            sumY += f * dy;
+            sumZ += f * dz;
+            sumPotential += node.mass * invD;
+            current = node.next;
+        } else {
+            current = current + 1; // open the cell: its first child follows it
+        }
+    }
+
+    ax = gm * sumX;
+    ay = gm * sumY;
+    az = gm * sumZ;
+    potential = -gm * sumPotential;
+}
+
+void Octree::computeAccelerations(double gravitationalConstant, double theta, double softening,
+                                  double *ax, double *ay, double *az, double *potentials, ThreadPool &pool) const {
+    const double theta2 = theta * theta;
+    const double softening2 = softening * softening;
+    // Consecutive sorted bodies are close to each other and take similar paths in the tree
+    pool.parallelFor(order.size(), [&](size_t first, size_t last) {
+        double potential;
+        for (size_t s = first; s < last; ++s) {
+            const uint32_t i = order[s];
+            accelerationOf(static_cast<uint32_t>(s), gravitationalConstant, theta2, softening2, ax[i], ay[i], az[i], potential);
+            if (potentials)
+                potentials[i] = potential;
+        }
+    });
+}
+
+void Octree::computeAccelerations(double gravitationalConstant, double theta, double softening,
+                                  const std::vector<uint32_t> &bodies, double *ax, double *ay, double *az, ThreadPool &pool) const {
+    const double theta2 = theta * theta;
+    const double softening2 = softening * softening;
+    pool.parallelFor(bodies.size(), [&](size_t first, size_t last) {
+        double potential;
+        for (size_t b = first; b < last; ++b) {
+            const uint32_t i = bodies[b];
+            accelerationOf(sortedSlots[i], gravitationalConstant, theta2, softening2, ax[i], ay[i], az[i], potential);
+        }
+    });
+}
@@ -0,0 +1,65 @@
+#ifndef _OCTREE
+#define _OCTREE
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ThreadPool.h"
+
+// Barnes-Hut octree over a set of point masses.
+// The bodies are sorted along a Morton (Z-order) curve, so that every cell of the tree covers a
+// contiguous range of sorted bodies. The nodes are stored in depth-first order with, for each
+// node, the index of the node following its subtree: the tree is traversed without any stack,
+// either by descending into the first child (the next node) or by skipping the whole subtree.
+class Octree {
+    public:
+        struct Node {
+            double comX, comY, comZ; // center of mass
+            double mass;
+            double width; // width of the cubic cell
+            uint32_t next; // node following the subtree of this one
+            uint32_t bodyBegin, bodyEnd; // bodies of the subtree, in sorted order
+            bool leaf;
+        };
+
+        // Builds the tree over the n given bodies, in parallel on the pool
+        void build(const double *x, const double *y, const double *z, const double *mass, size_t n, ThreadPool &pool);
+
+        // Computes the gravitational acceleration of every body of the last build, approximating the
+        // cells seen under an angle smaller than theta by their center of mass. The softening length
+        // avoids singularities in close encounters. The accelerations are written at the original indices,
+        // as well as the gravitational potentials if an array is given for them.
+        void computeAccelerations(double gravitationalConstant, double theta, double softening,
+                                  double *ax, double *ay, double *az, double *potentials, ThreadPool &pool) const;
+
+        // Same, for the bodies whose original index is listed (e.g. the bodies due for a kick)
+        void computeAccelerations(double gravitationalConstant, double theta, double softening,
+                                  const std::vector<uint32_t> &bodies, double *ax, double *ay, double *az, ThreadPool &pool) const;
+
+        size_t getNodeCount() const { return nodes.size(); }
+
+    private:
+        struct Range {
+            uint32_t begin, end;
+            int level;
+        };
+
+        void collectSubtrees(uint32_t begin, uint32_t end, int level, int splitLevel, std::vector<Range> &subtrees) const;
+        void buildSubtree(uint32_t begin, uint32_t end, int level, std::vector<Node> &out) const;
+        size_t assemble(uint32_t begin, uint32_t end, int level, int splitLevel,
+                        std::vector<std::vector<Node> > &subtrees, size_t &nextSubtree);
+        uint32_t childEnd(uint32_t begin, uint32_t end, int level, unsigned octant) const;
+        void accelerationOf(uint32_t sortedIndex, double gm, double theta2, double softening2,
+                            double &ax, double &ay, double &az, double &potential) const;
+
+    private:
+        double rootWidth = 0.0;
+        std::vector<uint64_t> keys; // sorted Morton keys
+        std::vector<uint32_t> order; // original index of each sorted body
+        std::vector<uint32_t> sortedSlots; // sorted index of each original body
+        std::vector<double> sortedX, sortedY, sortedZ, sortedMass;
+        std::vector<Node> nodes;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "OrbitalState.h"
+#include "KeplerSolver.h"
+
+#include <cassert>
+#include <cmath>
+
+size_t OrbitalState::addBody(int parent, float orbitRadius, float eccentricity, float orbitPeriod, float phase, float inclination) {
+    assert(parent < static_cast<int>(size()));
+    assert(eccentricity >= 0.0f && eccentricity < 1.0f);
+
+    // The periods are divided by 10 for a faster animation
+    double angularSpeed = orbitPeriod > 0.0f ? 2.0 * glm::pi<double>() / (orbitPeriod * 0.1) : 0.0;
+
+    orbitRadii.push_back(orbitRadius);
+    eccentricities.push_back(eccentricity);
+    orbitPeriods.push_back(orbitPeriod);
+    angularSpeeds.push_back(angularSpeed);
+    phases.push_back(phase);
+    inclinations.push_back(inclination);
+    sinInclinations.push_back(std::sin(inclination));
+    cosInclinations.push_back(std::cos(inclination));
+    parents.push_back(parent);
+    masses.push_back(0.0);
+    posX.push_back(0.0);
+    posY.push_back(0.0);
+    posZ.push_back(0.0);
+    prevPosX.push_back(0.0);
+    prevPosY.push_back(0.0);
+    prevPosZ.push_back(0.0);
+    meanAnomalies.push_back(0.0f);
+    cosTrueAnomalies.push_back(1.0f);
+    sinTrueAnomalies.push_back(0.0f);
+    radiusRatios.push_back(1.0f);
+
+    return parents.size() - 1;
+}
+
+void OrbitalState::reserve(size_t count) {
+    orbitRadii.reserve(count);
+    eccentricities.reserve(count);
+    orbitPeriods.reserve(count);
+    angularSpeeds.reserve(count);
+    phases.reserve(count);
+    inclinations.reserve(count);
+    sinInclinations.reserve(count);
+    cosInclinations.reserve(count);
+    parents.reserve(count);
+    masses.reserve(count);
+    posX.reserve(count);
+    posY.reserve(count);
+    posZ.reserve(count);
+    prevPosX.reserve(count);
+    prevPosY.reserve(count);
+    prevPosZ.reserve(count);
+    meanAnomalies.reserve(count);
+    cosTrueAnomalies.reserve(count);
+    sinTrueAnomalies.reserve(count);
+    radiusRatios.reserve(count);
+}
+
+glm::dvec3 OrbitalState::getKeplerVelocity(size_t index, double gm) const {
+    const double e = eccentricities[index];
+    const double p = orbitRadii[index] * (1.0 - e * e); // semi-latus rectum
+    if (p <= 0.0)
+        return glm::dvec3(0.0);
+
+    // In the orbital plane: v = sqrt(gm / p) * (-sin(nu), e + cos(nu)), expressed in the basis
+    // used by updateLocalPositions, i.e. (1, 0, 0) and the tilted (0, -sin(i), cos(i))
+    const double speed = std::sqrt(gm / p);
+    const double u = -speed * sinTrueAnomalies[index];
+    const double v = speed * (e + cosTrueAnomalies[index]);
+    return glm::dvec3(u, -v * sinInclinations[index], v * cosInclinations[index]);
+}
+
+double OrbitalState::getOrbitGM(size_t index) const {
+    const double a = orbitRadii[index];
+    return angularSpeeds[index] * angularSpeeds[index] * a * a * a;
+}
+
+glm::dvec3 OrbitalState::computePosition(size_t index, double time) const {
+    if (orbitPeriods[index] <= 0.0f)
+        return glm::dvec3(0.0);
+
+    const double e = eccentricities[index];
+    const double twoPi = 2.0 * glm::pi<double>();
+    const double meanAnomaly = std::remainder(phases[index] + angularSpeeds[index] * time, twoPi);
+
+    // Newton iterations on E - e sin(E) = M, until convergence in double precision
+    double E = e < 0.8 ? meanAnomaly : (meanAnomaly < 0.0 ? -glm::pi<double>() : glm::pi<double>());
+    for (int iteration = 0; iteration < 50; ++iteration) {
+        const double delta = (E - e * std::sin(E) - meanAnomaly) / (1.0 - e * std::cos(E));
+        E -= delta;
+        if (std::abs(delta) < 1e-15)
+            break;
+    }
+
+    // Same orbital plane as in updateLocalPositions
+    const double planeX = orbitRadii[index] * (std::cos(E) - e);
+    const double planeZ = orbitRadii[index] * std::sqrt(1.0 - e * e) * std::sin(E);
+    const double inclination = inclinations[index];
+    return glm::dvec3(planeX, -planeZ * std::sin(inclination), planeZ * std::cos(inclination));
+}
+
+void OrbitalState::update(double time) {
+    // Every position is overwritten below, so the current arrays simply become the previous ones
+    posX.swap(prevPosX);
+    posY.swap(prevPosY);
+    posZ.swap(prevPosZ);
+    updateLocalPositions(time);
+}
+
+void OrbitalState::updateLocalPositions(double time) {
+    const size_t n = size();
+    const double *speed = angularSpeeds.data();
+    const float *phase = phases.data();
+    float *meanAnomaly = meanAnomalies.data();
+
+    // The number of whole turns is removed before going to float, whatever the time
+    const double twoPi = 2.0 * glm::pi<double>();
+    for (size_t i = 0; i < n; ++i) {
+        const double m = phase[i] + speed[i] * time;
+        meanAnomaly[i] = static_cast<float>(m - twoPi * std::floor(m / twoPi + 0.5));
+    }
+
+    solveKepler(meanAnomaly, eccentricities.data(), cosTrueAnomalies.data(), sinTrueAnomalies.data(), radiusRatios.data(), n);
+
+    const float *radius = orbitRadii.data();
+    const float *cosNu = cosTrueAnomalies.data();
+    const float *sinNu = sinTrueAnomalies.data();
+    const float *ratio = radiusRatios.data();
+    const float *sinI = sinInclinations.data();
+    const float *cosI = cosInclinations.data();
+    double *x = posX.data();
+    double *y = posY.data();
+    double *z = posZ.data();
+
+    // Independent iterations over contiguous arrays: the compiler can vectorize this loop.
+    // The positions are built in double from the float outputs of the solver.
+    for (size_t i = 0; i < n; ++i) {
+        double distance = static_cast<double>(radius[i]) * ratio[i];
+        double planeZ = distance * sinNu[i];
+        x[i] = distance * cosNu[i];
+        // Tilt the orbital plane around the X axis
+        y[i] = -planeZ * sinI[i];
+        z[i] = planeZ * cosI[i];
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef _ORBITALSTATE
+#define _ORBITALSTATE
+
+#include <vector>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+// Structure-of-arrays store of the orbital elements of every body of the system.
+// Each body is identified by its index; a body follows an elliptical orbit around its
+// parent (or sits at the origin when it has none), the parent being at one focus.
+// All the bodies are advanced together by update(), which computes their positions relative
+// to their parents; the absolute positions are obtained through the SceneHierarchy.
+class OrbitalState {
+    public:
+        static const int kNoParent = -1;
+
+        // Registers a body and returns its index. The parent must already be registered.
+        // The orbit radius is the semi-major axis of the ellipse and the phase the mean anomaly at time 0.
+        size_t addBody(int parent, float orbitRadius, float eccentricity, float orbitPeriod, float phase, float inclination);
+        void reserve(size_t count);
+        // Computes the position of every body at the given time. The positions computed by the
+        // previous call are kept, so that the rendering can interpolate between the two states.
+        // The mean anomalies are reduced in double precision, so that long runs keep their accuracy.
+        void update(double time);
+        size_t size() const { return parents.size(); }
+        int getParent(size_t index) const { return parents[index]; }
+        // The masses are only used by the gravitational simulation (see NBodySystem)
+        void setMass(size_t index, double mass) { masses[index] = mass; }
+        double getMass(size_t index) const { return masses[index]; }
+        // Velocity relative to the parent on the orbit of the latest update, for a gravitational
+        // parameter gm (G times the masses of the pair); the kinematic model itself has no notion of mass
+        glm::dvec3 getKeplerVelocity(size_t index, double gm) const;
+        // Gravitational parameter for which the orbit is Keplerian (Kepler's third law, gm = n^2 a^3
+        // with the mean motion n of the scaled period), or 0 for a body that does not orbit
+        double getOrbitGM(size_t index) const;
+        float getOrbitRadius(size_t index) const { return orbitRadii[index]; }
+        float getOrbitPeriod(size_t index) const { return orbitPeriods[index]; }
+        // Position relative to the parent at any time, computed in double precision for this body
+        // only (independently of update()). Used as the reference to build ephemerides.
+        glm::dvec3 computePosition(size_t index, double time) const;
+        // Positions relative to the parent, kept in double precision like the rest of the simulation
+        // (the Kepler solver itself works in float, relative to the orbit)
+        glm::dvec3 getPosition(size_t index) const { return glm::dvec3(posX[index], posY[index], posZ[index]); }
+        glm::dvec3 getPreviousPosition(size_t index) const { return glm::dvec3(prevPosX[index], prevPosY[index], prevPosZ[index]); }
+        // Position relative to the parent between the previous state (alpha = 0) and the latest one (alpha = 1)
+        glm::dvec3 getInterpolatedPosition(size_t index, double alpha) const { return glm::mix(getPreviousPosition(index), getPosition(index), alpha); }
+
+    private:
+        void updateLocalPositions(double time);
+
+    private:
+        // Orbital elements
+        std::vector<float> orbitRadii;
+        std::vector<float> eccentricities;
+        std::vector<float> orbitPeriods;
+        std::vector<double> angularSpeeds; // 2*pi / period, precomputed to keep divisions out of the update loop
+        std::vector<float> phases;
+        std::vector<float> inclinations;
+        std::vector<float> sinInclinations;
+        std::vector<float> cosInclinations;
+        std::vector<int> parents;
+        std::vector<double> masses;
+        // Kepler solver inputs and outputs, kept between updates to avoid reallocations
+        std::vector<float> meanAnomalies;
+        std::vector<float> cosTrueAnomalies;
+        std::vector<float> sinTrueAnomalies;
+        std::vector<float> radiusRatios;
+        // Positions, relative to the parent
+        std::vector<double> posX;
+        std::vector<double> posY;
+        std::vector<double> posZ;
+        // Positions of the previous update
+        std::vector<double> prevPosX;
+        std::vector<double> prevPosY;
+        std::vector<double> prevPosZ;
+};
+
+#endif
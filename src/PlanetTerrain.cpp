@@ -0,0 +1,403 @@
+#include "PlanetTerrain.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/ext.hpp>
+
+#include "MeshOptimizer.h"
+#include "stb_image.h"
+
+// Cube faces, with the same axes as SphereMesh::genCubeSphere: the face is on the positive or
+// negative side (odd faces) of its axis, and spanned by the two following axes
+static const glm::dvec3 kAxes[3] = { glm::dvec3(1, 0, 0), glm::dvec3(0, 1, 0), glm::dvec3(0, 0, 1) };
+
+// Skirts hang from the borders of the patches, down by this fraction of the width of the patch,
+// to hide the cracks with neighbours of another level
+static const double kSkirtDepth = 0.05;
+
+static const int kFloatsPerVertex = 8; // position, normal, texture coordinates
+
+PlanetTerrain::PlanetTerrain(ThreadPool *pool, size_t slotCount) : pendingBuilds(0) {
+    this->pool = pool;
+    this->slots.resize(slotCount);
+}
+
+PlanetTerrain::~PlanetTerrain() {
+    std::unique_lock<std::mutex> lock(builtMutex);
+    buildFinished.wait(lock, [this] { return pendingBuilds == 0; });
+}
+
+bool PlanetTerrain::loadHeightmap(ImageDecoder *decoder, const std::string &path, float heightScale) {
+    const DecodedImage image = decoder->take(path, 1); // grey levels
+    if (!image.data)
+        return false;
+    heights.resize(static_cast<size_t>(image.width) * image.height);
+    for (size_t i = 0; i < heights.size(); ++i)
+        heights[i] = image.data[i] / 255.0f;
+    stbi_image_free(image.data);
+    heightmapWidth = image.width;
+    heightmapHeight = image.height;
+    this->heightScale = heightScale;
+    return true;
+}
+
+uint64_t PlanetTerrain::makeKey(int face, int level, uint32_t x, uint32_t y) {
+    return (static_cast<uint64_t>(face) << 61) | (static_cast<uint64_t>(level) << 56) | (static_cast<uint64_t>(x) << 28) | y;
+}
+
+void PlanetTerrain::decodeKey(uint64_t key, int &face, int &level, uint32_t &x, uint32_t &y) {
+    face = static_cast<int>(key >> 61);
+    level = static_cast<int>((key >> 56) & 31);
+    x = static_cast<uint32_t>((key >> 28) & ((1u << 28) - 1));
+    y = static_cast<uint32_t>(key & ((1u << 28) - 1));
+}
+
+uint64_t PlanetTerrain::childKey(uint64_t key, int child) {
+    int face, level;
+    uint32_t x, y;
+    decodeKey(key, face, level, x, y);
+    return makeKey(face, level + 1, 2 * x + (child & 1), 2 * y + (child >> 1));
+}
+
+glm::dvec3 PlanetTerrain::direction(int face, double a, double b) const {
+    const glm::dvec3 normal = kAxes[face / 2] * (face % 2 ? -1.0 : 1.0);
+    const glm::dvec3 &tangent = kAxes[(face / 2 + 1) % 3], &bitangent = kAxes[(face / 2 + 2) % 3];
+    const double quarter = glm::pi<double>() / 4.0; // equal angles, like the cube spheres
+    return glm::normalize(normal + tangent * std::tan(quarter * a) + bitangent * std::tan(quarter * b));
+}
+
+float PlanetTerrain::sampleHeight(const glm::dvec3 &direction) const {
+    if (heights.empty())
+        return 0.0f;
+    // Same mapping as the texture coordinates of the spheres, bilinear, repeated around the equator
+    double u = std::atan2(direction.z, direction.x) / (2.0 * glm::pi<double>());
+    u -= std::floor(u);
+    const double v = std::acos(glm::clamp(direction.y, -1.0, 1.0)) / glm::pi<double>();
+    const double x = u * heightmapWidth - 0.5, y = glm::clamp(v * heightmapHeight - 0.5, 0.0, heightmapHeight - 1.0);
+    const int x0 = static_cast<int>(std::floor(x)), y0 = static_cast<int>(y);
+    const float fx = static_cast<float>(x - x0), fy = static_cast<float>(y - y0);
+    const int left = (x0 + heightmapWidth) % heightmapWidth, right = (x0 + 1) % heightmapWidth;
+    const int top = y0, bottom = std::min(y0 + 1, heightmapHeight - 1);
+    const float h0 = glm::mix(heights[top * heightmapWidth + left], heights[top * heightmapWidth + right], fx);
+    const float h1 = glm::mix(heights[bottom * heightmapWidth + left], heights[bottom * heightmapWidth + right], fx);
+    return heightScale * glm::mix(h0, h1, fy);
+}
+
+glm::vec3 PlanetTerrain::patchCenter(uint64_t key, float &width) const {
+    int face, level;
+    uint32_t x, y;
+    decodeKey(key, face, level, x, y);
+    const double cells = static_cast<double>(1u << level);
+    width = static_cast<float>(glm::pi<double>() / 2.0 / cells); // angle spanned by the patch, at the center of the face
+    return glm::vec3(direction(face, 2.0 * (x + 0.5) / cells - 1.0, 2.0 * (y + 0.5) / cells - 1.0));
+}
+
+void PlanetTerrain::genIndices() {
+    // Vertex (i, j) of the grid is at j * N + i, followed by the skirts under the four borders
+    // (j = 0, j = N - 1, i = 0, i = N - 1). The triangles are oriented on a flat patch, with the
+    // grid facing up (+z) and each skirt facing away from the patch.
+    const int n = kGridSize;
+    std::vector<glm::vec3> flat(n * n + 4 * n);
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i)
+            flat[j * n + i] = glm::vec3(i, j, 0);
+    }
+    const glm::vec3 skirtFacings[4] = { glm::vec3(0, -1, 0), glm::vec3(0, 1, 0), glm::vec3(-1, 0, 0), glm::vec3(1, 0, 0) };
+    auto borderVertex = [n](int edge, int k) { return edge < 2 ? (edge == 0 ? 0 : n - 1) * n + k : k * n + (edge == 2 ? 0 : n - 1); };
+    for (int edge = 0; edge < 4; ++edge) {
+        for (int k = 0; k < n; ++k)
+            flat[n * n + edge * n + k] = flat[borderVertex(edge, k)] - glm::vec3(0, 0, 1);
+    }
+
+    indices.clear();
+    auto addFacing = [&](unsigned int a, unsigned int b, unsigned int c, const glm::vec3 &facing) {
+        if (glm::dot(glm::cross(flat[b] - flat[a], flat[c] - flat[a]), facing) < 0.0f)
+            std::swap(b, c);
+        indices.insert(indices.end(), { a, b, c });
+    };
+    for (int j = 0; j + 1 < n; ++j) {
+        for (int i = 0; i + 1 < n; ++i) {
+            const unsigned int p1 = j * n + i, p2 = p1 + 1, p3 = p1 + n, p4 = p3 + 1;
+            addFacing(p1, p2, p3, glm::vec3(0, 0, 1));
+            addFacing(p2, p4, p3, glm::vec3(0, 0, 1));
+        }
+    }
+    for (int edge = 0; edge < 4; ++edge) {
+        for (int k = 0; k + 1 < n; ++k) {
+            const unsigned int e0 = borderVertex(edge, k), e1 = borderVertex(edge, k + 1);
+            const unsigned int s0 = n * n + edge * n + k, s1 = s0 + 1;
+            addFacing(e0, e1, s0, skirtFacings[edge]);
+            addFacing(e1, s1, s0, skirtFacings[edge]);
+        }
+    }
+
+    // Ordered for the vertex cache, and the vertices in the order of their first use (buildPatch
+    // writes vertex (i, j) at remap[j * N + i]). The patches are too flat to reorder against overdraw.
+    optimizeVertexCache(indices, flat.size());
+    optimizeVertexFetch(indices, flat.size(), remap);
+
+    // The same triangles wound the other way, for the faces on the negative side of their axis
+    indexCount = indices.size();
+    for (size_t t = 0; t < indexCount; t += 3)
+        indices.insert(indices.end(), { indices[t], indices[t + 2], indices[t + 1] });
+}
+
+void PlanetTerrain::init() {
+    genIndices();
+    glGenBuffers(1, &ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+
+    const size_t vertexCount = kGridSize * kGridSize + 4 * kGridSize;
+    const GLsizei stride = kFloatsPerVertex * sizeof(GLfloat);
+    freeSlots.clear();
+    for (size_t s = 0; s < slots.size(); ++s) {
+        Slot &slot = slots[s];
+        glGenVertexArrays(1, &slot.vao);
+        glBindVertexArray(slot.vao);
+        glGenBuffers(1, &slot.vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, slot.vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertexCount * stride, nullptr, GL_DYNAMIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*) (3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*) (6 * sizeof(GLfloat)));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo); // part of the state of the vertex array
+        freeSlots.push_back(static_cast<int>(slots.size() - 1 - s));
+    }
+    glBindVertexArray(0);
+}
+
+void PlanetTerrain::buildPatch(uint64_t key, BuiltPatch &patch) const {
+    int face, level;
+    uint32_t x, y;
+    decodeKey(key, face, level, x, y);
+    const int n = kGridSize;
+    const double cells = static_cast<double>(1u << level);
+    const double a0 = 2.0 * x / cells - 1.0, b0 = 2.0 * y / cells - 1.0;
+    const double step = 2.0 / cells / (n - 1);
+
+    // Displaced positions over the grid and one more vertex around it, for the normals
+    const int m = n + 2;
+    std::vector<glm::dvec3> directions(m * m), points(m * m);
+    std::vector<float> displacements(m * m);
+    for (int j = 0; j < m; ++j) {
+        for (int i = 0; i < m; ++i) {
+            const int k = j * m + i;
+            directions[k] = direction(face, a0 + (i - 1) * step, b0 + (j - 1) * step);
+            displacements[k] = sampleHeight(directions[k]);
+            points[k] = directions[k] * (1.0 + displacements[k]);
+        }
+    }
+
+    // The vertices are relative to the center, to keep their precision in float on small patches.
+    // The texture coordinate u is kept on the same side of the seam as the center of the patch.
+    const glm::dvec3 center = direction(face, a0 + 1.0 / cells, b0 + 1.0 / cells);
+    double centerU = std::atan2(center.z, center.x) / (2.0 * glm::pi<double>());
+    const double skirtDepth = kSkirtDepth * glm::pi<double>() / 2.0 / cells;
+    patch.key = key;
+    patch.center = glm::vec3(center);
+    patch.vertices.resize((n * n + 4 * n) * kFloatsPerVertex);
+    auto writeVertex = [&](int vertex, int i, int j, double depth) {
+        const int k = (j + 1) * m + (i + 1);
+        const glm::dvec3 &dir = directions[k];
+        const glm::dvec3 position = dir * (1.0 + displacements[k] - depth) - center;
+        glm::dvec3 normal = glm::normalize(glm::cross(points[k + 1] - points[k - 1], points[k + m] - points[k - m]));
+        if (glm::dot(normal, dir) < 0.0)
+            normal = -normal;
+        double u = std::atan2(dir.z, dir.x) / (2.0 * glm::pi<double>());
+        u -= std::round(u - centerU);
+        const double v = std::acos(glm::clamp(dir.y, -1.0, 1.0)) / glm::pi<double>();
+        float *out = &patch.vertices[remap[vertex] * kFloatsPerVertex];
+        const double values[kFloatsPerVertex] = { position.x, position.y, position.z, normal.x, normal.y, normal.z, u, v };
+        for (int c = 0; c < kFloatsPerVertex; ++c)
+            out[c] = static_cast<float>(values[c]);
+    };
+    for (int j = 0; j < n; ++j) {
+        for (int i = 0; i < n; ++i)
+            writeVertex(j * n + i, i, j, 0.0);
+    }
+    for (int k = 0; k < n; ++k) {
+        writeVertex(n * n + k, k, 0, skirtDepth);
+        writeVertex(n * n + n + k, k, n - 1, skirtDepth);
+        writeVertex(n * n + 2 * n + k, 0, k, skirtDepth);
+        writeVertex(n * n + 3 * n + k, n - 1, k, skirtDepth);
+    }
+}
+
+void PlanetTerrain::requestBuild(uint64_t key, Node &node) {
+    if (node.building || pendingBuilds >= kMaxPendingBuilds)
+        return;
+    node.building = true;
+    ++pendingBuilds;
+    pool->submit([this, key]() {
+        BuiltPatch patch;
+        buildPatch(key, patch);
+        std::lock_guard<std::mutex> lock(builtMutex);
+        builtPatches.push_back(std::move(patch));
+        --pendingBuilds;
+        buildFinished.notify_all();
+    });
+}
+
+int PlanetTerrain::findSlot(uint64_t key) const {
+    auto found = residentPatches.find(key);
+    return found != residentPatches.end() ? found->second : -1;
+}
+
+int PlanetTerrain::acquireSlot() {
+    if (!freeSlots.empty()) {
+        const int slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+    // Reuse the slot left out of the tree for the longest time
+    int oldest = -1;
+    for (size_t s = 0; s < slots.size(); ++s) {
+        if (slots[s].used && slots[s].lastUsedUpdate + 1 < updateCount && (oldest < 0 || slots[s].lastUsedUpdate < slots[oldest].lastUsedUpdate))
+            oldest = static_cast<int>(s);
+    }
+    if (oldest >= 0)
+        residentPatches.erase(slots[oldest].key);
+    return oldest;
+}
+
+void PlanetTerrain::uploadBuiltPatches() {
+    std::vector<BuiltPatch> built;
+    {
+        std::lock_guard<std::mutex> lock(builtMutex);
+        const size_t count = std::min<size_t>(builtPatches.size(), static_cast<size_t>(kMaxUploadsPerUpdate));
+        built.assign(std::make_move_iterator(builtPatches.begin()), std::make_move_iterator(builtPatches.begin() + count));
+        builtPatches.erase(builtPatches.begin(), builtPatches.begin() + count);
+    }
+
+    for (BuiltPatch &patch : built) {
+        // The patch may have been merged away since its build was requested
+        auto found = nodes.find(patch.key);
+        if (found == nodes.end())
+            continue;
+        found->second.building = false;
+        if (findSlot(patch.key) >= 0)
+            continue;
+        const int slot = acquireSlot();
+        if (slot < 0)
+            continue; // every slot is in the tree, it will be requested again
+        residentPatches[patch.key] = slot;
+        slots[slot].key = patch.key;
+        slots[slot].center = patch.center;
+        slots[slot].flipped = (patch.key >> 61) % 2 == 1;
+        slots[slot].used = true;
+        slots[slot].lastUsedUpdate = updateCount;
+        glBindBuffer(GL_ARRAY_BUFFER, slots[slot].vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, patch.vertices.size() * sizeof(float), patch.vertices.data());
+    }
+}
+
+void PlanetTerrain::eraseChildren(uint64_t key) {
+    // Their slots stay resident until they are reused
+    for (int child = 0; child < 4; ++child) {
+        const uint64_t ck = childKey(key, child);
+        auto found = nodes.find(ck);
+        if (found == nodes.end())
+            continue;
+        if (found->second.split)
+            eraseChildren(ck);
+        nodes.erase(found);
+    }
+}
+
+bool PlanetTerrain::visit(uint64_t key, const glm::vec3 &cameraPosition) {
+    float width;
+    const glm::vec3 center = patchCenter(key, width);
+    const float distance = glm::length(cameraPosition - center);
+    const int level = static_cast<int>((key >> 56) & 31);
+
+    // The references to the elements of an unordered_map survive the insertions of the children
+    // and their rehashes, and the children only ever erase their own descendants
+    Node &node = nodes[key];
+    const int slot = findSlot(key);
+    if (slot >= 0)
+        slots[slot].lastUsedUpdate = updateCount;
+
+    // Beyond the horizon, with the half diagonal of the patch as margin: nothing to draw
+    const float angle = std::acos(glm::clamp(glm::dot(center, cameraPosition) / glm::length(cameraPosition), -1.0f, 1.0f));
+    if (angle - 0.75f * width > horizonAngle) {
+        if (node.split) {
+            eraseChildren(key);
+            node.split = false;
+        }
+        return true;
+    }
+
+    if (node.split && distance > kMergeDistance * width) {
+        // Merge once the patch itself can be drawn in place of its children
+        if (slot >= 0) {
+            eraseChildren(key);
+            node.split = false;
+        } else {
+            requestBuild(key, node);
+        }
+    } else if (!node.split && slot >= 0 && level < kMaxLevel && distance < kSplitDistance * width) {
+        // The children reuse their slots if they are still resident
+        size_t missing = 0;
+        for (int child = 0; child < 4; ++child)
+            missing += findSlot(childKey(key, child)) < 0 ? 1 : 0;
+        if (missing <= availableSlots) {
+            node.split = true;
+            availableSlots -= missing;
+        }
+    }
+
+    if (node.split) {
+        // The children are all visited, to request their builds, but only drawn if they all can be
+        const size_t firstDrawn = drawnSlots.size();
+        bool covered = true;
+        for (int child = 0; child < 4; ++child)
+            covered = visit(childKey(key, child), cameraPosition) && covered;
+        if (covered)
+            return true;
+        drawnSlots.resize(firstDrawn);
+    }
+
+    if (slot >= 0) {
+        drawnSlots.push_back(slot);
+        return true;
+    }
+    requestBuild(key, node);
+    return false;
+}
+
+void PlanetTerrain::update(const glm::vec3 &cameraPosition) {
+    ++updateCount;
+    uploadBuiltPatches();
+
+    availableSlots = freeSlots.size();
+    for (const Slot &slot : slots) {
+        if (slot.used && slot.lastUsedUpdate + 1 < updateCount)
+            ++availableSlots;
+    }
+    availableSlots -= std::min(availableSlots, static_cast<size_t>(pendingBuilds));
+
+    // The highest mountains may still show beyond the horizon of the sphere
+    const float distance = glm::length(cameraPosition);
+    horizonAngle = distance > 1.0f ? std::acos(1.0f / distance) + std::acos(1.0f / (1.0f + heightScale)) : glm::pi<float>();
+
+    drawnSlots.clear();
+    drawnSlotsCoverAll = true;
+    for (int face = 0; face < 6; ++face)
+        drawnSlotsCoverAll = visit(makeKey(face, 0, 0, 0), cameraPosition) && drawnSlotsCoverAll;
+}
+
+void PlanetTerrain::render(GLuint program, const glm::mat4 &model) const {
+    const GLint modelLocation = glGetUniformLocation(program, "modelMat");
+    for (int s : drawnSlots) {
+        const Slot &slot = slots[s];
+        const glm::mat4 patchModel = glm::translate(model, slot.center);
+        glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(patchModel));
+        glBindVertexArray(slot.vao);
+        glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (void*) ((slot.flipped ? indexCount : 0) * sizeof(unsigned int)));
+    }
+}
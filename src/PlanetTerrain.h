@@ -0,0 +1,126 @@
+#ifndef _PLANETTERRAIN
+#define _PLANETTERRAIN
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "ImageDecoder.h"
+#include "ThreadPool.h"
+
+// Terrain of a planet seen from close, for the radius 1 like SphereMesh.
+// The six faces of a cube projected onto the sphere (see SphereType::Cube) are the roots of
+// quadtrees of square patches, split where the camera comes close and merged back as it goes
+// away. Each patch is a grid of vertices displaced along the vertical by a heightmap, built on the
+// threads of the pool, then uploaded to one of a fixed number of GPU slots. A patch is only split
+// once it is built itself and when slots are available for its children, and it is drawn until
+// they are all built, which hides the builds in progress. The patches beyond the horizon are
+// neither split nor drawn. The slots of merged patches are kept
+// for when they are needed again, until the ones used the longest time ago are reused.
+class PlanetTerrain {
+    public:
+        PlanetTerrain(ThreadPool *pool, size_t slotCount);
+        ~PlanetTerrain(); // waits for the builds in progress
+
+        // Grey levels of the image (0 to 1, equirectangular like the textures), scaled by heightScale
+        // relative to the radius, taken from the decoder with 1 channel. Must be called before the first update.
+        bool loadHeightmap(ImageDecoder *decoder, const std::string &path, float heightScale);
+        void init(); // creates the GPU slots; requires an OpenGL context
+
+        // Splits and merges the patches for a camera at the given position (in the frame of the unit
+        // sphere), starts building the missing ones and uploads the ones built since the last update
+        void update(const glm::vec3 &cameraPosition);
+        // True once the six roots are built, until then the object should be drawn as a sphere
+        bool isReady() const { return drawnSlots.size() > 0 && drawnSlotsCoverAll; }
+        // Draws the patches selected by the last update, with the given model matrix of the unit sphere
+        void render(GLuint program, const glm::mat4 &model) const;
+
+        size_t getDrawnPatchCount() const { return drawnSlots.size(); }
+        size_t getDrawnTriangleCount() const { return drawnSlots.size() * (indexCount / 3); }
+        size_t getNodeCount() const { return nodes.size(); }
+        size_t getPendingBuildCount() const { return pendingBuilds; }
+        size_t getSlotCount() const { return slots.size(); }
+
+        const static int kMaxLevel = 14;
+        const static int kGridSize = 33; // vertices along each side of a patch
+        // A patch is split when the camera is closer than kSplitDistance times its width, and merged
+        // back beyond kMergeDistance times its width
+        constexpr static float kSplitDistance = 2.0f;
+        constexpr static float kMergeDistance = 2.5f;
+        const static size_t kMaxPendingBuilds = 32;
+        const static size_t kMaxUploadsPerUpdate = 16;
+
+    private:
+        struct Node {
+            bool split = false;
+            bool building = false;
+        };
+
+        struct Slot {
+            GLuint vao = 0;
+            GLuint vbo = 0;
+            uint64_t key = 0; // patch stored in the slot
+            glm::vec3 center; // the vertices are relative to it, for the precision
+            bool flipped = false; // faces on the negative side of their axis are wound the other way
+            bool used = false;
+            unsigned long lastUsedUpdate = 0; // last update where the patch was in the tree
+        };
+
+        struct BuiltPatch {
+            uint64_t key;
+            glm::vec3 center;
+            std::vector<float> vertices;
+        };
+
+        static uint64_t makeKey(int face, int level, uint32_t x, uint32_t y);
+        static uint64_t childKey(uint64_t key, int child);
+        static void decodeKey(uint64_t key, int &face, int &level, uint32_t &x, uint32_t &y);
+        glm::dvec3 direction(int face, double a, double b) const; // point of the face at the cube coordinates (a, b) in [-1, 1]
+        float sampleHeight(const glm::dvec3 &direction) const;
+        glm::vec3 patchCenter(uint64_t key, float &width) const;
+
+        bool visit(uint64_t key, const glm::vec3 &cameraPosition);
+        void eraseChildren(uint64_t key);
+        void requestBuild(uint64_t key, Node &node);
+        int findSlot(uint64_t key) const; // -1 if the patch is not in a slot
+        void buildPatch(uint64_t key, BuiltPatch &patch) const;
+        void uploadBuiltPatches();
+        int acquireSlot();
+        void genIndices();
+
+    private:
+        ThreadPool *pool;
+        std::vector<float> heights;
+        int heightmapWidth = 0, heightmapHeight = 0;
+        float heightScale = 0.0f;
+
+        std::unordered_map<uint64_t, Node> nodes;
+        std::vector<Slot> slots;
+        std::vector<int> freeSlots;
+        std::unordered_map<uint64_t, int> residentPatches; // slot of each uploaded patch, in the tree or not
+        std::vector<int> drawnSlots;
+        bool drawnSlotsCoverAll = false;
+        float horizonAngle = 0.0f; // angle from the point under the camera beyond which the terrain is hidden
+        size_t availableSlots = 0; // slots free or out of the tree, and not awaited by a build: the splits can use them
+        unsigned long updateCount = 0;
+
+        std::vector<unsigned int> indices; // shared by all the patches, then again with the other winding
+        std::vector<unsigned int> remap; // position in the vertex buffer of each vertex of the grid and of the skirts
+        GLuint ibo = 0;
+        size_t indexCount = 0; // for one winding
+
+        std::mutex builtMutex;
+        std::condition_variable buildFinished;
+        std::vector<BuiltPatch> builtPatches;
+        std::atomic<size_t> pendingBuilds;
+};
+
+#endif
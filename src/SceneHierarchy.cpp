@@ -0,0 +1,107 @@
+#include "SceneHierarchy.h"
+
+#include <algorithm>
+#include <cassert>
+
+size_t SceneHierarchy::addNode(int parent) {
+    assert(parent < static_cast<int>(size()) || parent == kNoParent);
+
+    // Appending keeps the order valid since the parent already exists
+    size_t node = nodeParents.size();
+    nodeParents.push_back(parent);
+    nodeSlots.push_back(parentSlots.size());
+    parentSlots.push_back(parent == kNoParent ? kNoParent : static_cast<int>(nodeSlots[parent]));
+    localTransforms.push_back(glm::dmat4(1.0));
+    worldTransforms.push_back(glm::dmat4(1.0));
+    dirty.push_back(1);
+    return node;
+}
+
+void SceneHierarchy::setParent(size_t node, int parent) {
+    assert(parent < static_cast<int>(size()) && parent != static_cast<int>(node));
+    nodeParents[node] = parent;
+    orderDirty = true;
+}
+
+void SceneHierarchy::setLocalTransform(size_t node, const glm::dmat4 &transform) {
+    const size_t slot = nodeSlots[node];
+    if (localTransforms[slot] != transform) {
+        localTransforms[slot] = transform;
+        dirty[slot] = 1;
+    }
+}
+
+void SceneHierarchy::sortNodes() {
+    const size_t n = size();
+
+    // Children lists in compressed form: the children of node i are children[first[i]..first[i+1]]
+    std::vector<size_t> first(n + 1, 0);
+    for (size_t i = 0; i < n; ++i)
+        if (nodeParents[i] != kNoParent)
+            ++first[nodeParents[i] + 1];
+    for (size_t i = 0; i < n; ++i)
+        first[i + 1] += first[i];
+    std::vector<size_t> children(first[n]);
+    std::vector<size_t> fill(first.begin(), first.end() - 1);
+    for (size_t i = 0; i < n; ++i)
+        if (nodeParents[i] != kNoParent)
+            children[fill[nodeParents[i]]++] = i;
+
+    // Depth-first traversal from the roots, so that every subtree ends up contiguous
+    std::vector<size_t> order;
+    order.reserve(n);
+    std::vector<size_t> stack;
+    for (size_t root = 0; root < n; ++root) {
+        if (nodeParents[root] != kNoParent)
+            continue;
+        stack.push_back(root);
+        while (!stack.empty()) {
+            size_t node = stack.back();
+            stack.pop_back();
+            order.push_back(node);
+            for (size_t c = first[node + 1]; c > first[node]; --c)
+                stack.push_back(children[c - 1]);
+        }
+    }
+    assert(order.size() == n); // otherwise the parent links contain a cycle
+
+    std::vector<glm::dmat4> sortedLocals(n);
+    for (size_t slot = 0; slot < n; ++slot)
+        sortedLocals[slot] = localTransforms[nodeSlots[order[slot]]];
+    for (size_t slot = 0; slot < n; ++slot)
+        nodeSlots[order[slot]] = slot;
+    for (size_t slot = 0; slot < n; ++slot) {
+        const int parent = nodeParents[order[slot]];
+        parentSlots[slot] = parent == kNoParent ? kNoParent : static_cast<int>(nodeSlots[parent]);
+    }
+    localTransforms.swap(sortedLocals);
+    std::fill(dirty.begin(), dirty.end(), 1); // the parents changed, everything has to be recomputed
+    orderDirty = false;
+}
+
+void SceneHierarchy::propagate() {
+    if (orderDirty)
+        sortNodes();
+
+    const size_t n = size();
+    const int *parent = parentSlots.data();
+    const glm::dmat4 *local = localTransforms.data();
+    glm::dmat4 *world = worldTransforms.data();
+    uint8_t *changed = dirty.data();
+    size_t updateCount = 0;
+
+    // Parents precede their children: when a node is reached, its parent's world transform and
+    // dirty flag are final. A clean node under a clean parent keeps its world transform.
+    for (size_t i = 0; i < n; ++i) {
+        const int p = parent[i];
+        if (p != kNoParent)
+            changed[i] |= changed[p];
+        if (!changed[i])
+            continue;
+        world[i] = p == kNoParent ? local[i] : world[p] * local[i];
+        ++updateCount;
+    }
+
+    std::fill(dirty.begin(), dirty.end(), 0);
+    lastUpdateCount = updateCount;
+}
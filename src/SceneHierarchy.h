@@ -0,0 +1,45 @@
+#ifndef _SCENEHIERARCHY
+#define _SCENEHIERARCHY
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+// Flattened transform hierarchy. Nodes can be added and re-parented in any order: they are
+// stored sorted so that parents always precede their children (depth-first order), and the
+// world transforms are propagated in a single linear sweep over contiguous arrays.
+// Only the nodes whose local transform changed since the previous propagation, or one of
+// whose ancestors changed, are recomputed. The transforms are in double precision, so that
+// far away bodies keep their accuracy; the rendering subtracts the camera position before
+// converting them to float.
+class SceneHierarchy {
+    public:
+        static const int kNoParent = -1;
+
+        size_t addNode(int parent); // returns the identifier of the node
+        void setParent(size_t node, int parent);
+        void setLocalTransform(size_t node, const glm::dmat4 &transform); // marks the node dirty if the transform changed
+        void propagate(); // updates the world transforms of the dirty nodes and of their descendants
+        size_t size() const { return nodeParents.size(); }
+        const glm::dmat4 &getWorldTransform(size_t node) const { return worldTransforms[nodeSlots[node]]; }
+        size_t getLastUpdateCount() const { return lastUpdateCount; } // number of world transforms recomputed by the last propagation
+
+    private:
+        void sortNodes();
+
+    private:
+        // Indexed by node identifier
+        std::vector<int> nodeParents;
+        std::vector<size_t> nodeSlots; // position of each node in the sorted arrays
+        // Indexed by slot, in depth-first order
+        std::vector<int> parentSlots;
+        std::vector<glm::dmat4> localTransforms;
+        std::vector<glm::dmat4> worldTransforms;
+        std::vector<uint8_t> dirty;
+        bool orderDirty = false;
+        size_t lastUpdateCount = 0;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef _SIMULATIONCLOCK_H
+#define _SIMULATIONCLOCK_H
+
+#include <algorithm>
+
+// Fixed-timestep clock decoupling the simulation from the rendering.
+// The real time elapsed between two frames is accumulated (scaled by the time scale), and the
+// simulation is advanced by as many fixed steps as fit in the accumulator. What is left over
+// gives the interpolation factor between the last two simulated states.
+class SimulationClock {
+public:
+    SimulationClock(double timeStep, double timeScale) : m_timeStep(timeStep), m_timeScale(timeScale) {}
+
+    inline double getTimeStep() const { return m_timeStep; }
+
+    inline double getTimeScale() const { return m_timeScale; }
+
+    inline void setTimeScale(const double s) { m_timeScale = s; }
+
+    // Time of the latest simulated state
+    inline double getTime() const { return m_time; }
+
+    inline unsigned long getStepCount() const { return m_stepCount; }
+
+    // Adds the real time elapsed since the previous frame. The accumulator is capped so that a
+    // slow frame does not trigger more and more steps (the simulation slows down instead).
+    void addRealTime(double seconds) {
+        m_accumulator = std::min(m_accumulator + seconds * m_timeScale, m_timeStep * kMaxStepsPerFrame);
+    }
+
+    // Returns true, and moves the time forward, while a whole step remains in the accumulator
+    bool consumeStep() {
+        if (m_accumulator < m_timeStep)
+            return false;
+        m_accumulator -= m_timeStep;
+        m_time += m_timeStep;
+        ++m_stepCount;
+        return true;
+    }
+
+    // Advances by one step regardless of the real time, for headless runs
+    void step() {
+        m_time += m_timeStep;
+        ++m_stepCount;
+    }
+
+    // Jumps to the given time, e.g. to scrub through the timeline; the pending real time is dropped
+    void seek(double time) {
+        m_time = time;
+        m_accumulator = 0.0;
+    }
+
+    // Interpolation factor in [0, 1] between the previous state and the latest one
+    inline float getAlpha() const { return static_cast<float>(m_accumulator / m_timeStep); }
+
+    // Time matching the interpolated state, i.e. the time to display
+    inline double getInterpolatedTime() const { return m_time - m_timeStep + m_accumulator; }
+
+private:
+    static const int kMaxStepsPerFrame = 100;
+
+    double m_timeStep; // Simulated seconds per step
+    double m_timeScale; // Simulated seconds per real second
+    double m_time = 0.0;
+    double m_accumulator = 0.0;
+    unsigned long m_stepCount = 0;
+};
+
+#endif //_SIMULATIONCLOCK_H
@@ -8,31 +8,78 @@
 Skybox::Skybox() {
     this->g_skyboxVbo = 0;
     this->g_skyboxVao = 0;
+    skyboxFaces =
+            {
+                    "media/skybox/skybox_right.png",
+                    "media/skybox/skybox_left.png",
+                    "media/skybox/skybox_top.png",
+                    "media/skybox/skybox_bottom.png",
+                    "media/skybox/skybox_front.png",
+                    "media/skybox/skybox_back.png",
+            };
+}
+
+void Skybox::prefetchImages(ImageDecoder *decoder) const {
+    if (isBaked(skyboxFaces))
+        return;
+    for (const std::string &face : skyboxFaces)
+        decoder->request(face, 3);
+}
+
+bool Skybox::isBaked(const std::vector<std::string> &faces, bool checkUpload) {
+    TextureFile file;
+    size_t levelCount = 0;
+    uint32_t internalFormat = 0;
+    for (const std::string &face : faces) {
+        if (!file.open(TextureFile::getBakedPath(face)) || file.getFormat().channels != 3 || (checkUpload && !file.isUploadable()))
+            return false;
+        if (levelCount != 0 && (file.getLevelCount() != levelCount || file.getFormat().internalFormat != internalFormat))
+            return false;
+        levelCount = file.getLevelCount();
+        internalFormat = file.getFormat().internalFormat;
+    }
+    return true;
 }
 
-GLuint Skybox::loadCubemap(std::vector<std::string> faces) {
+GLuint Skybox::loadCubemap(const std::vector<std::string> &faces, ImageDecoder *decoder, ThreadPool *pool) {
     GLuint textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-    int width, height, nrChannels;
-
-    for (unsigned int i = 0; i < faces.size(); i++) {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-
-        if (data) {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-                         0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data
-            );
-            stbi_image_free(data);
+    // The faces are uploaded from their baked files, with their mip chains, or else from their images
+    // with mip chains built here
+    const bool baked = isBaked(faces, true);
+    size_t levelCount = 1;
+    if (baked) {
+        TextureFile file;
+        for (unsigned int i = 0; i < faces.size(); i++) {
+            file.open(TextureFile::getBakedPath(faces[i]));
+            file.upload(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+        }
+        levelCount = file.getLevelCount();
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    std::vector<MipLevel> levels;
+    for (unsigned int i = 0; !baked && i < faces.size(); i++) {
+        // Decoded by the workers since prefetchImages, as RGB whatever the file holds
+        const DecodedImage image = decoder->take(faces[i], 3);
+
+        if (image.data) {
+            buildMipChain(image.data, image.width, image.height, 3, levels, pool);
+            stbi_image_free(image.data);
+            for (size_t l = 0; l < levels.size(); ++l) {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
+                             static_cast<GLint>(l), GL_RGB, levels[l].width, levels[l].height, 0, GL_RGB, GL_UNSIGNED_BYTE, levels[l].pixels.data()
+                );
+            }
+            levelCount = levels.size();
         }
         else {
             std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
         }
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    TextureFile::setMipmapSampling(GL_TEXTURE_CUBE_MAP, levelCount);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
@@ -40,7 +87,7 @@ GLuint Skybox::loadCubemap(std::vector<std::string> faces) {
     return textureID;
 }
 
-void Skybox::init() {
+void Skybox::init(ImageDecoder *decoder, ThreadPool *pool) {
 
     float skyboxVertices[] = {
             // positions
@@ -95,17 +142,7 @@ void Skybox::init() {
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
-    skyboxFaces =
-            {
-                    "media/skybox/skybox_right.png",
-                    "media/skybox/skybox_left.png",
-                    "media/skybox/skybox_top.png",
-                    "media/skybox/skybox_bottom.png",
-                    "media/skybox/skybox_front.png",
-                    "media/skybox/skybox_back.png",
-            };
-
-    cubemapTexture = loadCubemap(skyboxFaces);
+    cubemapTexture = loadCubemap(skyboxFaces, decoder, pool);
 }
 
 
@@ -13,6 +13,9 @@
 #include "stb_image.h"
 
 #include "Camera.h"
+#include "ImageDecoder.h"
+#include "MipChain.h"
+#include "TextureFile.h"
 
 #include <cstdlib>
 #include <iostream>
@@ -26,11 +29,16 @@
 class Skybox {
     public:
         Skybox();
-        void init();
+        void prefetchImages(ImageDecoder *decoder) const; // starts decoding the faces unless baked, before the OpenGL context exists
+        void init(ImageDecoder *decoder, ThreadPool *pool); // the pool builds the mip chains of the faces not baked
+        const std::vector<std::string> &getFaces() const { return skyboxFaces; }
         void render(GLuint program, Camera camera) const;
 
     private:
-        GLuint loadCubemap(std::vector<std::string> faces);
+        GLuint loadCubemap(const std::vector<std::string> &faces, ImageDecoder *decoder, ThreadPool *pool);
+        // All have a baked file with the same format and mip chain, and one the driver can upload if checked
+        // (which requires the OpenGL context)
+        static bool isBaked(const std::vector<std::string> &faces, bool checkUpload = false);
 
     private:
         std::vector<std::string> skyboxFaces;
@@ -0,0 +1,167 @@
+#include "SnapshotRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+SnapshotRing::SnapshotRing(size_t capacity, int keyframeInterval) {
+    this->capacity = std::max<size_t>(capacity, 1);
+    this->keyframeInterval = std::max(keyframeInterval, 1);
+    this->sinceKeyframe = this->keyframeInterval; // the first snapshot is a keyframe
+}
+
+bool SnapshotRing::enableSpill(const std::string &path) {
+    spillFile.close();
+    spillFile.open(path.c_str(), std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+    spilled.clear();
+    spillEnd = 0;
+    return spillFile.is_open();
+}
+
+void SnapshotRing::clear() {
+    entries.clear();
+    spilled.clear();
+    spillEnd = 0;
+    lastState.clear();
+    sinceKeyframe = keyframeInterval;
+    rawBytes = 0;
+    storedBytes = 0;
+}
+
+// Each value is stored as the XOR with its previous value, without its leading zero bytes: the
+// sign, the exponent and the first bits of the mantissa of a slowly moving body rarely change.
+// The numbers of stored bytes come first, as 4-bit counts, followed by the bytes themselves.
+void SnapshotRing::encodeDelta(const std::vector<double> &previous, const std::vector<double> &state, std::vector<uint8_t> &out) {
+    const size_t n = state.size();
+    out.assign((n + 1) / 2, 0);
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t a, b;
+        std::memcpy(&a, &previous[i], sizeof(a));
+        std::memcpy(&b, &state[i], sizeof(b));
+        uint64_t x = a ^ b;
+        uint8_t count = 0;
+        while (count < 8 && x >> (8 * count))
+            ++count;
+        out[i / 2] |= count << (4 * (i % 2));
+        for (uint8_t k = 0; k < count; ++k)
+            out.push_back(static_cast<uint8_t>(x >> (8 * k)));
+    }
+}
+
+void SnapshotRing::applyDelta(const std::vector<uint8_t> &data, std::vector<double> &state) {
+    const size_t n = state.size();
+    size_t position = (n + 1) / 2;
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t count = (data[i / 2] >> (4 * (i % 2))) & 0xF;
+        uint64_t x = 0;
+        for (uint8_t k = 0; k < count; ++k)
+            x |= static_cast<uint64_t>(data[position++]) << (8 * k);
+        uint64_t bits;
+        std::memcpy(&bits, &state[i], sizeof(bits));
+        bits ^= x;
+        std::memcpy(&state[i], &bits, sizeof(bits));
+    }
+}
+
+void SnapshotRing::record(double time, const NBodySystem &system) {
+    system.getState(scratch);
+
+    Entry entry;
+    entry.time = time;
+    entry.keyframe = sinceKeyframe >= keyframeInterval || lastState.size() != scratch.size();
+    if (entry.keyframe) {
+        entry.data.resize(scratch.size() * sizeof(double));
+        std::memcpy(entry.data.data(), scratch.data(), entry.data.size());
+        sinceKeyframe = 1;
+    } else {
+        encodeDelta(lastState, scratch, entry.data);
+        ++sinceKeyframe;
+    }
+    lastState.swap(scratch);
+    rawBytes += lastState.size() * sizeof(double);
+    storedBytes += entry.data.size();
+
+    // Whole groups are evicted, so the ring can exceed its capacity by less than a group
+    while (entry.keyframe && !entries.empty() && entries.size() >= capacity)
+        evictGroup();
+    entries.push_back(std::move(entry));
+}
+
+void SnapshotRing::evictGroup() {
+    do {
+        Entry &entry = entries.front();
+        if (spillFile.is_open()) {
+            spillFile.seekp(static_cast<std::streamoff>(spillEnd));
+            spillFile.write(reinterpret_cast<const char *>(entry.data.data()), entry.data.size());
+            SpilledEntry record = { entry.time, entry.keyframe, spillEnd, entry.data.size() };
+            spilled.push_back(record);
+            spillEnd += entry.data.size();
+        }
+        entries.pop_front();
+    } while (!entries.empty() && !entries.front().keyframe);
+    spillFile.flush();
+}
+
+bool SnapshotRing::readSpilled(size_t index, Entry &entry) {
+    const SpilledEntry &record = spilled[index];
+    entry.time = record.time;
+    entry.keyframe = record.keyframe;
+    entry.data.resize(static_cast<size_t>(record.size));
+    spillFile.seekg(static_cast<std::streamoff>(record.offset));
+    spillFile.read(reinterpret_cast<char *>(entry.data.data()), entry.data.size());
+    return static_cast<bool>(spillFile);
+}
+
+bool SnapshotRing::restore(double time, NBodySystem &system, double &snapshotTime) {
+    // Latest snapshot at or before the time, in memory first. A group (a keyframe and its deltas)
+    // is either entirely in memory or entirely spilled, so the keyframe is on the same side.
+    std::vector<double> state;
+    const bool inMemory = !entries.empty() && entries.front().time <= time;
+    if (inMemory) {
+        size_t last = entries.size() - 1;
+        while (entries[last].time > time)
+            --last;
+        size_t first = last;
+        while (!entries[first].keyframe)
+            --first;
+        state.resize(entries[first].data.size() / sizeof(double));
+        std::memcpy(state.data(), entries[first].data.data(), entries[first].data.size());
+        for (size_t i = first + 1; i <= last; ++i)
+            applyDelta(entries[i].data, state);
+        if (state.size() != 6 * system.size())
+            return false;
+        snapshotTime = entries[last].time;
+        entries.erase(entries.begin() + last + 1, entries.end());
+    } else if (!spilled.empty() && spilled.front().time <= time) {
+        size_t last = spilled.size() - 1;
+        while (spilled[last].time > time)
+            --last;
+        size_t first = last;
+        while (!spilled[first].keyframe)
+            --first;
+        Entry entry;
+        for (size_t i = first; i <= last; ++i) {
+            if (!readSpilled(i, entry))
+                return false;
+            if (i == first) {
+                state.resize(entry.data.size() / sizeof(double));
+                std::memcpy(state.data(), entry.data.data(), entry.data.size());
+            } else {
+                applyDelta(entry.data, state);
+            }
+        }
+        if (state.size() != 6 * system.size())
+            return false;
+        snapshotTime = spilled[last].time;
+        entries.clear();
+        spillEnd = spilled[last].offset + spilled[last].size;
+        spilled.erase(spilled.begin() + last + 1, spilled.end());
+    } else {
+        return false;
+    }
+
+    system.setState(state);
+    lastState.swap(state);
+    // Start a new group: the restored snapshot may be spilled, while the next ones go to memory
+    sinceKeyframe = keyframeInterval;
+    return true;
+}
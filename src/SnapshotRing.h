@@ -0,0 +1,69 @@
+#ifndef _SNAPSHOTRING
+#define _SNAPSHOTRING
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "NBodySystem.h"
+
+// Periodic snapshots of the state of an NBodySystem, to seek in time without replaying the
+// whole simulation: restoring the latest snapshot before the wanted time leaves at most one
+// snapshot interval to integrate.
+// Every keyframeInterval-th snapshot is a keyframe holding the raw state; the others only hold
+// the differences with the previous snapshot (XOR of the bit patterns, whose leading zero bytes
+// are dropped). The snapshots are kept in a ring of bounded capacity: the oldest group (a keyframe
+// and its deltas) is evicted when it is full, and either dropped or spilled to a file.
+class SnapshotRing {
+    public:
+        SnapshotRing(size_t capacity, int keyframeInterval);
+        // Evicted snapshots are appended to the given file instead of being dropped (the file is truncated)
+        bool enableSpill(const std::string &path);
+        void clear(); // forgets every snapshot, e.g. when a new simulation starts
+
+        void record(double time, const NBodySystem &system);
+        // Restores the latest snapshot taken at or before the given time, and returns its time in
+        // snapshotTime. The snapshots after it are discarded, as the simulation continues from there.
+        // Returns false if there is no such snapshot.
+        bool restore(double time, NBodySystem &system, double &snapshotTime);
+
+        bool empty() const { return entries.empty() && spilled.empty(); }
+        size_t getMemorySnapshotCount() const { return entries.size(); }
+        size_t getSpilledSnapshotCount() const { return spilled.size(); }
+        uint64_t getRawBytes() const { return rawBytes; } // size of the recorded states, uncompressed
+        uint64_t getStoredBytes() const { return storedBytes; } // size once compressed
+
+    private:
+        struct Entry {
+            double time;
+            bool keyframe;
+            std::vector<uint8_t> data;
+        };
+        struct SpilledEntry {
+            double time;
+            bool keyframe;
+            uint64_t offset, size;
+        };
+
+        static void encodeDelta(const std::vector<double> &previous, const std::vector<double> &state, std::vector<uint8_t> &out);
+        static void applyDelta(const std::vector<uint8_t> &data, std::vector<double> &state);
+        void evictGroup();
+        bool readSpilled(size_t index, Entry &entry);
+
+    private:
+        size_t capacity;
+        int keyframeInterval;
+        int sinceKeyframe;
+        std::deque<Entry> entries; // in memory, in time order, starting with a keyframe
+        std::vector<SpilledEntry> spilled; // on disk, in time order, older than the entries in memory
+        std::fstream spillFile;
+        uint64_t spillEnd = 0;
+        std::vector<double> lastState; // state of the latest snapshot, base of the next delta
+        std::vector<double> scratch;
+        uint64_t rawBytes = 0, storedBytes = 0;
+};
+
+#endif
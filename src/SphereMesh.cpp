@@ -0,0 +1,596 @@
+#include "SphereMesh.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+
+SphereMesh::SphereMesh(SphereType type, size_t resolution) {
+    this->m_type = type;
+    this->m_resolution = resolution;
+}
+
+void SphereMesh::init(ThreadPool *pool) {
+    m_blobs = genBlobs(m_type, m_resolution, pool, m_vertices, m_indices);
+    this->initGPUgeometry();
+}
+
+void SphereMesh::init(const MeshBlobs &blobs) {
+    m_blobs = blobs;
+    this->initGPUgeometry();
+}
+
+void SphereMesh::releaseBlobs() {
+    m_blobs.vertices = nullptr;
+    m_blobs.indices = nullptr;
+    std::vector<PackedVertex>().swap(m_vertices);
+    std::vector<unsigned char>().swap(m_indices);
+}
+
+MeshBlobs SphereMesh::genBlobs(SphereType type, size_t resolution, ThreadPool *pool,
+                               std::vector<PackedVertex> &vertices, std::vector<unsigned char> &indices) {
+    SphereGeometry geometry;
+    genGeometry(type, resolution, geometry, pool);
+    optimizeGeometry(geometry);
+    packVertices(geometry, vertices);
+
+    MeshBlobs blobs;
+    blobs.vertices = vertices.data();
+    blobs.vertexCount = vertices.size();
+    blobs.indexCount = geometry.indices.size();
+    blobs.indexSize = vertices.size() <= 65536 ? sizeof(uint16_t) : sizeof(unsigned int);
+    indices.resize(blobs.indexCount * blobs.indexSize);
+    if (blobs.indexSize == sizeof(uint16_t))
+        std::copy(geometry.indices.begin(), geometry.indices.end(), reinterpret_cast<uint16_t *>(indices.data()));
+    else
+        std::copy(geometry.indices.begin(), geometry.indices.end(), reinterpret_cast<unsigned int *>(indices.data()));
+    blobs.indices = indices.data();
+    blobs.maxError = computeMaxError(geometry);
+    return blobs;
+}
+
+std::string SphereMesh::getName(SphereType type, size_t resolution) {
+    const char *names[3] = { "uv", "ico", "cube" };
+    return std::string("sphere-") + names[static_cast<int>(type)] + "-" + std::to_string(resolution);
+}
+
+VertexLayout SphereMesh::getVertexLayout() {
+    // The integers are normalized to [-1, 1] or [0, 1] by the vertex fetch, the shaders finish the decoding
+    VertexLayout layout;
+    layout.stride = sizeof(PackedVertex);
+    layout.attributeCount = 3;
+    layout.attributes[0] = { 0, 3, GL_SHORT, GL_TRUE, offsetof(PackedVertex, position) };
+    layout.attributes[1] = { 1, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal) };
+    layout.attributes[2] = { 2, 2, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, texCoord) };
+    return layout;
+}
+
+void SphereMesh::genSphere(size_t resolution, SphereGeometry &geometry, ThreadPool *pool) {
+    const size_t rowSize = resolution + 1;
+    const size_t vertexCount = rowSize * rowSize;
+    geometry.positions.resize(3 * vertexCount);
+    geometry.normals.resize(3 * vertexCount);
+    geometry.texCoords.resize(2 * vertexCount);
+    geometry.indices.resize(6 * resolution * resolution);
+
+    // Angles of the rings (phi, 0 to pi) and of the columns (theta, 0 to 2*pi). The last column
+    // repeats the first one exactly, so that the seam is closed, and the poles are exactly on the axis.
+    std::vector<float> sinPhi(rowSize), cosPhi(rowSize), sinTheta(rowSize), cosTheta(rowSize);
+    for (size_t k = 0; k <= resolution; ++k) {
+        const double phi = glm::pi<double>() * k / resolution;
+        const double theta = 2.0 * glm::pi<double>() * k / resolution;
+        sinPhi[k] = static_cast<float>(std::sin(phi));
+        cosPhi[k] = static_cast<float>(std::cos(phi));
+        sinTheta[k] = static_cast<float>(std::sin(theta));
+        cosTheta[k] = static_cast<float>(std::cos(theta));
+    }
+    sinPhi[0] = sinPhi[resolution] = 0.0f;
+    sinTheta[resolution] = sinTheta[0];
+    cosTheta[resolution] = cosTheta[0];
+
+    auto genRows = [&](size_t first, size_t last) {
+        const float step = 1.0f / static_cast<float>(resolution);
+        for (size_t i = first; i < last; ++i) {
+            float *position = &geometry.positions[3 * i * rowSize];
+            float *normal = &geometry.normals[3 * i * rowSize];
+            float *texCoord = &geometry.texCoords[2 * i * rowSize];
+            const float t2 = static_cast<float>(i) * step;
+            for (size_t j = 0; j <= resolution; ++j) {
+                // Spherical coordinates; the normals are the same as the positions for a unit sphere
+                const float x = sinPhi[i] * cosTheta[j];
+                const float y = cosPhi[i];
+                const float z = sinPhi[i] * sinTheta[j];
+                position[0] = normal[0] = x;
+                position[1] = normal[1] = y;
+                position[2] = normal[2] = z;
+                texCoord[0] = static_cast<float>(j) * step;
+                texCoord[1] = t2;
+                position += 3;
+                normal += 3;
+                texCoord += 2;
+            }
+
+            // Two triangles per quad between this ring and the next one
+            if (i == resolution)
+                continue;
+            unsigned int *index = &geometry.indices[6 * i * resolution];
+            for (size_t j = 0; j < resolution; ++j) {
+                const unsigned int p1 = static_cast<unsigned int>(i * rowSize + j);
+                const unsigned int p2 = p1 + 1;
+                const unsigned int p3 = p1 + static_cast<unsigned int>(rowSize);
+                const unsigned int p4 = p3 + 1;
+                index[0] = p1;
+                index[1] = p2;
+                index[2] = p3;
+                index[3] = p2;
+                index[4] = p4;
+                index[5] = p3;
+                index += 6;
+            }
+        }
+    };
+    if (pool)
+        pool->parallelFor(rowSize, genRows);
+    else
+        genRows(0, rowSize);
+}
+
+// Adds a vertex on the sphere in the direction of the given point, or returns the index of the
+// vertex already added there (up to rounding) by a neighbouring face
+static unsigned int addWeldedVertex(const glm::vec3 &point, SphereGeometry &geometry,
+                                    std::unordered_map<uint64_t, unsigned int> &welded) {
+    const glm::vec3 position = glm::normalize(point);
+    uint64_t key = 0;
+    for (int k = 0; k < 3; ++k)
+        key = (key << 21) | static_cast<uint64_t>(std::lround((position[k] + 1.0f) * (1 << 19)));
+    auto found = welded.find(key);
+    if (found != welded.end())
+        return found->second;
+    const unsigned int index = static_cast<unsigned int>(geometry.positions.size() / 3);
+    geometry.positions.insert(geometry.positions.end(), { position.x, position.y, position.z });
+    welded[key] = index;
+    return index;
+}
+
+static glm::vec3 vertexPosition(const SphereGeometry &geometry, unsigned int index) {
+    return glm::vec3(geometry.positions[3 * index], geometry.positions[3 * index + 1], geometry.positions[3 * index + 2]);
+}
+
+// Adds a triangle facing outwards (counter-clockwise seen from outside, like the UV sphere)
+static void addOutwardTriangle(unsigned int a, unsigned int b, unsigned int c, SphereGeometry &geometry) {
+    const glm::vec3 pa = vertexPosition(geometry, a), pb = vertexPosition(geometry, b), pc = vertexPosition(geometry, c);
+    if (glm::dot(glm::cross(pb - pa, pc - pa), pa + pb + pc) < 0.0f)
+        std::swap(b, c);
+    geometry.indices.insert(geometry.indices.end(), { a, b, c });
+}
+
+static unsigned int duplicateVertex(unsigned int index, float u, SphereGeometry &geometry) {
+    const unsigned int copy = static_cast<unsigned int>(geometry.positions.size() / 3);
+    for (int k = 0; k < 3; ++k)
+        geometry.positions.push_back(geometry.positions[3 * index + k]);
+    geometry.texCoords.push_back(u);
+    geometry.texCoords.push_back(geometry.texCoords[2 * index + 1]);
+    return copy;
+}
+
+// Computes the normals and the texture coordinates (the same as the UV sphere's) of a geometry
+// made of positions and triangles. The triangles crossing the seam of the texture get copies of
+// their vertices on the near side with u + 1, and the triangles touching a pole get copies of
+// the pole with the mean u of their other vertices, since a pole has no longitude of its own.
+static void finishGeometry(SphereGeometry &geometry) {
+    const size_t vertexCount = geometry.positions.size() / 3;
+    geometry.texCoords.resize(2 * vertexCount);
+    std::vector<bool> pole(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        const float x = geometry.positions[3 * v], y = geometry.positions[3 * v + 1], z = geometry.positions[3 * v + 2];
+        float u = std::atan2(z, x) / (2.0f * glm::pi<float>());
+        if (u < 0.0f)
+            u += 1.0f;
+        geometry.texCoords[2 * v] = u;
+        geometry.texCoords[2 * v + 1] = std::acos(glm::clamp(y, -1.0f, 1.0f)) / glm::pi<float>();
+        pole[v] = x * x + z * z < 1e-12f;
+    }
+
+    std::unordered_map<unsigned int, unsigned int> wrapped; // vertex of the seam -> copy with u + 1
+    for (size_t t = 0; t < geometry.indices.size(); t += 3) {
+        unsigned int *triangle = &geometry.indices[t];
+        float u[3];
+        bool atPole[3];
+        for (int k = 0; k < 3; ++k) {
+            u[k] = geometry.texCoords[2 * triangle[k]];
+            atPole[k] = pole[triangle[k]];
+        }
+        float minU = 1.0f, maxU = 0.0f;
+        for (int k = 0; k < 3; ++k) {
+            if (!atPole[k]) {
+                minU = std::min(minU, u[k]);
+                maxU = std::max(maxU, u[k]);
+            }
+        }
+        if (maxU - minU > 0.5f) {
+            for (int k = 0; k < 3; ++k) {
+                if (atPole[k] || u[k] >= 0.5f)
+                    continue;
+                auto found = wrapped.find(triangle[k]);
+                if (found == wrapped.end())
+                    found = wrapped.insert(std::make_pair(triangle[k], duplicateVertex(triangle[k], u[k] + 1.0f, geometry))).first;
+                triangle[k] = found->second;
+                u[k] += 1.0f;
+            }
+        }
+        for (int k = 0; k < 3; ++k) {
+            if (atPole[k])
+                triangle[k] = duplicateVertex(triangle[k], 0.5f * (u[(k + 1) % 3] + u[(k + 2) % 3]), geometry);
+        }
+    }
+    geometry.normals = geometry.positions; // for a unit sphere
+}
+
+void SphereMesh::genIcosphere(size_t frequency, SphereGeometry &geometry) {
+    geometry.positions.clear();
+    geometry.texCoords.clear();
+    geometry.indices.clear();
+
+    // Icosahedron, turned about the x axis to put its vertex 5 at the north pole
+    const float golden = 0.5f * (1.0f + std::sqrt(5.0f));
+    const glm::vec3 corners[12] = {
+        { -1, golden, 0 }, { 1, golden, 0 }, { -1, -golden, 0 }, { 1, -golden, 0 },
+        { 0, -1, golden }, { 0, 1, golden }, { 0, -1, -golden }, { 0, 1, -golden },
+        { golden, 0, -1 }, { golden, 0, 1 }, { -golden, 0, -1 }, { -golden, 0, 1 }
+    };
+    const unsigned int faces[20][3] = {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+        { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 }
+    };
+    const glm::mat3 tilt = glm::mat3(glm::rotate(glm::mat4(1.0f), -std::atan2(golden, 1.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+
+    // Vertex (i, j) of a face is at corner a + i/n (b - a) + j/n (c - a); row i holds n + 1 - i vertices
+    const size_t n = std::max<size_t>(frequency, 1);
+    std::unordered_map<uint64_t, unsigned int> welded;
+    std::vector<unsigned int> faceVertices;
+    for (const unsigned int *face : faces) {
+        const glm::vec3 a = tilt * corners[face[0]], b = tilt * corners[face[1]], c = tilt * corners[face[2]];
+        faceVertices.clear();
+        for (size_t i = 0; i <= n; ++i) {
+            for (size_t j = 0; i + j <= n; ++j)
+                faceVertices.push_back(addWeldedVertex(a + (b - a) * (float(i) / n) + (c - a) * (float(j) / n), geometry, welded));
+        }
+        auto vertex = [&](size_t i, size_t j) { return faceVertices[i * (n + 1) - i * (i - 1) / 2 + j]; };
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; i + j < n; ++j) {
+                addOutwardTriangle(vertex(i, j), vertex(i + 1, j), vertex(i, j + 1), geometry);
+                if (i + j + 1 < n)
+                    addOutwardTriangle(vertex(i + 1, j), vertex(i + 1, j + 1), vertex(i, j + 1), geometry);
+            }
+        }
+    }
+    finishGeometry(geometry);
+}
+
+void SphereMesh::genCubeSphere(size_t segments, SphereGeometry &geometry) {
+    geometry.positions.clear();
+    geometry.texCoords.clear();
+    geometry.indices.clear();
+
+    // Each face is spanned by two axes; the grid is uniform in angle (tan) rather than on the cube,
+    // which evens out the size of the squares between the centers and the corners of the faces
+    const glm::vec3 axes[3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    const size_t n = std::max<size_t>(segments, 1);
+    std::vector<float> offsets(n + 1);
+    for (size_t k = 0; k <= n; ++k)
+        offsets[k] = std::tan(glm::pi<float>() / 4.0f * (2.0f * k / n - 1.0f));
+    offsets[0] = -1.0f;
+    offsets[n] = 1.0f;
+
+    std::unordered_map<uint64_t, unsigned int> welded;
+    std::vector<unsigned int> faceVertices((n + 1) * (n + 1));
+    for (int face = 0; face < 6; ++face) {
+        const glm::vec3 normal = axes[face / 2] * (face % 2 ? -1.0f : 1.0f);
+        const glm::vec3 &tangent = axes[(face / 2 + 1) % 3], &bitangent = axes[(face / 2 + 2) % 3];
+        for (size_t i = 0; i <= n; ++i) {
+            for (size_t j = 0; j <= n; ++j)
+                faceVertices[i * (n + 1) + j] = addWeldedVertex(normal + tangent * offsets[i] + bitangent * offsets[j], geometry, welded);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < n; ++j) {
+                const unsigned int p1 = faceVertices[i * (n + 1) + j], p2 = faceVertices[i * (n + 1) + j + 1];
+                const unsigned int p3 = faceVertices[(i + 1) * (n + 1) + j], p4 = faceVertices[(i + 1) * (n + 1) + j + 1];
+                addOutwardTriangle(p1, p2, p3, geometry);
+                addOutwardTriangle(p2, p4, p3, geometry);
+            }
+        }
+    }
+    finishGeometry(geometry);
+}
+
+void SphereMesh::genGeometry(SphereType type, size_t resolution, SphereGeometry &geometry, ThreadPool *pool) {
+    switch (type) {
+        case SphereType::Ico:
+            genIcosphere(static_cast<size_t>(std::lround(resolution / 5.0)), geometry);
+            break;
+        case SphereType::Cube:
+            genCubeSphere(2 * static_cast<size_t>(std::lround(resolution / 8.0)), geometry);
+            break;
+        default:
+            genSphere(resolution, geometry, pool);
+            break;
+    }
+}
+
+// Closest point of the triangle abc to the origin (see Ericson, Real-Time Collision Detection, 5.1.5)
+static glm::dvec3 closestPointToOrigin(const glm::dvec3 &a, const glm::dvec3 &b, const glm::dvec3 &c) {
+    const glm::dvec3 ab = b - a, ac = c - a, ap = -a;
+    const double d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0 && d2 <= 0.0)
+        return a;
+    const glm::dvec3 bp = -b;
+    const double d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0 && d4 <= d3)
+        return b;
+    const double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+        return a + ab * (d1 / (d1 - d3));
+    const glm::dvec3 cp = -c;
+    const double d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0 && d5 <= d6)
+        return c;
+    const double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+        return a + ac * (d2 / (d2 - d6));
+    const double va = d3 * d6 - d5 * d4;
+    if (va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    const double denominator = 1.0 / (va + vb + vc);
+    return a + ab * (vb * denominator) + ac * (vc * denominator);
+}
+
+double SphereMesh::computeMaxError(const SphereGeometry &geometry) {
+    // The vertices are on the sphere: the triangles are inside it, and the farthest point of a
+    // triangle from the sphere is its closest point to the center
+    double maxError = 0.0;
+    for (size_t t = 0; t < geometry.indices.size(); t += 3) {
+        glm::dvec3 p[3];
+        for (int k = 0; k < 3; ++k) {
+            const float *position = &geometry.positions[3 * geometry.indices[t + k]];
+            p[k] = glm::dvec3(position[0], position[1], position[2]);
+        }
+        maxError = std::max(maxError, 1.0 - glm::length(closestPointToOrigin(p[0], p[1], p[2])));
+    }
+    return maxError;
+}
+
+void SphereMesh::optimizeGeometry(SphereGeometry &geometry) {
+    const size_t vertexCount = geometry.positions.size() / 3;
+    // No overdraw pass: a convex mesh drawn with back-face culling covers each pixel once, whatever the order
+    optimizeVertexCache(geometry.indices, vertexCount);
+    std::vector<unsigned int> remap;
+    optimizeVertexFetch(geometry.indices, vertexCount, remap);
+    remapVertices(geometry.positions, 3, remap);
+    remapVertices(geometry.normals, 3, remap);
+    remapVertices(geometry.texCoords, 2, remap);
+}
+
+static int16_t toSnorm16(float value) {
+    return static_cast<int16_t>(std::lround(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+static uint16_t toUnorm16(float value) {
+    return static_cast<uint16_t>(std::lround(glm::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+void SphereMesh::packVertices(const SphereGeometry &geometry, std::vector<PackedVertex> &vertices) {
+    vertices.resize(geometry.positions.size() / 3);
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        PackedVertex &packed = vertices[v];
+        for (int k = 0; k < 3; ++k)
+            packed.position[k] = toSnorm16(geometry.positions[3 * v + k]);
+        packed.position[3] = 0;
+
+        // Octahedral encoding: project onto the octahedron |x| + |y| + |z| = 1, then fold the lower
+        // half over the upper one
+        glm::vec3 n(geometry.normals[3 * v], geometry.normals[3 * v + 1], geometry.normals[3 * v + 2]);
+        n /= std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        glm::vec2 e(n.x, n.y);
+        if (n.z < 0.0f)
+            e = glm::vec2((1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+        packed.normal[0] = toSnorm16(e.x);
+        packed.normal[1] = toSnorm16(e.y);
+
+        packed.texCoord[0] = toUnorm16(geometry.texCoords[2 * v] / kTexCoordScaleU);
+        packed.texCoord[1] = toUnorm16(geometry.texCoords[2 * v + 1]);
+    }
+}
+
+void SphereMesh::unpackVertex(const PackedVertex &vertex, float position[3], float normal[3], float texCoord[2]) {
+    // The same as shaders/planetVertexShader.glsl
+    for (int k = 0; k < 3; ++k)
+        position[k] = std::max(vertex.position[k] / 32767.0f, -1.0f);
+    glm::vec3 n(std::max(vertex.normal[0] / 32767.0f, -1.0f), std::max(vertex.normal[1] / 32767.0f, -1.0f), 0.0f);
+    n.z = 1.0f - std::abs(n.x) - std::abs(n.y);
+    const float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    n = glm::normalize(n);
+    for (int k = 0; k < 3; ++k)
+        normal[k] = n[k];
+    texCoord[0] = vertex.texCoord[0] / 65535.0f * kTexCoordScaleU;
+    texCoord[1] = vertex.texCoord[1] / 65535.0f;
+}
+
+void SphereMesh::initGPUgeometry() {
+  m_indexType = m_blobs.indexSize == sizeof(uint16_t) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+  const VertexLayout layout = getVertexLayout();
+
+ // Create a single handle, vertex array object that contains attributes,
+ // vertex buffer objects (here a single one, interleaving the attributes)
+#ifdef _MY_OPENGL_IS_33_
+  glGenVertexArrays(1, &m_vao); // If your system doesn't support OpenGL 4.5, you should use this instead of glCreateVertexArrays.
+#else
+  glCreateVertexArrays(1, &m_vao);
+#endif
+  glBindVertexArray(m_vao);
+
+  size_t vertexBufferSize = layout.stride*m_blobs.vertexCount;
+#ifdef _MY_OPENGL_IS_33_
+  glGenBuffers(1, &m_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertexBufferSize, m_blobs.vertices, GL_STATIC_DRAW);
+#else
+  glCreateBuffers(1, &m_vbo);
+  glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+  glNamedBufferStorage(m_vbo, vertexBufferSize, m_blobs.vertices, 0); // Create a data storage on the GPU and fill it from a CPU array
+#endif
+  for (uint32_t a = 0; a < layout.attributeCount; ++a) {
+    const VertexAttributeLayout &attribute = layout.attributes[a];
+    glEnableVertexAttribArray(attribute.location);
+    glVertexAttribPointer(attribute.location, attribute.componentCount, attribute.type, attribute.normalized, layout.stride, (void*) (size_t) attribute.offset);
+  }
+
+  // Same for an index buffer object that stores the list of indices of the
+  // triangles forming the mesh
+  size_t indexBufferSize = m_blobs.indexSize*m_blobs.indexCount;
+#ifdef _MY_OPENGL_IS_33_
+  glGenBuffers(1, &m_ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, m_blobs.indices, GL_STATIC_DRAW);
+#else
+  glCreateBuffers(1, &m_ibo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+  glNamedBufferStorage(m_ibo, indexBufferSize, m_blobs.indices, 0);
+#endif
+
+  glBindVertexArray(0); // deactivate the VAO for now, will be activated again when rendering
+}
+
+void SphereMesh::draw() const {
+    glBindVertexArray(m_vao);
+    glDrawElements(GL_TRIANGLES, m_blobs.indexCount, m_indexType, 0); // Call for rendering: stream the current GPU geometry through the current GPU program
+}
+
+size_t SphereMesh::getGPUBytes() const {
+    return sizeof(PackedVertex) * m_blobs.vertexCount + m_blobs.indexSize * m_blobs.indexCount;
+}
+
+bool SphereMeshCache::load(const std::string &path) {
+    return file.open(path, SphereMesh::getVertexLayout());
+}
+
+bool SphereMeshCache::save(const std::string &path) {
+    bool saved = true;
+    if (loadedMeshCount < meshes.size()) {
+        // Written aside then renamed, as the loaded meshes are read from the current file
+        std::vector<std::pair<std::string, MeshBlobs> > blobs;
+        for (const auto &entry : meshes)
+            blobs.push_back(std::make_pair(SphereMesh::getName(entry.first.first, entry.first.second), entry.second->getBlobs()));
+        const std::string temporaryPath = path + ".tmp";
+        saved = MeshFile::write(SphereMesh::getVertexLayout(), blobs, temporaryPath);
+        file.close();
+        saved = saved && (std::remove(path.c_str()) == 0 || std::ifstream(path.c_str()).fail()) && std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+        loadedMeshCount = meshes.size();
+    }
+    for (auto &entry : meshes)
+        entry.second->releaseBlobs();
+    file.close();
+    return saved;
+}
+
+const SphereMesh &SphereMeshCache::get(SphereType type, size_t resolution) {
+    std::unique_ptr<SphereMesh> &mesh = meshes[std::make_pair(type, resolution)];
+    if (!mesh) {
+        mesh.reset(new SphereMesh(type, resolution));
+        MeshBlobs blobs;
+        if (file.find(SphereMesh::getName(type, resolution), blobs)) {
+            mesh->init(blobs);
+            ++loadedMeshCount;
+        } else {
+            mesh->init(pool);
+        }
+    }
+    return *mesh;
+}
+
+const ProceduralSphere &SphereMeshCache::getProcedural() {
+    if (!procedural) {
+        procedural.reset(new ProceduralSphere());
+        procedural->init();
+    }
+    return *procedural;
+}
+
+const SphereImpostor &SphereMeshCache::getImpostor() {
+    if (!impostor) {
+        impostor.reset(new SphereImpostor());
+        impostor->init();
+    }
+    return *impostor;
+}
+
+size_t SphereMeshCache::getGPUBytes() const {
+    size_t bytes = 0;
+    for (const auto &entry : meshes)
+        bytes += entry.second->getGPUBytes();
+    return bytes;
+}
+
+ProceduralSphere::~ProceduralSphere() {
+    if (m_vao)
+        glDeleteVertexArrays(1, &m_vao);
+}
+
+void ProceduralSphere::init() {
+    // The core profile draws nothing without a vertex array, even one without attributes
+#ifdef _MY_OPENGL_IS_33_
+    glGenVertexArrays(1, &m_vao);
+#else
+    glCreateVertexArrays(1, &m_vao);
+#endif
+}
+
+void ProceduralSphere::draw(GLuint program, size_t resolution) const {
+    glUniform1i(glGetUniformLocation(program, "proceduralResolution"), static_cast<GLint>(resolution));
+    glBindVertexArray(m_vao);
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(3 * getTriangleCount(resolution)));
+    glUniform1i(glGetUniformLocation(program, "proceduralResolution"), 0);
+}
+
+double ProceduralSphere::getMaxError(size_t resolution) {
+    // The closest point of the triangles is the middle of the diagonal of the quads, at an angle of
+    // sqrt(5) / 2 * pi / resolution from their corners
+    const double halfDiagonal = std::sqrt(5.0) / 2.0 * glm::pi<double>() / resolution;
+    return 1.0 - std::cos(halfDiagonal);
+}
+
+size_t ProceduralSphere::getResolutionForError(double maxError) {
+    const double halfDiagonal = std::acos(std::max(1.0 - maxError, -1.0));
+    size_t resolution = std::max<size_t>(3, static_cast<size_t>(std::ceil(std::sqrt(5.0) / 2.0 * glm::pi<double>() / halfDiagonal)));
+    while (resolution > 3 && getMaxError(resolution - 1) <= maxError) // rounding
+        --resolution;
+    return resolution;
+}
+
+SphereImpostor::~SphereImpostor() {
+    if (m_vao)
+        glDeleteVertexArrays(1, &m_vao);
+}
+
+void SphereImpostor::init() {
+#ifdef _MY_OPENGL_IS_33_
+    glGenVertexArrays(1, &m_vao);
+#else
+    glCreateVertexArrays(1, &m_vao);
+#endif
+}
+
+void SphereImpostor::draw() const {
+    glBindVertexArray(m_vao);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
@@ -0,0 +1,171 @@
+#ifndef _SPHEREMESH
+#define _SPHEREMESH
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glad/gl.h>
+
+#include "MeshFile.h"
+#include "ThreadPool.h"
+
+// CPU-side geometry of a sphere mesh, ready to be uploaded
+struct SphereGeometry {
+    std::vector<float> positions; // x, y, z per vertex
+    std::vector<float> normals; // x, y, z per vertex
+    std::vector<float> texCoords; // u, v per vertex
+    std::vector<unsigned int> indices; // three per triangle
+};
+
+// Vertex as uploaded to the GPU, 16 bytes instead of 32 for three float arrays. The position is
+// in signed normalized 16-bit integers (the sphere has radius 1), the normal in the octahedral
+// encoding (the unit sphere folded onto a square) and the texture coordinates in unsigned
+// normalized 16-bit integers, with u halved as the seam copies go up to 1.5.
+struct PackedVertex {
+    int16_t position[4]; // w unused, for the alignment
+    int16_t normal[2];
+    uint16_t texCoord[2];
+};
+
+// Tessellations of the sphere. The resolution is the number of edges around the equator for all of
+// them, so that they look alike at the same resolution.
+enum class SphereType {
+    UV, // rings and columns of constant latitude and longitude, crowded at the poles
+    Ico, // subdivided icosahedron, resolution / 5 edges along each of its edges
+    Cube // cube with resolution / 4 edges along each of its edges (rounded to even, for vertices at the poles), projected at equal angles
+};
+
+// Sphere of radius 1, with positions, normals and texture coordinates, uploaded to the GPU.
+// The objects scale it to their radius with their model matrix, so one mesh serves all the
+// objects of the same type and resolution.
+class SphereMesh {
+    public:
+        SphereMesh(SphereType type, size_t resolution);
+        // Generates the geometry and uploads it, keeping the uploaded blobs until releaseBlobs;
+        // requires an OpenGL context
+        void init(ThreadPool *pool);
+        void init(const MeshBlobs &blobs); // uploads blobs of the same layout, e.g. from a MeshFile
+        MeshBlobs getBlobs() const { return m_blobs; } // null after releaseBlobs
+        void releaseBlobs();
+        // Draws the triangles with the current program, which decodes the packed vertices (see the
+        // octahedralNormals and texCoordScale uniforms of the planet shaders)
+        void draw() const;
+        SphereType getType() const { return m_type; }
+        size_t getResolution() const { return m_resolution; }
+        size_t getVertexCount() const { return m_blobs.vertexCount; }
+        size_t getTriangleCount() const { return m_blobs.indexCount / 3; }
+        size_t getGPUBytes() const; // size of the vertex and index buffers
+        double getMaxError() const { return m_blobs.maxError; } // see computeMaxError
+
+        // Fills the geometry of a UV sphere with resolution + 1 rings of resolution + 1 vertices.
+        // The sines and cosines are computed once per ring and once per column, the arrays are sized
+        // exactly (no allocation when the geometry already has the capacity), and the rings are
+        // written in parallel on the pool if one is given.
+        static void genSphere(size_t resolution, SphereGeometry &geometry, ThreadPool *pool);
+
+        // Icosahedron whose faces are divided into frequency^2 triangles, and cube whose faces are
+        // divided into segments^2 squares. The vertices of the edges are shared between the faces, and
+        // duplicated along the seam of the texture and at the poles to get continuous texture coordinates.
+        static void genIcosphere(size_t frequency, SphereGeometry &geometry);
+        static void genCubeSphere(size_t segments, SphereGeometry &geometry);
+
+        // Any of the above, for the given resolution around the equator
+        static void genGeometry(SphereType type, size_t resolution, SphereGeometry &geometry, ThreadPool *pool);
+
+        // Reorders the triangles for the vertex cache and the vertices for the vertex fetch (see
+        // MeshOptimizer.h); the triangles are the same
+        static void optimizeGeometry(SphereGeometry &geometry);
+
+        // Largest distance between the triangles and the unit sphere
+        static double computeMaxError(const SphereGeometry &geometry);
+
+        // Packed vertices of the geometry, and their decoding as done by the shaders
+        static void packVertices(const SphereGeometry &geometry, std::vector<PackedVertex> &vertices);
+        static void unpackVertex(const PackedVertex &vertex, float position[3], float normal[3], float texCoord[2]);
+        constexpr static float kTexCoordScaleU = 2.0f; // the packed u is multiplied by this
+        static VertexLayout getVertexLayout(); // of PackedVertex
+
+        // Generates, optimizes and packs the geometry, as uploaded: 16-bit indices when the vertices
+        // allow it. The blobs point into the given arrays.
+        static MeshBlobs genBlobs(SphereType type, size_t resolution, ThreadPool *pool,
+                                  std::vector<PackedVertex> &vertices, std::vector<unsigned char> &indices);
+        static std::string getName(SphereType type, size_t resolution); // in mesh files
+
+    private:
+        void initGPUgeometry();
+
+    private:
+        SphereType m_type;
+        size_t m_resolution;
+        MeshBlobs m_blobs;
+        std::vector<PackedVertex> m_vertices; // generated blobs
+        std::vector<unsigned char> m_indices;
+        GLuint m_vao = 0;
+        GLuint m_vbo = 0; // packed vertices
+        GLuint m_ibo = 0;
+        GLenum m_indexType = GL_UNSIGNED_INT; // 16-bit indices when the vertices allow it
+};
+
+// UV sphere of radius 1 without any vertex or index buffer: when the proceduralResolution uniform
+// is positive, the planet and star vertex shaders compute the vertices of genSphere from
+// gl_VertexID, two triangles per quad. Only an empty vertex array is needed, so the resolution
+// is free to change at every draw.
+class ProceduralSphere {
+    public:
+        ~ProceduralSphere();
+        void init(); // requires an OpenGL context
+        void draw(GLuint program, size_t resolution) const; // with the current program, which must be the given one
+        static size_t getTriangleCount(size_t resolution) { return 2 * resolution * resolution; }
+        // Largest distance to the unit sphere, at the quads of the equator: 5 pi^2 / (8 resolution^2)
+        static double getMaxError(size_t resolution);
+        static size_t getResolutionForError(double maxError); // smallest resolution within maxError
+
+    private:
+        GLuint m_vao = 0;
+};
+
+// Sphere drawn as a single quad facing the camera, on which the impostor shaders ray-cast the exact
+// sphere of the model matrix: silhouette, depth, normal and texture coordinates are exact at any
+// size, for two triangles. Like ProceduralSphere, the quad comes from gl_VertexID alone.
+class SphereImpostor {
+    public:
+        ~SphereImpostor();
+        void init(); // requires an OpenGL context
+        void draw() const; // with the impostor program
+
+    private:
+        GLuint m_vao = 0;
+};
+
+// Sphere meshes shared by all the objects, created on first request for each type and resolution,
+// the procedural sphere and the impostor. The meshes found in the mesh file opened with load are
+// uploaded straight from it, the others are generated, and save writes them all to the file for the
+// next launch.
+class SphereMeshCache {
+    public:
+        explicit SphereMeshCache(ThreadPool *pool) : pool(pool) {}
+        bool load(const std::string &path); // before the meshes are requested; false if there is no valid file
+        // Once all the meshes are created: writes the file if some were generated, then frees the blobs of
+        // all the meshes and the mapping
+        bool save(const std::string &path);
+        const SphereMesh &get(SphereType type, size_t resolution); // requires an OpenGL context
+        const ProceduralSphere &getProcedural(); // same
+        const SphereImpostor &getImpostor(); // same
+        size_t getMeshCount() const { return meshes.size(); }
+        size_t getLoadedMeshCount() const { return loadedMeshCount; } // found in the file
+        size_t getGPUBytes() const;
+
+    private:
+        ThreadPool *pool; // for the generation of the meshes
+        std::map<std::pair<SphereType, size_t>, std::unique_ptr<SphereMesh> > meshes;
+        std::unique_ptr<ProceduralSphere> procedural;
+        std::unique_ptr<SphereImpostor> impostor;
+        MeshFile file;
+        size_t loadedMeshCount = 0;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "TextureBaker.h"
+
+#include <chrono>
+#include <limits>
+#include <vector>
+
+#include "MipChain.h"
+#include "TextureFile.h"
+#include "stb_image.h"
+
+typedef std::chrono::steady_clock BakeClock;
+
+bool bakeTexture(const std::string &imagePath, int channels, BlockFormat format, const std::string &bakedPath, ThreadPool *pool,
+                 BakeResult &result) {
+    const BakeClock::time_point start = BakeClock::now();
+    int width, height, numComponents;
+    unsigned char *data = stbi_load(imagePath.c_str(), &width, &height, &numComponents, channels);
+    if (!data)
+        return false;
+    std::vector<MipLevel> mips;
+    buildMipChain(data, width, height, channels, mips, pool);
+    stbi_image_free(data);
+
+    const GLenum internalFormats[5] = { 0, GL_R8, 0, GL_RGB8, GL_RGBA8 };
+    const GLenum formats[5] = { 0, GL_RED, 0, GL_RGB, GL_RGBA };
+    if (!canCompress(format, channels))
+        format = BlockFormat::None;
+    TextureFileFormat fileFormat;
+    fileFormat.internalFormat = format == BlockFormat::None ? internalFormats[channels] : getBlockFormatGL(format);
+    fileFormat.format = format == BlockFormat::None ? formats[channels] : 0;
+    fileFormat.type = format == BlockFormat::None ? GL_UNSIGNED_BYTE : 0;
+    fileFormat.channels = channels;
+
+    // Every level compressed, then the first one decoded back to measure what the compression lost
+    const BakeClock::time_point encodeStart = BakeClock::now();
+    std::vector<std::vector<unsigned char>> blocks(format == BlockFormat::None ? 0 : mips.size());
+    for (size_t l = 0; l < blocks.size(); ++l)
+        compressImage(format, mips[l].pixels.data(), mips[l].width, mips[l].height, channels, blocks[l], pool);
+    result.encodeSeconds = std::chrono::duration<double>(BakeClock::now() - encodeStart).count();
+    result.psnr = std::numeric_limits<double>::infinity();
+    if (!blocks.empty()) {
+        std::vector<unsigned char> decoded;
+        decompressImage(format, blocks[0].data(), mips[0].width, mips[0].height, channels, decoded);
+        result.psnr = computePsnr(mips[0].pixels.data(), decoded.data(), decoded.size());
+    }
+
+    std::vector<TextureFileLevel> levels(mips.size());
+    for (size_t l = 0; l < mips.size(); ++l) {
+        levels[l].data = blocks.empty() ? mips[l].pixels.data() : blocks[l].data();
+        levels[l].size = blocks.empty() ? mips[l].pixels.size() : blocks[l].size();
+        levels[l].width = mips[l].width;
+        levels[l].height = mips[l].height;
+    }
+    if (!TextureFile::write(fileFormat, levels, bakedPath))
+        return false;
+
+    TextureFile file;
+    result.width = width;
+    result.height = height;
+    result.levelCount = levels.size();
+    result.bakedBytes = file.open(bakedPath) ? file.getFileSize() : 0;
+    result.format = format;
+    result.seconds = std::chrono::duration<double>(BakeClock::now() - start).count();
+    return true;
+}
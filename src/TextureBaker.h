@@ -0,0 +1,30 @@
+#ifndef _TEXTUREBAKER
+#define _TEXTUREBAKER
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "BlockCompression.h"
+#include "ThreadPool.h"
+
+// Outcome of baking an image, for the report of --bake-textures
+struct BakeResult {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    size_t levelCount = 0;
+    size_t bakedBytes = 0; // of the written file
+    BlockFormat format = BlockFormat::None; // of the levels
+    double psnr = 0.0; // of the first level against the image, in dB (infinite when uncompressed)
+    double encodeSeconds = 0.0; // block compression
+    double seconds = 0.0; // decoding, mip chain, block compression and writing
+};
+
+// Decodes the image with the given channels (1, 3 or 4), builds its mip chain on the pool and writes
+// it as a TextureFile to bakedPath, its levels compressed on the pool in the given block format if it
+// suits the channels (see canCompress), uncompressed otherwise. Returns false if the image cannot be
+// decoded or the file cannot be written.
+bool bakeTexture(const std::string &imagePath, int channels, BlockFormat format, const std::string &bakedPath, ThreadPool *pool,
+                 BakeResult &result);
+
+#endif
@@ -0,0 +1,100 @@
+#include "TextureCache.h"
+
+#include "MipChain.h"
+#include "stb_image.h"
+
+static const int kChannelCounts[3] = { 1, 3, 4 }; // of each TextureFormat
+
+void TextureCache::prefetch(const std::string &path, TextureFormat format) {
+    TextureFile file;
+    if (!textures[std::make_pair(path, format)].expired() || openBaked(path, format, file))
+        return; // uploaded already, or nothing to decode
+    decoder->request(path, kChannelCounts[static_cast<int>(format)]);
+}
+
+std::shared_ptr<const Texture> TextureCache::get(const std::string &path, TextureFormat format) {
+    std::weak_ptr<Texture> &entry = textures[std::make_pair(path, format)];
+    std::shared_ptr<Texture> texture = entry.lock();
+    if (texture) {
+        ++hits;
+        savedBytes += texture->getBytes();
+        return texture;
+    }
+    ++misses;
+    texture = loadTexture(path, format);
+    entry = texture;
+    return texture;
+}
+
+size_t TextureCache::getTextureCount() const {
+    size_t count = 0;
+    for (const auto &entry : textures)
+        count += entry.second.expired() ? 0 : 1;
+    return count;
+}
+
+size_t TextureCache::getGPUBytes() const {
+    size_t bytes = 0;
+    for (const auto &entry : textures) {
+        std::shared_ptr<Texture> texture = entry.second.lock();
+        if (texture)
+            bytes += texture->getBytes();
+    }
+    return bytes;
+}
+
+bool TextureCache::openBaked(const std::string &path, TextureFormat format, TextureFile &file) {
+    return file.open(TextureFile::getBakedPath(path)) && file.getFormat().channels == static_cast<uint32_t>(kChannelCounts[static_cast<int>(format)]);
+}
+
+std::shared_ptr<Texture> TextureCache::loadTexture(const std::string &path, TextureFormat format) {
+    const GLenum formats[3] = { GL_RED, GL_RGB, GL_RGBA };
+    const int f = static_cast<int>(format);
+
+    TextureFile file;
+    if (openBaked(path, format, file) && file.isUploadable()) {
+        // Uploaded straight from the mapping, with the whole mip chain
+        GLuint texID;
+        glGenTextures(1, &texID);
+        glBindTexture(GL_TEXTURE_2D, texID);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        TextureFile::setMipmapSampling(GL_TEXTURE_2D, file.getLevelCount());
+        file.upload(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        size_t bytes = 0;
+        for (size_t l = 0; l < file.getLevelCount(); ++l)
+            bytes += file.getLevel(l).size;
+        ++baked;
+        return std::make_shared<Texture>(texID, file.getLevel(0).width, file.getLevel(0).height, bytes);
+    }
+
+    // The image in CPU memory, converted to the requested channels, usually decoded by a worker already,
+    // and its mip chain
+    const DecodedImage image = decoder->take(path, kChannelCounts[f]);
+    if (!image.data)
+        return nullptr;
+    std::vector<MipLevel> levels;
+    buildMipChain(image.data, image.width, image.height, kChannelCounts[f], levels, pool);
+    stbi_image_free(image.data); // Free useless CPU memory
+
+    GLuint texID;
+    glGenTextures(1, &texID); // generate an OpenGL texture container
+    glBindTexture(GL_TEXTURE_2D, texID); // activate the texture
+    // Setup the texture filtering option and repeat mode; check www.opengl.org for details.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    TextureFile::setMipmapSampling(GL_TEXTURE_2D, levels.size());
+    // Fill the GPU texture with the levels stored in CPU memory, whose rows are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    size_t bytes = 0;
+    for (size_t l = 0; l < levels.size(); ++l) {
+        glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(l), formats[f], levels[l].width, levels[l].height, 0, formats[f], GL_UNSIGNED_BYTE, levels[l].pixels.data());
+        bytes += levels[l].pixels.size();
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0); // unbind the texture
+
+    return std::make_shared<Texture>(texID, image.width, image.height, bytes);
+}
@@ -0,0 +1,70 @@
+#ifndef _TEXTURECACHE
+#define _TEXTURECACHE
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <glad/gl.h>
+
+#include "ImageDecoder.h"
+#include "TextureFile.h"
+
+// Channels of the decoded image, converted by stb_image whatever the file holds
+enum class TextureFormat { Grey, RGB, RGBA };
+
+// 2D texture on the GPU, deleted with the last reference to it
+class Texture {
+    public:
+        Texture(GLuint id, int width, int height, size_t bytes) : id(id), width(width), height(height), bytes(bytes) {}
+        ~Texture() { glDeleteTextures(1, &id); }
+        Texture(const Texture &) = delete;
+        Texture &operator=(const Texture &) = delete;
+
+        GLuint getId() const { return id; }
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        size_t getBytes() const { return bytes; } // as uploaded, with the mip chain if any
+
+    private:
+        GLuint id;
+        int width, height;
+        size_t bytes;
+};
+
+// Textures shared by all the objects, decoded and uploaded on the first request for each path and
+// format. The cache only keeps weak references: a texture stays alive while an object holds it, and
+// is loaded again if requested after its last holder released it. A texture is uploaded from its baked
+// file if there is one the driver supports (see TextureFile), or else from its image, decoded by the
+// decoder, where it can be prefetched, with a mip chain built at load time. Both are sampled with
+// trilinear filtering.
+class TextureCache {
+    public:
+        // The mip chains of the images are built on the pool
+        TextureCache(ImageDecoder *decoder, ThreadPool *pool) : decoder(decoder), pool(pool) {}
+        void prefetch(const std::string &path, TextureFormat format); // starts decoding the image unless baked, without OpenGL
+        // Requires an OpenGL context; returns null if the file cannot be decoded
+        std::shared_ptr<const Texture> get(const std::string &path, TextureFormat format);
+        size_t getHitCount() const { return hits; }
+        size_t getMissCount() const { return misses; }
+        size_t getBakedCount() const { return baked; } // misses loaded from baked files
+        size_t getSavedBytes() const { return savedBytes; } // decoded and uploaded bytes avoided by the hits
+        size_t getTextureCount() const; // alive
+        size_t getGPUBytes() const; // of the alive textures
+
+    private:
+        static bool openBaked(const std::string &path, TextureFormat format, TextureFile &file);
+        std::shared_ptr<Texture> loadTexture(const std::string &path, TextureFormat format);
+
+    private:
+        ImageDecoder *decoder;
+        ThreadPool *pool;
+        std::map<std::pair<std::string, TextureFormat>, std::weak_ptr<Texture> > textures;
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t baked = 0;
+        size_t savedBytes = 0;
+};
+
+#endif
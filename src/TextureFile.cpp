@@ -0,0 +1,164 @@
+#include "TextureFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "BlockCompression.h"
+
+#ifndef GL_TEXTURE_MAX_ANISOTROPY
+// Core in OpenGL 4.6, same values as the EXT_texture_filter_anisotropic extension before
+#define GL_TEXTURE_MAX_ANISOTROPY 0x84FE
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY 0x84FF
+#endif
+
+static const char kMagic[4] = { 'T', 'E', 'X', 'B' };
+static const uint32_t kVersion = 2; // 2: block-compressed levels
+static const uint64_t kAlignment = 16;
+
+static uint64_t alignOffset(uint64_t offset) {
+    return (offset + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+bool TextureFile::write(const TextureFileFormat &format, const std::vector<TextureFileLevel> &levels, const std::string &path) {
+    if (levels.empty() || levels.size() > kMaxLevels)
+        return false;
+    Header header = Header(); // zero-initialized, padding included
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.levelCount = static_cast<uint32_t>(levels.size());
+    header.format = format;
+
+    std::vector<LevelRecord> records(levels.size());
+    uint64_t offset = sizeof(Header) + levels.size() * sizeof(LevelRecord);
+    for (size_t l = 0; l < levels.size(); ++l) {
+        LevelRecord &record = records[l];
+        std::memset(&record, 0, sizeof(record));
+        record.offset = alignOffset(offset);
+        record.size = levels[l].size;
+        record.width = levels[l].width;
+        record.height = levels[l].height;
+        offset = record.offset + record.size;
+    }
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(LevelRecord));
+    uint64_t written = sizeof(Header) + records.size() * sizeof(LevelRecord);
+    const char zeros[kAlignment] = {};
+    for (size_t l = 0; l < levels.size(); ++l) {
+        out.write(zeros, records[l].offset - written);
+        out.write(static_cast<const char *>(levels[l].data), records[l].size);
+        written = records[l].offset + records[l].size;
+    }
+    return static_cast<bool>(out);
+}
+
+bool TextureFile::open(const std::string &path) {
+    close();
+    if (!file.open(path))
+        return false;
+
+    // Check everything an upload relies on, so that a truncated or foreign file is rejected here
+    const size_t fileSize = file.getSize();
+    const Header *candidate = reinterpret_cast<const Header *>(file.getData());
+    bool valid = fileSize >= sizeof(Header)
+                 && std::memcmp(candidate->magic, kMagic, sizeof(kMagic)) == 0
+                 && candidate->version == kVersion
+                 && candidate->levelCount > 0 && candidate->levelCount <= kMaxLevels
+                 && fileSize >= sizeof(Header) + uint64_t(candidate->levelCount) * sizeof(LevelRecord);
+    const LevelRecord *records = reinterpret_cast<const LevelRecord *>(file.getData() + sizeof(Header));
+    for (uint32_t l = 0; valid && l < candidate->levelCount; ++l) {
+        const LevelRecord &record = records[l];
+        valid = record.width > 0 && record.height > 0
+                && record.offset % kAlignment == 0 && record.offset + record.size <= fileSize;
+    }
+    if (!valid) {
+        file.close();
+        return false;
+    }
+
+    this->header = candidate;
+    this->levels = records;
+    return true;
+}
+
+void TextureFile::close() {
+    file.close();
+    this->header = nullptr;
+    this->levels = nullptr;
+}
+
+TextureFileLevel TextureFile::getLevel(size_t level) const {
+    TextureFileLevel result;
+    result.data = file.getData() + levels[level].offset;
+    result.size = levels[level].size;
+    result.width = levels[level].width;
+    result.height = levels[level].height;
+    return result;
+}
+
+// Whether the OpenGL version of the context is at least major.minor, or it has the extension
+static bool hasFeature(GLint major, GLint minor, const char *extension) {
+    GLint contextMajor = 0, contextMinor = 0, extensionCount = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    if (contextMajor > major || (contextMajor == major && contextMinor >= minor))
+        return true;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for (GLint i = 0; i < extensionCount; ++i) {
+        if (std::strcmp(reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i)), extension) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool TextureFile::isUploadable() const {
+    if (!isCompressed())
+        return true;
+    // Queried once: GL_COMPRESSED_TEXTURE_FORMATS is no help, the drivers may leave BC7 out of it
+    static const bool supported[4] = {
+        false,
+        hasFeature(99, 0, "GL_EXT_texture_compression_s3tc"), // never core
+        hasFeature(4, 2, "GL_ARB_texture_compression_bptc"),
+        hasFeature(4, 3, "GL_ARB_ES3_compatibility")
+    };
+    const BlockFormat formats[4] = { BlockFormat::None, BlockFormat::BC1, BlockFormat::BC7, BlockFormat::ETC2 };
+    for (int f = 1; f < 4; ++f) {
+        if (header->format.internalFormat == getBlockFormatGL(formats[f]))
+            return supported[f];
+    }
+    return false;
+}
+
+void TextureFile::upload(GLenum target) const {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // the rows are tightly packed
+    for (size_t l = 0; l < getLevelCount(); ++l) {
+        const TextureFileLevel level = getLevel(l);
+        if (isCompressed())
+            glCompressedTexImage2D(target, static_cast<GLint>(l), header->format.internalFormat, level.width, level.height, 0,
+                                   static_cast<GLsizei>(level.size), level.data);
+        else
+            glTexImage2D(target, static_cast<GLint>(l), header->format.internalFormat, level.width, level.height, 0,
+                         header->format.format, header->format.type, level.data);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void TextureFile::setMipmapSampling(GLenum target, size_t levelCount) {
+    // The driver limit, 1 without the extension (the query then fails and is ignored)
+    static float maxAnisotropy = -1.0f;
+    if (maxAnisotropy < 0.0f) {
+        GLfloat supported = 1.0f;
+        glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &supported);
+        maxAnisotropy = glGetError() == GL_NO_ERROR ? std::min(kMaxAnisotropy, supported) : 1.0f;
+    }
+
+    glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levelCount - 1));
+    glTexParameteri(target, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if (maxAnisotropy > 1.0f)
+        glTexParameterf(target, GL_TEXTURE_MAX_ANISOTROPY, maxAnisotropy);
+}
@@ -0,0 +1,80 @@
+#ifndef _TEXTUREFILE
+#define _TEXTUREFILE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glad/gl.h>
+
+#include "MappedFile.h"
+
+// Pixel format of a baked texture, as given to glTexImage2D, or to glCompressedTexImage2D when format
+// and type are 0
+struct TextureFileFormat {
+    uint32_t internalFormat; // GL_RGB8..., or a block-compressed format (see BlockCompression.h)
+    uint32_t format; // GL_RGB...
+    uint32_t type; // GL_UNSIGNED_BYTE...
+    uint32_t channels; // of the source image
+};
+
+// One level of the mip chain, ready for glTexImage2D or glCompressedTexImage2D
+struct TextureFileLevel {
+    const void *data = nullptr;
+    size_t size = 0; // in bytes
+    uint32_t width = 0;
+    uint32_t height = 0;
+};
+
+// Baked texture, in the spirit of KTX2: a header giving the pixel format and the size, then the
+// whole mip chain exactly as uploaded (rows tightly packed, or blocks). The file is mapped in memory like the
+// mesh file, so that loading a texture is a mapping and one glTexImage2D per level, without any
+// decoding. It is written offline by --bake-textures next to its image (getBakedPath).
+class TextureFile {
+    public:
+        static bool write(const TextureFileFormat &format, const std::vector<TextureFileLevel> &levels, const std::string &path);
+        static std::string getBakedPath(const std::string &imagePath) { return imagePath + ".tex"; }
+
+        bool open(const std::string &path); // returns false if the file is missing or invalid
+        void close();
+        bool isOpen() const { return header != nullptr; }
+        TextureFileFormat getFormat() const { return header->format; }
+        bool isCompressed() const { return header->format.format == 0; }
+        // Whether the driver can upload the format (the block-compressed ones depend on the version and
+        // extensions); requires an OpenGL context
+        bool isUploadable() const;
+        size_t getLevelCount() const { return isOpen() ? header->levelCount : 0; }
+        TextureFileLevel getLevel(size_t level) const; // valid until close
+        size_t getFileSize() const { return file.getSize(); }
+
+        // Uploads every level to the bound texture of the target (a face for cube maps); requires an OpenGL context
+        void upload(GLenum target) const;
+        // Trilinear filtering of the bound texture of the target, with anisotropic filtering when supported
+        static void setMipmapSampling(GLenum target, size_t levelCount);
+
+        const static size_t kMaxLevels = 32;
+        constexpr static float kMaxAnisotropy = 8.0f;
+
+    private:
+        struct Header {
+            char magic[4];
+            uint32_t version;
+            uint32_t levelCount;
+            uint32_t padding;
+            TextureFileFormat format;
+        };
+        struct LevelRecord {
+            uint64_t offset; // in bytes from the start of the file, aligned to 16 bytes
+            uint64_t size;
+            uint32_t width;
+            uint32_t height;
+            uint64_t padding;
+        };
+
+    private:
+        MappedFile file;
+        const Header *header = nullptr;
+        const LevelRecord *levels = nullptr;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    if (threadCount == 0)
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 1; i < threadCount; ++i)
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    taskAvailable.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(const std::function<void()> &task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(task);
+    }
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::submitFirst(const std::function<void()> &task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_front(task);
+    }
+    taskAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return; // stopping
+            task = tasks.front();
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t, size_t)> &body) {
+    if (count == 0)
+        return;
+    const size_t threadCount = getThreadCount();
+    if (threadCount == 1 || count == 1) {
+        body(0, count);
+        return;
+    }
+
+    // A few ranges per thread, handed out dynamically to balance uneven workloads
+    const size_t rangeSize = (count + threadCount * 4 - 1) / (threadCount * 4);
+    const size_t rangeCount = (count + rangeSize - 1) / rangeSize;
+
+    // Shared with the helpers, which may only start once this call has returned, when the workers
+    // are busy with other tasks: they then find every range claimed and never touch body. So this
+    // call only waits for the ranges in progress on other threads, not for the helpers to start.
+    struct Ranges {
+        std::atomic<size_t> next;
+        size_t finishedCount; // under mutex
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    std::shared_ptr<Ranges> ranges = std::make_shared<Ranges>();
+    ranges->next = 0;
+    ranges->finishedCount = 0;
+    const std::function<void(size_t, size_t)> *bodyPointer = &body;
+    auto runRanges = [ranges, bodyPointer, count, rangeSize, rangeCount]() {
+        size_t processed = 0;
+        for (size_t r = ranges->next++; r < rangeCount; r = ranges->next++, ++processed)
+            (*bodyPointer)(r * rangeSize, std::min(count, (r + 1) * rangeSize));
+        if (processed == 0)
+            return;
+        std::lock_guard<std::mutex> lock(ranges->mutex);
+        ranges->finishedCount += processed;
+        if (ranges->finishedCount == rangeCount)
+            ranges->finished.notify_one();
+    };
+
+    // The helpers go before the queued tasks (image decodes, terrain patches...), which nobody waits for
+    const size_t helperCount = std::min(workers.size(), rangeCount - 1);
+    for (size_t i = 0; i < helperCount; ++i)
+        submitFirst(runRanges);
+    runRanges();
+
+    std::unique_lock<std::mutex> lock(ranges->mutex);
+    ranges->finished.wait(lock, [&] { return ranges->finishedCount == rangeCount; });
+}
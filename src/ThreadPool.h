@@ -0,0 +1,40 @@
+#ifndef _THREADPOOL
+#define _THREADPOOL
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads consuming a queue of tasks.
+class ThreadPool {
+    public:
+        // A thread count of 0 uses every hardware thread. The calling thread counts as one of
+        // them in parallelFor, so threadCount - 1 workers are started.
+        explicit ThreadPool(size_t threadCount);
+        ~ThreadPool();
+        size_t getThreadCount() const { return workers.size() + 1; }
+        void submit(const std::function<void()> &task);
+
+        // Calls body(begin, end) over consecutive ranges covering [0, count), on the workers and
+        // on the calling thread, and returns once every range has been processed. Helpers stuck behind
+        // other queued tasks do not hold it up: the calling thread then processes their ranges itself.
+        // The helpers are queued before the submitted tasks, to be picked by the next free worker.
+        void parallelFor(size_t count, const std::function<void(size_t, size_t)> &body);
+
+    private:
+        void submitFirst(const std::function<void()> &task); // ahead of the queued tasks
+        void workerLoop();
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+        std::condition_variable taskAvailable;
+        bool stopping = false;
+};
+
+#endif
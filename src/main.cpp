@@ -26,7 +26,17 @@
 #include "stb_image.h"
 
 #include "CelestialObject.h"
+#include "OrbitalState.h"
+#include "SimulationClock.h"
+#include "SceneHierarchy.h"
+#include "Ephemeris.h"
+#include "NBodySystem.h"
+#include "SnapshotRing.h"
+#include "ThreadPool.h"
 #include "Skybox.h"
+#include "AsteroidBelt.h"
+#include "Benchmark.h"
+#include "TextureBaker.h"
 
 #include <cstdlib>
 #include <iostream>
@@ -35,6 +45,10 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
 
 // constants
 const static float kSizeSun = 1;
@@ -48,6 +62,11 @@ const static float kRadOrbitMoon = 2;
 const static float kRadOrbitMars = 15;
 const static float kRadOrbitJupiter = 20;
 
+const static float kEccentricityEarth = 0.0167;
+const static float kEccentricityMoon = 0.0549;
+const static float kEccentricityMars = 0.0934;
+const static float kEccentricityJupiter = 0.0489;
+
 const static float kOrbitPeriodEarth = 365;
 const static float kOrbitPeriodMoon = 28;
 const static float kOrbitPeriodMars = 687;
@@ -64,15 +83,100 @@ const static float kInclinationAngleMoon = glm::radians(5.14f);
 const static float kInclinationAngleMars = glm::radians(25.19f);
 const static float kInclinationAngleJupiter = glm::radians(3.13f);
 
+// Icospheres, which are as accurate as UV spheres with half the triangles (see --bench-sphere-error).
+// Each object draws the coarsest level of detail, from this resolution down, that looks right on the screen.
+const static SphereType kSphereType = SphereType::Ico;
+const static size_t kSphereResolution = 320;
+
+// Close up, the planets turn into terrains, with mountains up to this fraction of their radius
+const static float kTerrainHeightScale = 0.01f;
+
+// Camera: each dolly step moves by this factor, and the near plane shrinks down to kMinNear
+// near the surfaces (half the altitude), for the terrains
+const static float kDollyFactor = 1.1f;
+const static float kMinNear = 1e-5f;
+const static float kMaxNear = 0.1f;
+
+// Masses used by the gravitational simulation mode, relative to the Sun. The distances and periods
+// of the scene are not realistic, so each orbit is kept by a binding to its parent, derived from its
+// kinematic radius and period (see NBodySystem::loadFromOrbits): pressing G keeps the same orbits,
+// and the masses only set the perturbations of the bodies on each other.
+const static double kMassSun = 1;
+const static double kMassEarth = 3.0e-6;
+const static double kMassMoon = 3.7e-8;
+const static double kMassMars = 3.2e-7;
+const static double kMassJupiter = 9.5e-4;
+
+// Chosen so that the Earth keeps its period around the Sun (Kepler's third law, with the periods divided by 10)
+const static double kGravitationalConstant = 4 * M_PI * M_PI * std::pow(kRadOrbitEarth, 3) / std::pow(0.1 * kOrbitPeriodEarth, 2) / kMassSun;
+
+const static double kSimulationTimeStep = 1.0 / 120.0; // simulated seconds per step
+
+// Asteroid belt between the orbits of Mars and Jupiter, clear of the two planets.
+// The B key cycles through the particle counts.
+const static float kBeltInnerRadius = kRadOrbitMars + 1.0f;
+const static float kBeltOuterRadius = kRadOrbitJupiter - 2.0f;
+const static size_t kBeltParticleCounts[] = { 0, 10000, 100000, 1000000 };
+const static size_t kDefaultBeltParticleCount = 100000;
+
+// Precomputed orbits, rebuilt at startup when missing or when the orbits above change
+const static char *kEphemerisPath = "ephemeris.bin";
+const static double kEphemerisSpan = 100 * 0.1 * kOrbitPeriodEarth; // 100 orbits of the Earth
+const static double kSeekDuration = 10 * 0.1 * kOrbitPeriodEarth; // jump of the [ and ] keys
+
+// Sphere meshes as uploaded, written after the first launch and then mapped instead of generated
+const static char *kMeshCachePath = "meshes.bin";
+
+// Snapshots of the gravitational simulation, to seek back in time: one per simulated second,
+// the oldest ones being spilled to a file beyond the capacity of the ring
+const static double kSnapshotInterval = 1.0;
+const static size_t kSnapshotCapacity = 600;
+const static int kSnapshotKeyframeInterval = 10;
+const static char *kSnapshotSpillPath = "snapshots.bin";
+
 // Model transformation matrices
 glm::mat4 g_sun, g_earth, g_moon;
 
 // Meshes array
 std::vector<CelestialObject*> g_celestialObjects;
 
+// Sphere meshes, shared by the celestial objects of the same resolution
+SphereMeshCache* g_sphereMeshes = nullptr;
+
+// Images decoded on the workers from the start, and the textures uploaded from them, shared by the
+// celestial objects of the same image
+ImageDecoder* g_imageDecoder = nullptr;
+TextureCache* g_textures = nullptr;
+
+// Orbits of all the celestial objects, advanced together once per simulation step
+OrbitalState g_orbitalState;
+
+// Orbit frames of the celestial objects, with the same indices as in g_orbitalState
+SceneHierarchy g_sceneHierarchy;
+
+// Positions of the kinematic mode, looked up in the precomputed tables when they cover the time
+Ephemeris g_ephemeris;
+
+// Fixed-timestep clock driving the simulation independently of the frame rate
+SimulationClock g_simulationClock(kSimulationTimeStep, 1.0);
+
+// The bodies either follow their orbits (kinematic mode) or the gravitational forces (gravity mode)
+enum class SimulationMode { Kinematic, Gravity };
+SimulationMode g_simulationMode = SimulationMode::Kinematic;
+ThreadPool* g_threadPool;
+NBodySystem* g_nbodySystem;
+SnapshotRing* g_snapshots;
+double g_nextSnapshotTime = 0.0;
+
+void setSimulationMode(SimulationMode mode);
+void seekSimulation(double time);
+void createSolarSystem();
+
 // Skybox
 Skybox* g_skybox;
 
+AsteroidBelt* g_asteroidBelt;
+
 bool arrowUpPressed = false;
 bool arrowDownPressed = false;
 bool arrowRightPressed = false;
@@ -85,6 +189,8 @@ GLFWwindow *g_window = nullptr;
 GLuint g_program = 0; // A GPU program contains at least a vertex shader and a fragment shader
 GLuint l_program = 0; // A GPU program for the light objects
 GLuint s_program = 0; // A GPU program for the skybox
+GLuint b_program = 0; // A GPU program for the asteroid belt
+GLuint i_program = 0; // A GPU program for the sphere impostors
 
 // OpenGL identifiers
 GLuint g_vao = 0;
@@ -93,11 +199,14 @@ GLuint g_ibo = 0;
 
 // Basic camera model
 Camera g_camera;
+// Index in g_celestialObjects of the object the camera looks at; its position is relative to that object
+size_t g_cameraTarget = 0;
 
 
 // Executed each time the window is resized. Adjust the aspect ratio and the rendering viewport to the current window.
 void windowSizeCallback(GLFWwindow* window, int width, int height) {
   g_camera.setAspectRatio(static_cast<float>(width)/static_cast<float>(height));
+  g_camera.setViewportHeight(static_cast<float>(height));
   glViewport(0, 0, (GLint)width, (GLint)height); // Dimension of the rendering region in the window
 }
 
@@ -108,6 +217,31 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
   } else if(action == GLFW_PRESS && key == GLFW_KEY_F) {
       std::cout << "F pressed" << std::endl;
       glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  } else if(action == GLFW_PRESS && key == GLFW_KEY_G) {
+      setSimulationMode(g_simulationMode == SimulationMode::Kinematic ? SimulationMode::Gravity : SimulationMode::Kinematic);
+  } else if(action == GLFW_PRESS && key == GLFW_KEY_B) {
+      const size_t countCount = sizeof(kBeltParticleCounts) / sizeof(kBeltParticleCounts[0]);
+      size_t next = 0;
+      while (next < countCount && kBeltParticleCounts[next] <= g_asteroidBelt->getParticleCount())
+        ++next;
+      g_asteroidBelt->setParticleCount(kBeltParticleCounts[next % countCount]);
+      std::cout << "Asteroid belt: " << g_asteroidBelt->getParticleCount() << " particles" << std::endl;
+  } else if(action == GLFW_PRESS && key == GLFW_KEY_T) {
+      g_cameraTarget = (g_cameraTarget + 1) % g_celestialObjects.size();
+      std::cout << "Camera target: object " << g_cameraTarget << std::endl;
+  } else if(action == GLFW_PRESS && key == GLFW_KEY_P) {
+      const bool procedural = !g_celestialObjects[0]->isProcedural();
+      for (CelestialObject *o : g_celestialObjects)
+        o->setProcedural(procedural);
+      std::cout << (procedural ? "Procedural spheres" : "Sphere meshes") << std::endl;
+  } else if(action != GLFW_RELEASE && (key == GLFW_KEY_EQUAL || key == GLFW_KEY_MINUS)) {
+      // Down to just above the surface of the target, where its terrain shows
+      const float minDistance = 1.0002f * g_celestialObjects[g_cameraTarget]->getRadius();
+      g_camera.dolly(key == GLFW_KEY_EQUAL ? 1.0f / kDollyFactor : kDollyFactor, minDistance);
+  } else if(action == GLFW_PRESS && key == GLFW_KEY_LEFT_BRACKET) {
+      seekSimulation(std::max(0.0, g_simulationClock.getTime() - kSeekDuration));
+  } else if(action == GLFW_PRESS && key == GLFW_KEY_RIGHT_BRACKET) {
+      seekSimulation(g_simulationClock.getTime() + kSeekDuration);
   } else if(action == GLFW_PRESS && (key == GLFW_KEY_ESCAPE || key == GLFW_KEY_Q)) {
       glfwSetWindowShouldClose(window, true); // Closes the application if the escape key is pressed
   }
@@ -255,27 +389,56 @@ void initGPUprograms() {
   loadShader(s_program, GL_FRAGMENT_SHADER, "shaders/skyboxFragmentShader.glsl");
   glLinkProgram(s_program); // The main GPU program is ready to be handle streams of polygons
 
+  b_program = glCreateProgram();
+  loadShader(b_program, GL_VERTEX_SHADER, "shaders/beltVertexShader.glsl");
+  loadShader(b_program, GL_FRAGMENT_SHADER, "shaders/beltFragmentShader.glsl");
+  glLinkProgram(b_program);
+
+  i_program = glCreateProgram();
+  loadShader(i_program, GL_VERTEX_SHADER, "shaders/impostorVertexShader.glsl");
+  loadShader(i_program, GL_FRAGMENT_SHADER, "shaders/impostorFragmentShader.glsl");
+  glLinkProgram(i_program);
+
 }
 
 void initCamera() {
   int width, height;
   glfwGetWindowSize(g_window, &width, &height);
   g_camera.setAspectRatio(static_cast<float>(width)/static_cast<float>(height));
+  g_camera.setViewportHeight(static_cast<float>(height));
 
   g_camera.setPosition(glm::vec3(0.0, 50.0, 70.0));
-  g_camera.setNear(0.1);
+  g_camera.setNear(kMaxNear);
   g_camera.setFar(200.1);
 }
 
+// Starts decoding every image of the scene on the workers, so that the decoding overlaps the rest
+// of the startup and the OpenGL thread mostly uploads
+void prefetchImages() {
+  for (CelestialObject* o : g_celestialObjects)
+    o->prefetchImages(g_textures, g_imageDecoder);
+  g_skybox->prefetchImages(g_imageDecoder);
+}
+
 void init() {
   initGLFW();
   initOpenGL();
   initCamera();
 
+  g_sphereMeshes->load(kMeshCachePath);
   for (CelestialObject* o : g_celestialObjects) {
-    o->init();
+    o->init(g_sphereMeshes, g_textures, g_imageDecoder);
   }
-  g_skybox->init();
+  std::cout << g_celestialObjects.size() << " objects share " << g_sphereMeshes->getMeshCount() << " sphere meshes ("
+            << g_sphereMeshes->getGPUBytes() / 1024 << " KiB), " << g_sphereMeshes->getLoadedMeshCount()
+            << " loaded from " << kMeshCachePath << std::endl;
+  if (!g_sphereMeshes->save(kMeshCachePath))
+    std::cerr << "WARNING: cannot write " << kMeshCachePath << ", the sphere meshes will be generated at every launch" << std::endl;
+  g_skybox->init(g_imageDecoder, g_threadPool);
+  g_asteroidBelt->init();
+  std::cout << g_imageDecoder->getDecodedCount() << " images decoded on " << g_threadPool->getThreadCount() << " threads: "
+            << 1e3 * g_imageDecoder->getTotalDecodeTime() << " ms in total, the longest " << 1e3 * g_imageDecoder->getLongestDecodeTime()
+            << " ms, waited for " << 1e3 * g_imageDecoder->getWaitTime() << " ms" << std::endl;
 
   initGPUprograms();
 }
@@ -283,48 +446,440 @@ void init() {
 void clear() {
   glDeleteProgram(g_program);
   glDeleteProgram(l_program);
+  glDeleteProgram(s_program);
+  glDeleteProgram(b_program);
+  glDeleteProgram(i_program);
+
+  std::cout << "Texture cache: " << g_textures->getHitCount() << " hits, " << g_textures->getMissCount() << " misses ("
+            << g_textures->getBakedCount() << " baked), "
+            << g_textures->getSavedBytes() / 1024 << " KiB of decoding and upload saved, "
+            << g_textures->getTextureCount() << " textures (" << g_textures->getGPUBytes() / 1024 << " KiB)" << std::endl;
 
   glfwDestroyWindow(g_window);
   glfwTerminate();
 }
 
+// Puts the simulation in its initial state, the previous state being the same as the latest one
+void initSimulation() {
+  for (size_t i = 0; i < g_orbitalState.size(); ++i)
+    g_sceneHierarchy.addNode(g_orbitalState.getParent(i));
+
+  g_orbitalState.update(0.0);
+  g_orbitalState.update(0.0);
+}
+
+// Maps the ephemeris tables, after building them if they do not match the orbits of the scene
+void initEphemeris() {
+  if (g_ephemeris.open(kEphemerisPath) && g_ephemeris.matches(g_orbitalState))
+    return;
+  g_ephemeris.close();
+  std::cout << "Building " << kEphemerisPath << "..." << std::endl;
+  if (!Ephemeris::write(g_orbitalState, 0.0, kEphemerisSpan, 8, 12, kEphemerisPath) || !g_ephemeris.open(kEphemerisPath))
+    std::cerr << "WARNING: cannot write " << kEphemerisPath << ", the orbits will be computed at every step" << std::endl;
+}
+
+bool useEphemeris(double time) {
+  return g_simulationMode == SimulationMode::Kinematic && g_ephemeris.covers(time);
+}
+
+// Moves the orbit frames to the positions interpolated between the last two simulation steps,
+// or to the positions of the ephemeris at the given time when it can be used
+void updateSceneTransforms(float alpha, double time) {
+  for (size_t i = 0; i < g_orbitalState.size(); ++i) {
+    glm::dvec3 localPosition;
+    if (g_simulationMode == SimulationMode::Gravity) {
+      // The gravitational simulation gives absolute positions: make them relative to the parent
+      const int parent = g_orbitalState.getParent(i);
+      localPosition = g_nbodySystem->getInterpolatedPosition(i, alpha);
+      if (parent != OrbitalState::kNoParent)
+        localPosition -= g_nbodySystem->getInterpolatedPosition(parent, alpha);
+    } else if (useEphemeris(time)) {
+      localPosition = g_ephemeris.getPosition(i, time);
+    } else {
+      localPosition = g_orbitalState.getInterpolatedPosition(i, alpha);
+    }
+    g_sceneHierarchy.setLocalTransform(i, glm::translate(glm::dmat4(1.0), localPosition));
+  }
+  g_sceneHierarchy.propagate();
+}
+
+// Switches between the kinematic orbits and the gravitational simulation, starting from the current state
+void setSimulationMode(SimulationMode mode) {
+  g_orbitalState.update(g_simulationClock.getTime());
+  g_orbitalState.update(g_simulationClock.getTime());
+  if (mode == SimulationMode::Gravity) {
+    g_nbodySystem->loadFromOrbits(g_orbitalState);
+    g_snapshots->clear(); // a new timeline starts
+    g_snapshots->record(g_simulationClock.getTime(), *g_nbodySystem);
+    g_nextSnapshotTime = g_simulationClock.getTime() + kSnapshotInterval;
+    std::cout << "Gravity mode (" << g_threadPool->getThreadCount() << " threads)" << std::endl;
+  } else {
+    std::cout << "Kinematic mode" << std::endl;
+  }
+  g_simulationMode = mode;
+}
+
+// Advances the simulation by one fixed step, the clock having already been moved forward
+void stepSimulation() {
+  if (g_simulationMode == SimulationMode::Gravity) {
+    g_nbodySystem->step(g_simulationClock.getTimeStep());
+    if (g_simulationClock.getTime() >= g_nextSnapshotTime - 0.5 * g_simulationClock.getTimeStep()) {
+      g_snapshots->record(g_simulationClock.getTime(), *g_nbodySystem);
+      g_nextSnapshotTime += kSnapshotInterval;
+    }
+  } else if (!useEphemeris(g_simulationClock.getTime()))
+    g_orbitalState.update(g_simulationClock.getTime());
+}
+
+// Jumps to another time. The gravitational simulation restarts from the latest snapshot before
+// that time, if going backward, then is integrated up to it.
+void seekSimulation(double time) {
+  if (g_simulationMode == SimulationMode::Gravity) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double snapshotTime;
+    if (time < g_simulationClock.getTime()) {
+      if (!g_snapshots->restore(time, *g_nbodySystem, snapshotTime)) {
+        std::cout << "No snapshot before " << time << " s" << std::endl;
+        return;
+      }
+      g_simulationClock.seek(snapshotTime);
+      g_nextSnapshotTime = snapshotTime + kSnapshotInterval;
+    }
+    unsigned long stepCount = 0;
+    for (; g_simulationClock.getTime() < time - 0.5 * g_simulationClock.getTimeStep(); ++stepCount) {
+      g_simulationClock.step();
+      stepSimulation();
+    }
+    g_simulationClock.seek(g_simulationClock.getTime()); // drops the pending real time
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Time: " << g_simulationClock.getTime() << " s (" << stepCount << " steps integrated in " << elapsed << " s)" << std::endl;
+    return;
+  }
+  g_simulationClock.seek(time);
+  g_orbitalState.update(time);
+  g_orbitalState.update(time);
+  std::cout << "Time: " << time << " s" << std::endl;
+}
+
+// Advances the simulation by as many fixed steps as the real time elapsed since the previous frame allows
+void updateSimulation(double frameSeconds) {
+  g_simulationClock.addRealTime(frameSeconds);
+  while (g_simulationClock.consumeStep())
+    stepSimulation();
+}
+
+// Floating origin: the world transforms are kept in double precision, and only their position
+// relative to the camera is converted to float for the GPU, so that it stays accurate near the camera
+glm::mat4 toCameraRelative(const glm::dmat4 &world, const glm::dvec3 &cameraPosition) {
+  glm::dmat4 relative = world;
+  relative[3] = glm::dvec4(glm::dvec3(world[3]) - cameraPosition, 1.0);
+  return glm::mat4(relative);
+}
+
 // The main rendering call
 void render() {
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Erase the color and z buffers.
 
+  // Display the state between the last two simulation steps matching the current real time
+  const double time = g_simulationClock.getInterpolatedTime();
+  updateSceneTransforms(g_simulationClock.getAlpha(), time);
+
+  // The camera orbits its target; the near plane follows the closest surface, to fly down to it
+  const glm::dvec3 cameraPosition = glm::dvec3(g_sceneHierarchy.getWorldTransform(g_celestialObjects[g_cameraTarget]->getOrbitIndex())[3])
+                                    + glm::dvec3(g_camera.getPosition());
+  double altitude = g_camera.getFar();
+  for(CelestialObject* o : g_celestialObjects) {
+      const glm::dvec3 center(g_sceneHierarchy.getWorldTransform(o->getOrbitIndex())[3]);
+      altitude = std::min(altitude, glm::length(center - cameraPosition) - o->getRadius());
+  }
+  g_camera.setNear(glm::clamp(0.5f * static_cast<float>(altitude), kMinNear, kMaxNear));
+
   g_skybox->render(s_program, g_camera);
 
+  // The Sun lights the planets and is the center of the asteroid belt
+  glm::vec3 sunPosition(0.0f);
   for(CelestialObject* o : g_celestialObjects) {
+      if (o->getType() == CelestialType::Star)
+          sunPosition = glm::vec3(glm::dvec3(g_sceneHierarchy.getWorldTransform(o->getOrbitIndex())[3]) - cameraPosition);
+  }
+  glUseProgram(g_program);
+  glUniform3f(glGetUniformLocation(g_program, "lightPos"), sunPosition.x, sunPosition.y, sunPosition.z);
+  glUseProgram(i_program);
+  glUniform3f(glGetUniformLocation(i_program, "lightPos"), sunPosition.x, sunPosition.y, sunPosition.z);
+
+  for(CelestialObject* o : g_celestialObjects) {
+      const glm::mat4 orbitFrame = toCameraRelative(g_sceneHierarchy.getWorldTransform(o->getOrbitIndex()), cameraPosition);
       if (o->getType() == CelestialType::Star) {
-          o->render(l_program, g_camera);
+          o->render(l_program, i_program, g_camera, orbitFrame, time);
       } else if (o->getType() == CelestialType::Planet) {
-          o->render(g_program, g_camera);
+          o->render(g_program, i_program, g_camera, orbitFrame, time);
       }
   }
+
+  // The belt is purely visual: it is computed at the displayed time rather than stepped
+  g_asteroidBelt->update(time, *g_threadPool);
+  g_asteroidBelt->render(b_program, g_camera, sunPosition);
 }
 
-int main(int argc, char ** argv) {
+// Runs the simulation without any window, as fast as possible, for the given simulated duration
+void runHeadless(double duration) {
+  const unsigned long stepCount = (unsigned long) (duration / g_simulationClock.getTimeStep());
+  const bool gravity = g_simulationMode == SimulationMode::Gravity;
+  const double initialEnergy = gravity ? g_nbodySystem->computeTotalEnergy() : 0.0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < stepCount; ++i) {
+    g_simulationClock.step();
+    stepSimulation();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << "Simulated " << g_simulationClock.getTime() << " s in " << stepCount << " steps and " << elapsed << " s ("
+            << g_simulationClock.getTime() / elapsed << "x real time)" << std::endl;
+  if (gravity) {
+    const double energy = g_nbodySystem->computeTotalEnergy();
+    std::cout << "Energy drift: " << std::abs((energy - initialEnergy) / initialEnergy) << " ("
+              << g_nbodySystem->getForceEvaluationCount() << " force evaluations)" << std::endl;
+  }
+  updateSceneTransforms(1.0f, g_simulationClock.getTime());
+  for (size_t i = 0; i < g_orbitalState.size(); ++i) {
+    glm::dvec3 p = glm::dvec3(g_sceneHierarchy.getWorldTransform(i)[3]);
+    std::cout << "  body " << i << ": " << p.x << ", " << p.y << ", " << p.z << std::endl;
+  }
+}
+
+// Images of the created scene: the skybox faces, then the textures of the objects
+std::vector<std::string> getSceneImages() {
+  std::vector<std::string> paths = g_skybox->getFaces();
+  for (CelestialObject* o : g_celestialObjects) {
+    if (std::find(paths.begin(), paths.end(), o->getTexturePath()) == paths.end())
+      paths.push_back(o->getTexturePath());
+  }
+  return paths;
+}
+
+// Runs the benchmark requested on the command line, if any. Returns false when no benchmark was requested.
+bool runBenchmarks(const std::string &option, int argc, char ** argv) {
+  if (option == "--bench-orbits") {
+    size_t bodyCount = argc > 2 ? std::max(1L, std::atol(argv[2])) : 100000;
+    int frameCount = argc > 3 ? std::max(1, std::atoi(argv[3])) : 100;
+    benchOrbitalState(bodyCount, frameCount);
+  } else if (option == "--bench-kepler") {
+    size_t bodyCount = argc > 2 ? std::max(1L, std::atol(argv[2])) : 1000000;
+    int repeatCount = argc > 3 ? std::max(1, std::atoi(argv[3])) : 20;
+    if (!benchKeplerSolver(bodyCount, repeatCount))
+      std::exit(EXIT_FAILURE);
+  } else if (option == "--bench-nbody") {
+    size_t bodyCount = argc > 2 ? std::max(2L, std::atol(argv[2])) : 100000;
+    int stepCount = argc > 3 ? std::max(1, std::atoi(argv[3])) : 10;
+    size_t maxThreads = argc > 4 ? std::max(1, std::atoi(argv[4])) : std::max(1u, std::thread::hardware_concurrency());
+    benchNBody(bodyCount, stepCount, maxThreads);
+  } else if (option == "--bench-timesteps") {
+    size_t bodyCount = argc > 2 ? std::max(2L, std::atol(argv[2])) : 10000;
+    int stepCount = argc > 3 ? std::max(1, std::atoi(argv[3])) : 100;
+    benchTimesteps(bodyCount, stepCount);
+  } else if (option == "--bench-belt") {
+    size_t particleCount = argc > 2 ? std::max(10000L, std::atol(argv[2])) : 1000000;
+    int frameCount = argc > 3 ? std::max(1, std::atoi(argv[3])) : 100;
+    benchAsteroidBelt(particleCount, frameCount);
+  } else if (option == "--bench-snapshots") {
+    size_t bodyCount = argc > 2 ? std::max(2L, std::atol(argv[2])) : 1000;
+    int snapshotCount = argc > 3 ? std::max(1, std::atoi(argv[3])) : 100;
+    if (!benchSnapshots(bodyCount, snapshotCount))
+      std::exit(EXIT_FAILURE);
+  } else if (option == "--bench-ephemeris") {
+    size_t bodyCount = argc > 2 ? std::max(2L, std::atol(argv[2])) : 1000;
+    size_t lookupCount = argc > 3 ? std::max(1L, std::atol(argv[3])) : 1000;
+    if (!benchEphemeris(bodyCount, lookupCount))
+      std::exit(EXIT_FAILURE);
+  } else if (option == "--bench-spheres") {
+    size_t maxResolution = argc > 2 ? std::max(64L, std::atol(argv[2])) : 4096;
+    int repeatCount = argc > 3 ? std::max(1, std::atoi(argv[3])) : 5;
+    if (!benchSphereGeneration(maxResolution, repeatCount))
+      std::exit(EXIT_FAILURE);
+  } else if (option == "--bench-sphere-error") {
+    size_t maxResolution = argc > 2 ? std::max(25L, std::atol(argv[2])) : 800;
+    benchSphereError(maxResolution);
+  } else if (option == "--bench-vertex-format") {
+    size_t maxResolution = argc > 2 ? std::max(20L, std::atol(argv[2])) : 640;
+    benchVertexFormat(maxResolution);
+  } else if (option == "--bench-mesh-optimizer") {
+    size_t maxResolution = argc > 2 ? std::max(20L, std::atol(argv[2])) : 640;
+    if (!benchMeshOptimizer(maxResolution))
+      std::exit(EXIT_FAILURE);
+  } else if (option == "--bench-mesh-cache") {
+    size_t maxResolution = argc > 2 ? std::max(20L, std::atol(argv[2])) : 320;
+    if (!benchMeshCache(maxResolution))
+      std::exit(EXIT_FAILURE);
+  } else if (option == "--bench-image-decoding") {
+    size_t threadCount = argc > 2 ? std::atol(argv[2]) : 0;
+    createSolarSystem(); // for the paths of its images
+    if (!benchImageDecoding(getSceneImages(), threadCount))
+      std::exit(EXIT_FAILURE);
+  } else if (option == "--bench-mip-generation") {
+    size_t size = argc > 2 ? std::max(16L, std::atol(argv[2])) : 2048;
+    size_t threadCount = argc > 3 ? std::atol(argv[3]) : 0;
+    if (!benchMipGeneration(size, threadCount))
+      std::exit(EXIT_FAILURE);
+  } else if (option == "--bench-block-compression") {
+    size_t threadCount = argc > 2 ? std::atol(argv[2]) : 0;
+    createSolarSystem(); // for the paths of its images
+    if (!benchBlockCompression(getSceneImages(), threadCount))
+      std::exit(EXIT_FAILURE);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Bakes the given images, or else those of the scene, next to them (see TextureFile), as RGB like the
+// texture loaders. Returns false if one of them fails.
+bool bakeTextures(int argc, char ** argv) {
+  // BC1 unless another block format is given first, the scene images unless others are given
+  BlockFormat format = BlockFormat::BC1;
+  int first = 2;
+  if (argc > 3 && std::string(argv[2]) == "--format") {
+    if (!parseBlockFormat(argv[3], format)) {
+      std::cerr << "ERROR: unknown block format " << argv[3] << " (none, bc1, bc7 or etc2)" << std::endl;
+      return false;
+    }
+    first = 4;
+  }
+  std::vector<std::string> paths(argv + first, argv + argc);
+  if (paths.empty()) {
+    createSolarSystem();
+    paths = getSceneImages();
+  }
+  ThreadPool pool(0);
+  bool baked = true;
+  for (const std::string &path : paths) {
+    BakeResult result;
+    if (!bakeTexture(path, 3, format, TextureFile::getBakedPath(path), &pool, result)) {
+      std::cerr << "ERROR: cannot bake " << path << std::endl;
+      baked = false;
+      continue;
+    }
+    std::cout << TextureFile::getBakedPath(path) << ": " << result.width << "x" << result.height << ", " << result.levelCount
+              << " levels, " << getBlockFormatName(result.format) << ", " << result.bakedBytes / 1024 << " KiB, ";
+    if (result.format != BlockFormat::None)
+      std::cout << "PSNR " << result.psnr << " dB, encoded in " << 1e3 * result.encodeSeconds << " ms, ";
+    std::cout << 1e3 * result.seconds << " ms" << std::endl;
+  }
+  return baked;
+}
 
+void printUsage(const char *program) {
+  std::cerr << "Usage: " << program << " [--headless [seconds] [gravity]"
+            << " | --bake-textures [--format none|bc1|bc7|etc2] [images]"
+            << " | --bench-orbits [bodies] [frames]"
+            << " | --bench-kepler [bodies] [repeats]"
+            << " | --bench-nbody [bodies] [steps] [threads]"
+            << " | --bench-timesteps [bodies] [steps]"
+            << " | --bench-ephemeris [bodies] [lookups]"
+            << " | --bench-belt [particles] [frames]"
+            << " | --bench-snapshots [bodies] [snapshots]"
+            << " | --bench-spheres [resolution] [repeats]"
+            << " | --bench-sphere-error [resolution]"
+            << " | --bench-vertex-format [resolution]"
+            << " | --bench-mesh-optimizer [resolution]"
+            << " | --bench-mesh-cache [resolution]"
+            << " | --bench-image-decoding [threads]"
+            << " | --bench-mip-generation [size] [threads]"
+            << " | --bench-block-compression [threads]]" << std::endl;
+}
+
+void createSolarSystem() {
     g_skybox = new Skybox();
 
-    CelestialObject* sun = new CelestialObject(kSizeSun, kRotationPeriodSun, (size_t) 100, "media/sun-2.jpg", CelestialType::Star);
+    CelestialObject* sun = new CelestialObject(&g_orbitalState, kSizeSun, kRotationPeriodSun, kSphereResolution, "media/sun-2.jpg", CelestialType::Star);
     g_celestialObjects.push_back(sun);
 
-    CelestialObject* mars = new CelestialObject(kSizeMars, sun, kRadOrbitMars, kOrbitPeriodMars, kRotationPeriodMars,  kInclinationAngleMars, (size_t) 100, "media/mars.jpeg", CelestialType::Planet);
+    CelestialObject* mars = new CelestialObject(&g_orbitalState, kSizeMars, sun, kRadOrbitMars, kEccentricityMars, kOrbitPeriodMars, kRotationPeriodMars,  kInclinationAngleMars, kSphereResolution, "media/mars.jpeg", CelestialType::Planet);
     g_celestialObjects.push_back(mars);
 
-    CelestialObject* jupiter = new CelestialObject(kSizeJupiter, sun, kRadOrbitJupiter, kOrbitPeriodJupiter, kRotationPeriodJupiter,  kInclinationAngleJupiter, (size_t) 100, "media/jupiter.jpg", CelestialType::Planet);
+    CelestialObject* jupiter = new CelestialObject(&g_orbitalState, kSizeJupiter, sun, kRadOrbitJupiter, kEccentricityJupiter, kOrbitPeriodJupiter, kRotationPeriodJupiter,  kInclinationAngleJupiter, kSphereResolution, "media/jupiter.jpg", CelestialType::Planet);
     g_celestialObjects.push_back(jupiter);
 
-    CelestialObject* earth = new CelestialObject(kSizeEarth, sun, kRadOrbitEarth, kOrbitPeriodEarth, kRotationPeriodEarth,  kInclinationAngleEarth, (size_t) 100, "media/earth.jpg", CelestialType::Planet);
+    CelestialObject* earth = new CelestialObject(&g_orbitalState, kSizeEarth, sun, kRadOrbitEarth, kEccentricityEarth, kOrbitPeriodEarth, kRotationPeriodEarth,  kInclinationAngleEarth, kSphereResolution, "media/earth.jpg", CelestialType::Planet);
     g_celestialObjects.push_back(earth);
 
-    CelestialObject* moon = new CelestialObject(kSizeMoon, earth, kRadOrbitMoon, kOrbitPeriodMoon, kRotationPeriodMoon, kInclinationAngleMoon, (size_t) 100, "media/moon.jpg", CelestialType::Planet);
+    CelestialObject* moon = new CelestialObject(&g_orbitalState, kSizeMoon, earth, kRadOrbitMoon, kEccentricityMoon, kOrbitPeriodMoon, kRotationPeriodMoon, kInclinationAngleMoon, kSphereResolution, "media/moon.jpg", CelestialType::Planet);
     g_celestialObjects.push_back(moon);
 
+    for (CelestialObject* o : g_celestialObjects) {
+        o->setSphereType(kSphereType);
+        if (o->getType() == CelestialType::Planet)
+            o->enableTerrain(g_threadPool, kTerrainHeightScale);
+    }
+
+    g_asteroidBelt = new AsteroidBelt(kBeltInnerRadius, kBeltOuterRadius, kRadOrbitEarth, kOrbitPeriodEarth);
+    g_asteroidBelt->setParticleCount(kDefaultBeltParticleCount);
+
+    g_orbitalState.setMass(sun->getOrbitIndex(), kMassSun);
+    g_orbitalState.setMass(mars->getOrbitIndex(), kMassMars);
+    g_orbitalState.setMass(jupiter->getOrbitIndex(), kMassJupiter);
+    g_orbitalState.setMass(earth->getOrbitIndex(), kMassEarth);
+    g_orbitalState.setMass(moon->getOrbitIndex(), kMassMoon);
+}
+
+int main(int argc, char ** argv) {
+
+    const std::string option = argc > 1 ? argv[1] : "";
+    if (runBenchmarks(option, argc, argv))
+        return EXIT_SUCCESS;
+    if (option == "--bake-textures")
+        return bakeTextures(argc, argv) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if (!option.empty() && option != "--headless") {
+        std::cerr << "Unknown option " << option << std::endl;
+        printUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    g_threadPool = new ThreadPool(0);
+    g_nbodySystem = new NBodySystem(g_threadPool, kGravitationalConstant);
+    g_sphereMeshes = new SphereMeshCache(g_threadPool);
+    g_imageDecoder = new ImageDecoder(g_threadPool);
+    g_textures = new TextureCache(g_imageDecoder, g_threadPool);
+    g_snapshots = new SnapshotRing(kSnapshotCapacity, kSnapshotKeyframeInterval);
+    if (!g_snapshots->enableSpill(kSnapshotSpillPath))
+      std::cerr << "WARNING: cannot write " << kSnapshotSpillPath << ", the oldest snapshots will be dropped" << std::endl;
+
+    createSolarSystem();
+    if (option != "--headless")
+        prefetchImages();
+    initSimulation();
+    initEphemeris();
+
+    if (option == "--headless") {
+        if (argc > 3 && std::string(argv[3]) == "gravity")
+            setSimulationMode(SimulationMode::Gravity);
+        runHeadless(argc > 2 ? std::atof(argv[2]) : 3600.0);
+        return EXIT_SUCCESS;
+    }
+
   init(); // Your initialization code (user interface, OpenGL states, scene with geometry, material, lights, etc)
 
+  double lastFrameTime = glfwGetTime();
+  double lastTitleTime = lastFrameTime;
+  int titleFrames = 0;
   while(!glfwWindowShouldClose(g_window)) {
+    double now = glfwGetTime();
+    updateSimulation(now - lastFrameTime);
+    lastFrameTime = now;
+
+    // Average frame time, shown in the title bar every second
+    ++titleFrames;
+    if (now - lastTitleTime >= 1.0) {
+      std::ostringstream title;
+      size_t triangleCount = 0;
+      for (CelestialObject* o : g_celestialObjects)
+        triangleCount += o->getDrawnTriangleCount();
+      title << "Simple Solar System - " << 1000.0 * (now - lastTitleTime) / titleFrames << " ms/frame, "
+            << triangleCount << " triangles, " << g_asteroidBelt->getParticleCount() << " asteroids";
+      glfwSetWindowTitle(g_window, title.str().c_str());
+      lastTitleTime = now;
+      titleFrames = 0;
+    }
+
     render();
     glfwSwapBuffers(g_window);
     updateCameraRotation();
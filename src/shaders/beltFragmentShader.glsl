@@ -0,0 +1,12 @@
+#version 330 core
+
+in float fShade;
+out vec4 color;
+
+void main() {
+        // Round sprites
+        vec2 offset = gl_PointCoord - vec2(0.5);
+        if (dot(offset, offset) > 0.25)
+                discard;
+        color = vec4(fShade * vec3(0.55, 0.5, 0.45), 1.0);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+
+// One coordinate per attribute: the positions are uploaded as three separate arrays
+layout(location=0) in float vPositionX;
+layout(location=1) in float vPositionY;
+layout(location=2) in float vPositionZ;
+
+out float fShade;
+
+uniform mat4 viewMat, projMat;
+uniform vec3 center; // center of the belt relative to the camera
+
+void main() {
+        vec4 viewPosition = viewMat * vec4(center + vec3(vPositionX, vPositionY, vPositionZ), 1.0);
+        gl_Position = projMat * viewPosition;
+        // Closer particles are bigger, down to a single pixel
+        gl_PointSize = clamp(60.0 / -viewPosition.z, 1.0, 4.0);
+        // A stable pseudo-random shade per particle
+        fShade = 0.5 + 0.5 * fract(sin(float(gl_VertexID) * 12.9898) * 43758.5453);
+}
@@ -0,0 +1,73 @@
+#version 330 core
+
+in vec3 fPosition;
+
+out vec4 color;
+
+struct Material {
+    sampler2D albedoTex;
+};
+uniform Material material;
+uniform mat4 viewMat, projMat, modelMat;
+uniform vec3 camPos;
+uniform vec3 lightPos; // position of the Sun, relative to the camera like fPosition
+uniform bool lit; // lit like in planetFragmentShader.glsl, or only textured like the stars
+
+void main() {
+
+    // Ray from the camera through the quad, against the sphere. The distance between the center and
+    // the ray is computed directly, as the difference of the squared distances loses the small bodies.
+    vec3 center = modelMat[3].xyz;
+    float radius = length(modelMat[0].xyz);
+    vec3 dir = normalize(fPosition - camPos);
+    vec3 toCamera = camPos - center;
+    float b = dot(toCamera, dir);
+    vec3 closest = toCamera - b * dir;
+    float h = radius * radius - dot(closest, closest);
+    // The derivatives are only defined while the whole quad of pixels runs: everything they need is
+    // computed before the discard, the pixels off the sphere taking the point of the ray closest to it
+    vec3 position = camPos + (-b - sqrt(max(h, 0.0))) * dir;
+    vec3 norm = (position - center) / radius;
+
+    // Texture coordinates of SphereMesh::genSphere, in the frame of the unit sphere. Of the two
+    // versions of u, wrapping on opposite meridians, the one continuous over the pixel is used.
+    vec3 local = normalize(transpose(mat3(modelMat)) * norm);
+    float angle = atan(local.z, local.x) / 6.28318530717959;
+    float u1 = fract(angle), u2 = fract(angle + 0.5) - 0.5;
+    vec2 texCoord1 = vec2(u1, acos(clamp(local.y, -1.0, 1.0)) / 3.14159265358979);
+    vec2 texCoord2 = vec2(u2, texCoord1.y);
+    vec2 dx1 = dFdx(texCoord1), dy1 = dFdy(texCoord1);
+    vec2 dx2 = dFdx(texCoord2), dy2 = dFdy(texCoord2);
+    bool firstU = abs(dx1.x) + abs(dy1.x) <= abs(dx2.x) + abs(dy2.x); // fwidth(u1) <= fwidth(u2)
+    if (h < 0.0)
+        discard;
+
+    vec4 clipPosition = projMat * viewMat * vec4(position, 1.0);
+    gl_FragDepth = 0.5 * (gl_DepthRange.diff * clipPosition.z / clipPosition.w + gl_DepthRange.near + gl_DepthRange.far);
+
+    vec3 texColor = firstU ? textureGrad(material.albedoTex, texCoord1, dx1, dy1).rgb
+                           : textureGrad(material.albedoTex, texCoord2, dx2, dy2).rgb;
+    if (!lit) {
+        color = vec4(texColor, 1.0);
+        return;
+    }
+
+    vec3 lightColor = vec3(1.0f, 1.0f, 0.7f);
+    float ambientStrength = 0.2;
+    vec3 ambient = ambientStrength * lightColor;
+
+    // diffuse
+    vec3 lightDir = normalize(lightPos - position);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+
+    // specular
+    float specularStrength = 0.8;
+    vec3 viewDir = normalize(camPos - position);
+    vec3 reflectDir = reflect(-lightDir, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
+    vec3 specular = specularStrength * spec * lightColor;
+
+    vec3 result = (ambient + diffuse + specular) * texColor;
+    color = vec4(result, 1.0);
+}
@@ -0,0 +1,26 @@
+#version 330 core
+
+// Quad of the sphere impostor (see SphereImpostor), drawn as a strip of 4 vertices without attributes
+
+out vec3 fPosition; // point of the quad, relative to the camera like the planets
+
+uniform mat4 viewMat, projMat, modelMat; // the model matrix scales a unit sphere, as for the meshes
+uniform vec3 camPos;
+
+void main() {
+        vec3 center = modelMat[3].xyz;
+        float radius = length(modelMat[0].xyz);
+        vec3 toCenter = center - camPos;
+        float distance = length(toCenter);
+        vec3 forward = toCenter / distance;
+        vec3 up = abs(forward.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+        vec3 right = normalize(cross(forward, up));
+        up = cross(right, forward);
+
+        // In the plane of the center, the cone of the rays tangent to the sphere has a radius of
+        // radius * distance / sqrt(distance^2 - radius^2): the quad just covers it
+        float halfSize = radius * distance / sqrt(max(distance * distance - radius * radius, 1e-12));
+        vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+        fPosition = center + (corner.x * right + corner.y * up) * halfSize;
+        gl_Position = projMat * viewMat * vec4(fPosition, 1.0);
+}
@@ -12,10 +12,10 @@ struct Material {
 uniform Material material;
 uniform sampler2D ourTexture;
 uniform vec3 camPos;
+uniform vec3 lightPos; // position of the Sun, relative to the camera like fPosition
 
 void main() {
 
-    vec3 lightPos = vec3(0.0f, 0.0f, 0.0f);
     vec3 lightColor = vec3(1.0f, 1.0f, 0.7f);
     vec3 texColor = texture(material.albedoTex, fTexCoord).rgb;
     float ambientStrength = 0.2;
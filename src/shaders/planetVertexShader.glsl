@@ -1,7 +1,7 @@
 #version 330 core
 
 layout(location=0) in vec3 vPosition;
-layout(location=1) in vec3 vNormal;
+layout(location=1) in vec3 vNormal; // octahedral encoding in xy when octahedralNormals is set
 layout(location=2) in vec2 vTexCoord;
 
 out vec3 fNormal;
@@ -9,10 +9,44 @@ out vec3 fPosition;
 out vec2 fTexCoord;
 
 uniform mat4 viewMat, projMat, modelMat;
+uniform bool octahedralNormals;
+uniform vec2 texCoordScale;
+uniform int proceduralResolution; // see ProceduralSphere
+
+// Vertex gl_VertexID of the UV sphere of SphereMesh::genSphere, without its index buffer: the quads
+// of ring i and column j are split into the triangles (i, j) (i, j + 1) (i + 1, j) and
+// (i, j + 1) (i + 1, j + 1) (i + 1, j)
+void proceduralVertex(out vec3 position, out vec2 texCoord) {
+        const int corners[6] = int[6](0, 1, 2, 1, 3, 2);
+        int quad = gl_VertexID / 6;
+        int corner = corners[gl_VertexID % 6];
+        int i = quad / proceduralResolution + corner / 2;
+        int j = quad % proceduralResolution + corner % 2;
+        float phi = 3.14159265358979 * float(i) / float(proceduralResolution);
+        float theta = 6.28318530717959 * float(j % proceduralResolution) / float(proceduralResolution); // the last column is the first one
+        float sinPhi = (i == 0 || i == proceduralResolution) ? 0.0 : sin(phi); // the poles are on the axis
+        position = vec3(sinPhi * cos(theta), cos(phi), sinPhi * sin(theta));
+        texCoord = vec2(j, i) / float(proceduralResolution);
+}
+
+// Unfolds the lower half of the octahedron, see SphereMesh::unpackVertex
+vec3 decodeOctahedral(vec2 e) {
+        vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+        float t = max(-n.z, 0.0);
+        n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+        return normalize(n);
+}
 
 void main() {
-        fNormal = mat3(transpose(inverse(modelMat))) * vNormal;
-        fPosition = vec3(modelMat * vec4(vPosition, 1.0));
-        fTexCoord = vTexCoord;
-        gl_Position = projMat * viewMat * modelMat * vec4(vPosition, 1.0);
+        vec3 position = vPosition;
+        vec3 normal = octahedralNormals ? decodeOctahedral(vNormal.xy) : vNormal;
+        vec2 texCoord = vTexCoord * texCoordScale;
+        if (proceduralResolution > 0) {
+                proceduralVertex(position, texCoord);
+                normal = position;
+        }
+        fNormal = mat3(transpose(inverse(modelMat))) * normal;
+        fPosition = vec3(modelMat * vec4(position, 1.0));
+        fTexCoord = texCoord;
+        gl_Position = projMat * viewMat * modelMat * vec4(position, 1.0);
 }
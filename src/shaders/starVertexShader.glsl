@@ -4,9 +4,30 @@ layout(location=2) in vec2 vTexCoord;
 
 out vec2 fTexCoord;
 uniform mat4 viewMat, projMat, modelMat;
+uniform vec2 texCoordScale; // see SphereMesh::kTexCoordScaleU
+uniform int proceduralResolution; // see ProceduralSphere
+
+// Vertex gl_VertexID of the UV sphere of SphereMesh::genSphere, without its index buffer: the quads
+// of ring i and column j are split into the triangles (i, j) (i, j + 1) (i + 1, j) and
+// (i, j + 1) (i + 1, j + 1) (i + 1, j)
+void proceduralVertex(out vec3 position, out vec2 texCoord) {
+    const int corners[6] = int[6](0, 1, 2, 1, 3, 2);
+    int quad = gl_VertexID / 6;
+    int corner = corners[gl_VertexID % 6];
+    int i = quad / proceduralResolution + corner / 2;
+    int j = quad % proceduralResolution + corner % 2;
+    float phi = 3.14159265358979 * float(i) / float(proceduralResolution);
+    float theta = 6.28318530717959 * float(j % proceduralResolution) / float(proceduralResolution); // the last column is the first one
+    float sinPhi = (i == 0 || i == proceduralResolution) ? 0.0 : sin(phi); // the poles are on the axis
+    position = vec3(sinPhi * cos(theta), cos(phi), sinPhi * sin(theta));
+    texCoord = vec2(j, i) / float(proceduralResolution);
+}
 
 void main()
 {
-    fTexCoord = vTexCoord;
-    gl_Position = projMat * viewMat * modelMat * vec4(vPosition, 1.0);
+    vec3 position = vPosition;
+    fTexCoord = vTexCoord * texCoordScale;
+    if (proceduralResolution > 0)
+        proceduralVertex(position, fTexCoord);
+    gl_Position = projMat * viewMat * modelMat * vec4(position, 1.0);
 }
\ No newline at end of file